@@ -0,0 +1,67 @@
+#include "RepoGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+RepoGenerator::RepoGenerator(const GeneratorOptions &options) : options(options), rng(options.seed)
+{
+    // Spread files over a fixed directory fan-out so depth and width are both controllable
+    paths.reserve(options.fileCount);
+    for (size_t i = 0; i < options.fileCount; ++i)
+    {
+        std::string path;
+        size_t bucket = i;
+        for (size_t level = 0; level < options.directoryDepth; ++level)
+        {
+            path += "d" + std::to_string(bucket % options.directoryFanout) + "/";
+            bucket /= options.directoryFanout;
+        }
+        paths.push_back(path + "file_" + std::to_string(i) + ".txt");
+    }
+}
+
+size_t RepoGenerator::drawSize()
+{
+    // Inverse power transform of a uniform sample: skew > 1 concentrates mass near minFileSize
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    double u = std::pow(unit(rng), options.sizeSkew);
+    return options.minFileSize + static_cast<size_t>(u * (options.maxFileSize - options.minFileSize));
+}
+
+void RepoGenerator::writeRandomFile(const std::string &path, size_t size)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 \n";
+    std::string content(size, ' ');
+    for (char &c : content)
+    {
+        c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << content;
+    bytes += size;
+}
+
+void RepoGenerator::writeWorkingTree(const std::string &root)
+{
+    for (const auto &path : paths)
+    {
+        fs::path full = fs::path(root) / path;
+        fs::create_directories(full.parent_path());
+        writeRandomFile(full.string(), drawSize());
+    }
+}
+
+size_t RepoGenerator::mutate(const std::string &root)
+{
+    size_t count = std::max<size_t>(1, static_cast<size_t>(paths.size() * options.churn));
+    std::uniform_int_distribution<size_t> pick(0, paths.size() - 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        writeRandomFile((fs::path(root) / paths[pick(rng)]).string(), drawSize());
+    }
+    return count;
+}
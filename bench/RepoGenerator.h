@@ -0,0 +1,42 @@
+#ifndef REPO_GENERATOR_H
+#define REPO_GENERATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct GeneratorOptions {
+    size_t fileCount = 1000;
+    size_t minFileSize = 64;
+    size_t maxFileSize = 16384;
+    double sizeSkew = 2.0;       // 1 = uniform sizes; larger values favour small files (power law)
+    size_t directoryDepth = 3;   // Directory levels above each file
+    size_t directoryFanout = 8;  // Subdirectories per level
+    size_t historyLength = 5;    // Commits on master after the initial one
+    size_t branchCount = 2;      // Branches forked from master
+    size_t commitsPerBranch = 2; // Commits made on each branch
+    double churn = 0.01;         // Fraction of files rewritten per commit
+    uint64_t seed = 42;
+};
+
+// Creates deterministic synthetic working trees and edits for benchmarking
+class RepoGenerator {
+private:
+    GeneratorOptions options;
+    std::mt19937_64 rng;
+    std::vector<std::string> paths;
+    uint64_t bytes = 0;
+
+    size_t drawSize();
+    void writeRandomFile(const std::string& path, size_t size);
+
+public:
+    explicit RepoGenerator(const GeneratorOptions& options);
+    void writeWorkingTree(const std::string& root); // Writes fileCount files under root
+    size_t mutate(const std::string& root);         // Rewrites a churn-sized random subset, returns the count
+    uint64_t bytesWritten() const { return bytes; }
+    const GeneratorOptions& getOptions() const { return options; }
+};
+
+#endif // REPO_GENERATOR_H
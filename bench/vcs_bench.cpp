@@ -0,0 +1,374 @@
+#include "RepoGenerator.h"
+#include "../include/VCSCommands.h"
+#include "../include/Stats.h"
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+// Accumulated wall time per command at one scale
+struct CommandTiming {
+    size_t runs = 0;
+    size_t failures = 0; // Runs that threw or reported failure; still timed
+    double totalSeconds = 0;
+};
+
+// Discards the commands' progress output so it does not dominate the timings
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+static void printUsage()
+{
+    std::cout << "Usage: vcs_bench [options]\n";
+    std::cout << "  --scales <n,n,...>          File counts to benchmark (default 1000; e.g. 1000,100000,1000000)\n";
+    std::cout << "  --workdir <dir>             Where synthetic repositories are created (default ./vcs_bench_repos)\n";
+    std::cout << "  --out <file>                Append JSON lines results to file (default stdout)\n";
+    std::cout << "  --min-size <bytes>          Smallest generated file (default 64)\n";
+    std::cout << "  --max-size <bytes>          Largest generated file (default 16384)\n";
+    std::cout << "  --size-skew <x>             1 = uniform, larger favours small files (default 2)\n";
+    std::cout << "  --depth <n>                 Directory depth (default 3)\n";
+    std::cout << "  --fanout <n>                Subdirectories per level (default 8)\n";
+    std::cout << "  --history <n>               Commits on master after the initial one (default 5)\n";
+    std::cout << "  --branches <n>              Branches forked from master (default 2)\n";
+    std::cout << "  --branch-commits <n>        Commits per branch (default 2)\n";
+    std::cout << "  --churn <fraction>          Fraction of files rewritten per commit (default 0.01)\n";
+    std::cout << "  --seed <n>                  Generator seed (default 42)\n";
+    std::cout << "  --large-file-mb <n>         Size of the large-file dedup scenario, 0 to skip (default 32)\n";
+    std::cout << "  --append-kb <n>             Bytes appended between its two commits, in KiB (default 1)\n";
+    std::cout << "  --keep                      Keep generated repositories\n";
+}
+
+// A whole-string non-negative decimal integer; false for anything else ("x", "5x", "", "-1")
+template <typename Integer>
+static bool parseCount(const std::string &text, Integer &value)
+{
+    const char *end = text.data() + text.size();
+    auto [stop, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && stop == end;
+}
+
+// A whole-string finite non-negative number
+static bool parseNumber(const std::string &text, double &value)
+{
+    if (text.empty() || std::isspace(static_cast<unsigned char>(text[0])))
+        return false;
+    char *stop = nullptr;
+    errno = 0;
+    double parsed = std::strtod(text.c_str(), &stop);
+    if (errno != 0 || stop != text.c_str() + text.size() || !std::isfinite(parsed) || parsed < 0)
+        return false;
+    value = parsed;
+    return true;
+}
+
+static bool parseScales(const std::string &list, std::vector<size_t> &scales)
+{
+    scales.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        size_t scale;
+        if (!parseCount(item, scale) || scale == 0)
+            return false;
+        scales.push_back(scale);
+    }
+    return !scales.empty();
+}
+
+// Commits a large file, appends to it and commits again; reports chunk dedup ratio and throughput.
+// False if a step failed (reported on stderr).
+static bool benchLargeFile(const fs::path &workRoot, size_t sizeMB, size_t appendKB, uint64_t seed, std::ostream &results)
+{
+    fs::path repoDir = workRoot / "repo_large_file";
+    fs::remove_all(repoDir);
+    fs::create_directories(repoDir);
+    fs::path originalCwd = fs::current_path();
+    fs::current_path(repoDir);
+
+    std::mt19937_64 rng(seed);
+    auto appendRandom = [&rng](size_t bytes)
+    {
+        std::vector<uint64_t> words(bytes / sizeof(uint64_t) + 1);
+        for (auto &word : words)
+        {
+            word = rng();
+        }
+        std::ofstream file("large.bin", std::ios::binary | std::ios::app);
+        file.write(reinterpret_cast<const char *>(words.data()), static_cast<std::streamsize>(bytes));
+    };
+
+    NullBuffer nullBuffer;
+    std::streambuf *coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    // Held back until stdout is restored, since results may be stdout itself
+    std::vector<nlohmann::json> records;
+    std::string error;
+    try
+    {
+        VCSCommands::init();
+        for (int round = 0; round < 2; ++round)
+        {
+            appendRandom(round == 0 ? sizeMB * 1024 * 1024 : appendKB * 1024);
+            uint64_t fileBytes = fs::file_size("large.bin");
+            uint64_t logicalBefore = Stats::get(Counter::ChunkBytesLogical);
+            uint64_t storedBefore = Stats::get(Counter::ChunkBytesStored);
+
+            auto start = std::chrono::steady_clock::now();
+            VCSCommands::add("large.bin");
+            if (!VCSCommands::commit("large file " + std::to_string(round)))
+            {
+                throw std::runtime_error("commit failed");
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            uint64_t logical = Stats::get(Counter::ChunkBytesLogical) - logicalBefore;
+            uint64_t stored = Stats::get(Counter::ChunkBytesStored) - storedBefore;
+            nlohmann::json record;
+            record["scale"] = fileBytes;
+            record["command"] = round == 0 ? "large_file_commit" : "large_file_append_commit";
+            record["runs"] = 1;
+            record["total_seconds"] = seconds;
+            record["logical_bytes"] = logical;
+            record["stored_bytes"] = stored;
+            record["dedup_ratio"] = stored ? static_cast<double>(logical) / stored : 0.0;
+            record["throughput_mb_s"] = seconds > 0 ? fileBytes / (1024.0 * 1024.0) / seconds : 0.0;
+            records.push_back(record);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+    }
+
+    std::cout.rdbuf(coutBuffer);
+    fs::current_path(originalCwd);
+    for (const auto &record : records)
+    {
+        results << record.dump() << std::endl;
+    }
+    if (!error.empty())
+    {
+        std::cerr << "Large file scenario: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions options;
+    std::vector<size_t> scales = {1000};
+    std::string workdir = "vcs_bench_repos";
+    std::string outPath;
+    bool keep = false;
+    size_t largeFileMB = 32;
+    size_t appendKB = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string value = (i + 1 < argc) ? argv[i + 1] : "";
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (arg == "--keep")
+        {
+            keep = true;
+            continue;
+        }
+        else if (value.empty())
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+        bool valid = true;
+        if (arg == "--scales") valid = parseScales(value, scales);
+        else if (arg == "--workdir") workdir = value;
+        else if (arg == "--out") outPath = value;
+        else if (arg == "--min-size") valid = parseCount(value, options.minFileSize);
+        else if (arg == "--max-size") valid = parseCount(value, options.maxFileSize);
+        else if (arg == "--size-skew") valid = parseNumber(value, options.sizeSkew) && options.sizeSkew > 0;
+        else if (arg == "--depth") valid = parseCount(value, options.directoryDepth);
+        else if (arg == "--fanout") valid = parseCount(value, options.directoryFanout) && options.directoryFanout > 0;
+        else if (arg == "--history") valid = parseCount(value, options.historyLength);
+        else if (arg == "--branches") valid = parseCount(value, options.branchCount);
+        else if (arg == "--branch-commits") valid = parseCount(value, options.commitsPerBranch);
+        else if (arg == "--churn") valid = parseNumber(value, options.churn) && options.churn <= 1;
+        else if (arg == "--seed") valid = parseCount(value, options.seed);
+        else if (arg == "--large-file-mb") valid = parseCount(value, largeFileMB);
+        else if (arg == "--append-kb") valid = parseCount(value, appendKB);
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+        if (!valid)
+        {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            printUsage();
+            return 1;
+        }
+        ++i;
+    }
+    if (options.minFileSize > options.maxFileSize)
+    {
+        std::cerr << "--min-size is larger than --max-size" << std::endl;
+        printUsage();
+        return 1;
+    }
+
+    std::ofstream outFile;
+    if (!outPath.empty())
+    {
+        outFile.open(outPath, std::ios::app);
+    }
+    std::ostream &results = outPath.empty() ? std::cout : outFile;
+
+    fs::path originalCwd = fs::current_path();
+    fs::path workRoot = fs::absolute(workdir);
+    NullBuffer nullBuffer;
+    bool failed = false;
+
+    for (size_t scale : scales)
+    {
+        options.fileCount = scale;
+        RepoGenerator generator(options);
+        std::map<std::string, CommandTiming> timings;
+
+        fs::path repoDir = workRoot / ("repo_" + std::to_string(scale));
+        fs::remove_all(repoDir);
+        fs::create_directories(repoDir);
+
+        auto generateStart = std::chrono::steady_clock::now();
+        generator.writeWorkingTree(repoDir.string());
+        double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - generateStart).count();
+
+        fs::current_path(repoDir);
+        std::streambuf *coutBuffer = std::cout.rdbuf(&nullBuffer);
+        std::streambuf *cerrBuffer = std::cerr.rdbuf(&nullBuffer);
+
+        // One failing step is reported after the scale instead of ending the whole run
+        std::vector<std::string> errors;
+        auto timed = [&](const std::string &command, const std::function<bool()> &run)
+        {
+            auto &timing = timings[command];
+            auto start = std::chrono::steady_clock::now();
+            try
+            {
+                if (!run())
+                {
+                    timing.failures++;
+                    errors.push_back(command + ": failed");
+                }
+            }
+            catch (const std::exception &e)
+            {
+                timing.failures++;
+                errors.push_back(command + ": " + e.what());
+            }
+            timing.runs++;
+            timing.totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        timed("init", [] { VCSCommands::init(); return true; });
+        timed("add", [] { VCSCommands::add("all"); return true; });
+        timed("commit", [] { return VCSCommands::commit("initial"); });
+
+        for (size_t h = 0; h < options.historyLength; ++h)
+        {
+            generator.mutate(".");
+            timed("add", [] { VCSCommands::add("all"); return true; });
+            timed("commit", [h] { return VCSCommands::commit("history " + std::to_string(h)); });
+        }
+
+        // Fan out branches from master, then bring each back with checkout + merge
+        std::vector<std::string> branches;
+        for (size_t b = 0; b < options.branchCount; ++b)
+        {
+            std::string branchName = "bench_" + std::to_string(b);
+            branches.push_back(branchName);
+            timed("checkout", [] { return VCSCommands::checkout("master"); });
+            timed("branch", [&branchName] { return VCSCommands::branch(branchName); });
+            for (size_t c = 0; c < options.commitsPerBranch; ++c)
+            {
+                generator.mutate(".");
+                timed("add", [] { VCSCommands::add("all"); return true; });
+                timed("commit", [&branchName, c] { return VCSCommands::commit(branchName + " " + std::to_string(c)); });
+            }
+        }
+
+        timed("checkout", [] { return VCSCommands::checkout("master"); });
+        for (const auto &branchName : branches)
+        {
+            timed("merge", [&branchName] { return VCSCommands::merge(branchName); });
+        }
+        timed("log", [] { VCSCommands::log(); return true; });
+        timed("graph", [] { VCSCommands::graph(); return true; });
+
+        std::cout.rdbuf(coutBuffer);
+        std::cerr.rdbuf(cerrBuffer);
+        fs::current_path(originalCwd);
+        for (const auto &error : errors)
+        {
+            std::cerr << "Scale " << scale << ": " << error << std::endl;
+        }
+        failed = failed || !errors.empty();
+
+        for (const auto &[command, timing] : timings)
+        {
+            nlohmann::json record;
+            record["scale"] = scale;
+            record["command"] = command;
+            record["runs"] = timing.runs;
+            record["failures"] = timing.failures;
+            record["total_seconds"] = timing.totalSeconds;
+            record["mean_seconds"] = timing.totalSeconds / timing.runs;
+            results << record.dump() << "\n";
+        }
+
+        nlohmann::json summary;
+        summary["scale"] = scale;
+        summary["command"] = "generate";
+        summary["runs"] = 1;
+        summary["total_seconds"] = generateSeconds;
+        summary["bytes_generated"] = generator.bytesWritten();
+        results << summary.dump() << std::endl;
+
+        if (!keep)
+        {
+            fs::remove_all(repoDir);
+        }
+    }
+
+    if (largeFileMB > 0)
+    {
+        failed = !benchLargeFile(workRoot, largeFileMB, appendKB, options.seed, results) || failed;
+        if (!keep)
+        {
+            fs::remove_all(workRoot / "repo_large_file");
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "Tree.h"
+
+struct ArchiveOptions {
+    std::string prefix;    // Prepended to every member name, e.g. "project-1.0/"
+    bool gzip = false;     // Compress the stream (needs zlib at build time)
+    int64_t mtime = 0;     // Modification time recorded for every member
+};
+
+// Streams a commit's tree as a POSIX ustar archive straight from the object store. Members are
+// written in tree (path) order and file contents are copied through one fixed-size buffer, so
+// memory use does not depend on the size of the tree or its files; the worktree is not touched.
+class Archive {
+public:
+    static bool gzipAvailable();
+    // Returns false if a blob is missing or the output fails; the archive is then incomplete
+    static bool write(const Tree& tree, std::ostream& out, const ArchiveOptions& options);
+};
+
+#endif // ARCHIVE_H
@@ -0,0 +1,28 @@
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where one line of a file came from
+struct BlameLine {
+    std::string commitId;     // Commit that introduced the line
+    std::string timestamp;
+    uint32_t originalLine;    // 1-based line number in that commit's version of the file
+    std::string text;
+};
+
+// Line-level blame. The history walk only reads each commit's directory_tree entry for the path,
+// passes over commits where the blob did not change, and diffs blobs only where it did. Results
+// are cached per (commit that introduced a blob, path) under `.vcs/cache/blame/`; history is
+// immutable, so a later blame reuses every cached version it reaches instead of walking past it.
+class Blame {
+public:
+    // Blames `path` (relative to the repository root) as of `commitId`; false with `error` set
+    // if the commit or path does not exist or the file is binary
+    static bool run(const std::string& commitId, const std::string& path, std::vector<BlameLine>& lines,
+                    std::string& error);
+};
+
+#endif // BLAME_H
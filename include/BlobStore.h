@@ -0,0 +1,36 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Digest.h"
+
+// Moves file contents in and out of `.vcs/data/hash/<hash>/`. Small files are stored whole as
+// `blob`; files of at least chunkThreshold bytes are split by Chunker into `.vcs/data/chunks/` and
+// the hash folder only keeps a `chunks.json` list, so unchanged chunks are stored once. The fixed
+// names keep a user's file called `chunks.json` or `hash.json` from passing for the bookkeeping.
+class BlobStore {
+public:
+    static constexpr uint64_t chunkThreshold = 1024 * 1024;
+
+    static bool store(const std::string& sourcePath, const std::string& hashFolderPath);
+    static bool restore(const std::string& hashFolderPath, const std::string& destinationPath);
+    // Size of a stored blob without reading it (the manifest's size for chunked blobs)
+    static bool size(const std::string& hashFolderPath, uint64_t& size);
+    // Loads a whole blob (reassembling chunks) into memory
+    static bool read(const std::string& hashFolderPath, std::string& content);
+    // Restores many blobs at once: whole blobs go through IoEngine batches, chunked ones stream
+    // individually. Returns one success flag per (hashFolderPath, destinationPath) pair.
+    static std::vector<bool> restoreMany(const std::vector<std::pair<std::string, std::string>>& jobs);
+    static bool isChunked(const std::string& hashFolderPath);
+    // The file holding a whole blob, or "" if there is none. Folders written before the fixed
+    // name keep the blob under the original file name, which is still found.
+    static std::string contentPath(const std::string& hashFolderPath);
+    // `.vcs/data/hash/<hex>`, the folder holding one stored file
+    static std::string objectPath(const Digest& hash);
+    static std::string chunkPath(const Digest& chunkHash);
+};
+
+#endif // BLOB_STORE_H
@@ -0,0 +1,37 @@
+#ifndef CHANGED_PATH_FILTER_H
+#define CHANGED_PATH_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Tree.h"
+
+// A Bloom filter over the paths a commit changed relative to its first parent: every added,
+// removed or modified file plus each of their ancestor directories (so a directory pathspec can
+// be tested too). Stored beside the commit as `.vcs/bloom/<commit-id>.bloom`. A "no" answer is
+// certain, which lets `log -- <path>` skip most commits without loading their trees.
+class ChangedPathFilter {
+private:
+    static constexpr uint32_t bitsPerPath = 10;
+    static constexpr uint32_t hashCount = 7;     // Near-optimal for 10 bits per entry (~1% false positives)
+    static constexpr size_t maxPaths = 512;      // Larger changes are stored as "touches everything"
+
+    std::vector<uint64_t> bits;
+    bool saturated = false;
+
+public:
+    // Paths are repository-relative, '/'-separated, without "./"
+    static ChangedPathFilter build(const std::vector<std::string>& paths);
+    bool mightContain(std::string_view path) const;
+
+    static std::string filterPath(const std::string& commitId);
+    bool save(const std::string& commitId) const;
+    // False if the commit has no filter file (e.g. written by an older version)
+    static bool load(const std::string& commitId, ChangedPathFilter& filter);
+
+    // Files that differ between the trees, plus their ancestor directories, sorted and unique
+    static std::vector<std::string> changedPaths(const Tree& parent, const Tree& tree);
+};
+
+#endif // CHANGED_PATH_FILTER_H
@@ -0,0 +1,23 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// FastCDC content-defined chunker: gear rolling hash with normalized chunking, so an insert or
+// append only changes the chunks around the edit and the rest of the file deduplicates.
+class Chunker {
+public:
+    static constexpr size_t minSize = 16 * 1024;
+    static constexpr size_t averageSize = 64 * 1024;
+    static constexpr size_t maxSize = 256 * 1024;
+
+    // Length of the first chunk of data[0, length)
+    static size_t cut(const uint8_t* data, size_t length);
+    // Streams the file and calls onChunk for each chunk in order; false if the file cannot be read
+    static bool chunkFile(const std::string& filePath, const std::function<void(const uint8_t*, size_t)>& onChunk);
+};
+
+#endif // CHUNKER_H
@@ -1,34 +1,61 @@
 #ifndef COMMIT_GRAPH_H
 #define COMMIT_GRAPH_H
 
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
-#include <memory>
 
-struct CommitNode {
-    std::string commitId;
-    std::string message;
-    std::string timestamp;
-    std::vector<std::string> parents; // Supports multiple parents for merges
-
-    CommitNode(const std::string& id, const std::string& msg, const std::string& time, const std::vector<std::string>& parentIds)
-        : commitId(id), message(msg), timestamp(time), parents(parentIds) {}
+// Optional limits for graph output: only ancestors of `tip` (all heads when empty), at most `limit` commits (0 = no limit)
+struct GraphRange {
+    std::string tip;
+    size_t limit = 0;
 };
 
+// Offset/length of a string stored in CommitGraph's shared string pool
+struct PoolSpan {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
 
 class CommitGraph {
 private:
-    std::unordered_map<std::string, std::shared_ptr<CommitNode>> nodes; // Commit ID -> CommitNode
-
+    // Every commit is interned once into a dense index; all per-commit data lives in parallel arrays
+    std::unordered_map<std::string, uint32_t> index; // Commit ID -> dense index
+    std::vector<std::string> commitIds;              // Dense index -> Commit ID
+    std::vector<uint8_t> loaded;                     // Whether the commit file has been parsed
+    std::vector<PoolSpan> messages;
+    std::vector<PoolSpan> timestamps;
+    std::string stringPool; // Messages and timestamps packed back to back
+
+    // CSR parent adjacency: parents of commit i are parentIndices[parentOffsets[i] .. parentOffsets[i + 1])
+    std::vector<uint32_t> parentOffsets;
+    std::vector<uint32_t> parentIndices;
+    std::vector<std::pair<uint32_t, uint32_t>> pendingEdges; // (child, parent) collected while loading
+
+    std::string vcsPath;
+
+    uint32_t intern(const std::string& commitId);
+    PoolSpan pool(const std::string& value);
     void loadBranch(const std::string& branchFilePath);
-    void loadCommit(const std::string& commitId);
+    void loadCommit(uint32_t self);
+    void finalize();
+    std::vector<uint32_t> topologicalOrder(const GraphRange& range) const;
 
 public:
     CommitGraph();
     void buildGraph(const std::string& vcsPath);
-    void displayGraph(); // Prints the graph for visual inspection
-    std::string exportToDOT(); // Exports the graph in DOT format for tools like Graphviz
+    void writeAscii(std::ostream& out, const GraphRange& range = {}) const; // Lane view, newest commits first
+    void exportToDOT(std::ostream& out, const GraphRange& range = {}) const; // Exports the graph in DOT format for tools like Graphviz
+
+    size_t size() const { return commitIds.size(); }
+    const std::string& commitId(uint32_t i) const { return commitIds[i]; }
+    std::string_view message(uint32_t i) const { return {stringPool.data() + messages[i].offset, messages[i].length}; }
+    std::string_view timestamp(uint32_t i) const { return {stringPool.data() + timestamps[i].offset, timestamps[i].length}; }
+    const uint32_t* parentsBegin(uint32_t i) const { return parentIndices.data() + parentOffsets[i]; }
+    const uint32_t* parentsEnd(uint32_t i) const { return parentIndices.data() + parentOffsets[i + 1]; }
 };
 
 #endif // COMMIT_GRAPH_H
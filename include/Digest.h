@@ -0,0 +1,56 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+// A SHA-256 value as 32 raw bytes. All in-memory hashes use this; hex only appears when a
+// digest is printed, written to JSON or used as a file/directory name under `.vcs/`.
+// The all-zero value doubles as "no digest" (e.g. an unreadable file).
+struct Digest {
+    static constexpr size_t size = 32;
+    std::array<uint8_t, size> bytes{};
+
+    // Four 64-bit word compares; compilers turn this into a couple of vector compares
+    bool operator==(const Digest& other) const {
+        uint64_t a[4], b[4];
+        std::memcpy(a, bytes.data(), size);
+        std::memcpy(b, other.bytes.data(), size);
+        return ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) == 0;
+    }
+    bool operator!=(const Digest& other) const { return !(*this == other); }
+    bool operator<(const Digest& other) const { return std::memcmp(bytes.data(), other.bytes.data(), size) < 0; }
+    bool isNull() const { return *this == Digest{}; }
+
+    std::string hex() const;
+    // False (and `digest` untouched) unless `hex` is exactly 64 hex digits
+    static bool fromHex(std::string_view hex, Digest& digest);
+    static Digest of(const void* data, size_t length);
+    static Digest of(std::string_view data) { return of(data.data(), data.size()); }
+};
+
+static_assert(std::is_trivially_copyable_v<Digest> && sizeof(Digest) == Digest::size);
+
+// SHA-256 output is uniformly distributed, so its first word is already a good hash
+struct DigestHash {
+    size_t operator()(const Digest& digest) const {
+        size_t value;
+        std::memcpy(&value, digest.bytes.data(), sizeof(value));
+        return value;
+    }
+};
+
+template <>
+struct std::hash<Digest> : DigestHash {};
+
+// JSON stores digests as hex strings
+void to_json(nlohmann::json& json, const Digest& digest);
+void from_json(const nlohmann::json& json, Digest& digest);
+
+#endif // DIGEST_H
@@ -0,0 +1,42 @@
+#ifndef EWAH_BITMAP_H
+#define EWAH_BITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A bitmap compressed with EWAH (Enhanced Word-Aligned Hybrid, 64-bit words): a marker word
+// holds a run of all-0 or all-1 words (bit 0: the run's bit, bits 1-32: run length) and the
+// number of literal words that follow it (bits 33-63). Sparse and dense regions both shrink to
+// a marker, and OR / AND NOT run over the compressed words, skipping runs wholesale.
+class EwahBitmap {
+private:
+    std::vector<uint64_t> words;
+    uint64_t wordCount = 0; // Uncompressed length in 64-bit words
+
+    friend class EwahEncoder;
+
+public:
+    // Compresses a plain bitset (bit i of the bitmap is bit i%64 of word i/64)
+    static EwahBitmap fromWords(const std::vector<uint64_t>& plain);
+    // ORs this bitmap into a plain bitset, growing it as needed
+    void orInto(std::vector<uint64_t>& plain) const;
+
+    EwahBitmap operator|(const EwahBitmap& other) const;
+    // Bits set here but not in `other`
+    EwahBitmap andNot(const EwahBitmap& other) const;
+
+    uint64_t count() const;
+    bool get(uint64_t position) const;
+    // Calls visit(position) for every set bit, in increasing order
+    void forEach(const std::function<void(uint64_t)>& visit) const;
+
+    size_t compressedWords() const { return words.size(); }
+    // Little-endian word count and words
+    std::string serialize() const;
+    static bool deserialize(const std::string& data, EwahBitmap& bitmap);
+};
+
+#endif // EWAH_BITMAP_H
@@ -2,17 +2,49 @@
 #define FILESYSTEM_H
 
 #include <string>
+#include <filesystem>
+#include <vector>
 #include <nlohmann/json.hpp>
+#include "Tree.h"
+
+class IgnoreMatcher;
+class SparseCheckout;
+class WorkingTreeIndex;
 
 class FileSystem {
 public:
     static bool createDirectory(const std::string& path);
     static bool fileExists(const std::string& path);
-    static std::string calculateHash(const std::string& filePath);
-    static nlohmann::json getDirectoryTree(const std::string& directoryPath);
+    // Null digest if the file cannot be read
+    static Digest calculateHash(const std::string& filePath);
+    // Hashes many files at once through IoEngine's batched reads; null digests for unreadable files
+    static std::vector<Digest> calculateHashes(const std::vector<std::string>& filePaths);
+    // Ignored directories, and with a sparse checkout directories outside it, are pruned, never descended into.
+    // With an index, files whose size and mtime it already knows are not read at all. Throws if a
+    // file cannot be read.
+    static Tree getDirectoryTree(const std::string& directoryPath, const IgnoreMatcher* ignore = nullptr,
+                                 const SparseCheckout* sparse = nullptr, WorkingTreeIndex* index = nullptr);
+    // Path of `path` relative to `root`, '/'-separated and without a leading "./"
+    static std::string relativePath(const std::filesystem::path& path, const std::filesystem::path& root);
     static std::string readFile(const std::string& filePath);
     static bool writeFile(const std::string& filePath, const std::string& content);
+    // Writes a temporary sibling and renames it into place, so concurrent readers see the old or
+    // the new content, never a partial file
+    static bool replaceFile(const std::string& filePath, const std::string& content);
+    // Kernel-side copy (copy_file_range/sendfile) where available; all blob movement goes through these
     static bool copyFile(const std::string& source, const std::string& destination);
+    static bool concatenateFiles(const std::vector<std::string>& sources, const std::string& destination);
+    static nlohmann::json readJson(const std::string& filePath);
+    static bool writeJson(const std::string& filePath, const nlohmann::json& value);
+
+    // While deferred, writeJson() only keeps the value in memory; fileExists(), readFile() and
+    // readJson() see it, and flushWrites() puts everything on disk (`vcs batch` checkpoints).
+    // Directory listings do not see pending files.
+    static void deferWrites(bool enabled); // Disabling flushes
+    static bool deferringWrites();
+    static bool flushWrites();
+    // Removes a file or directory tree, including pending writes below it
+    static void removeAll(const std::string& path);
 };
 
 #endif // FILESYSTEM_H
@@ -0,0 +1,32 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct FsckOptions {
+    bool quick = false;   // Existence and sizes only; no content is hashed
+    unsigned threads = 0; // 0: one per hardware thread
+};
+
+struct FsckReport {
+    size_t objects = 0;
+    size_t chunks = 0;
+    size_t commits = 0;
+    size_t branches = 0;
+    std::vector<std::string> errors; // Sorted, one line per problem
+
+    bool ok() const { return errors.empty(); }
+};
+
+// Verifies the repository in `.vcs/`: every stored object hashes to its folder name (chunked
+// objects chunk by chunk and as a whole), every commit parses and references existing parents and
+// blobs, and every branch and the current branch point at existing commits. Objects and commits
+// are checked in parallel.
+class Fsck {
+public:
+    static FsckReport run(const FsckOptions& options = {});
+};
+
+#endif // FSCK_H
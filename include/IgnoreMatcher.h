@@ -0,0 +1,57 @@
+#ifndef IGNORE_MATCHER_H
+#define IGNORE_MATCHER_H
+
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compiled `.vcsignore` rules (gitignore semantics: `#` comments, `!` negation, trailing `/` for
+// directories only, patterns containing `/` are anchored to the root, `*`, `?`, `[...]` and `**`).
+// Literal patterns are answered with hash lookups; only real globs run the token matcher.
+class IgnoreMatcher {
+private:
+    enum class TokenType { Literal, AnySingle, Star, DoubleStar, Class };
+
+    struct Token {
+        TokenType type;
+        std::string literal;
+        std::bitset<256> set;
+    };
+
+    struct Rule {
+        int order;          // Position in the file; the last matching rule wins
+        bool negated;
+        bool directoryOnly;
+        bool anchored;      // Matched against the full relative path instead of the basename
+        std::vector<Token> tokens;
+    };
+
+    struct LiteralRule {
+        int order = -1;
+        bool negated = false;
+        bool directoryOnly = false;
+    };
+
+    std::unordered_map<std::string, std::vector<LiteralRule>> literalNames; // Unanchored literal basenames
+    std::unordered_map<std::string, std::vector<LiteralRule>> literalPaths; // Anchored literal paths
+    std::vector<Rule> globRules;                                            // Kept in file order
+    int ruleCount = 0;
+
+    static std::vector<Token> compile(const std::string& pattern);
+    static bool matchTokens(const std::vector<Token>& tokens, size_t t, std::string_view text, size_t i);
+
+public:
+    IgnoreMatcher();
+    void addPattern(const std::string& line);
+    // Reads `<root>/.vcsignore` if present; `.vcs` is always ignored
+    static IgnoreMatcher load(const std::string& root);
+
+    // `relativePath` uses '/' separators and no leading "./"
+    bool isIgnored(std::string_view relativePath, bool isDirectory) const;
+    // Also checks every ancestor directory, for paths that were not reached by a pruned walk
+    bool isPathIgnored(std::string_view relativePath) const;
+};
+
+#endif // IGNORE_MATCHER_H
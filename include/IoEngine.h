@@ -0,0 +1,32 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct WriteJob {
+    std::string path;
+    std::string data;
+    uint32_t mode = 0644;
+};
+
+// Batched whole-file I/O. On Linux the opens, statx calls, reads, writes and closes of a whole
+// batch are queued on an io_uring together; where io_uring is unavailable (other platforms, old
+// kernels or ones missing an opcode, seccomp, or VCS_NO_IO_URING set) the same calls fall back to
+// blocking I/O per file. A file the ring fails on is retried with blocking I/O before it counts
+// as failed.
+class IoEngine {
+public:
+    static constexpr unsigned queueDepth = 256;
+
+    static bool usingIoUring();
+    // Calls onFile(index, ok, contents, mode) once per path, in completion order
+    static void readFiles(const std::vector<std::string>& paths,
+                          const std::function<void(size_t, bool, std::string&, uint32_t)>& onFile);
+    // Creates or truncates every file and writes its data; false if any of them failed
+    static bool writeFiles(const std::vector<WriteJob>& jobs);
+};
+
+#endif // IO_ENGINE_H
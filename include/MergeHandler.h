@@ -4,14 +4,57 @@
 #include <string>
 #include <vector>
 #include <nlohmann/json.hpp>
+#include "Tree.h"
+#include "RenameDetector.h"
+
+// How a path came out of a three-way merge
+enum class MergeAction {
+    Unchanged, // Same on every side; not reported
+    Modified,
+    Added,
+    Deleted,
+    Conflict // Ours and theirs both changed it, differently
+};
+
+// Which side's change the merged tree takes; Both when ours and theirs made the same change
+enum class MergeSide { Ours, Theirs, Both };
+
+// One changed path; absent versions are null digests
+struct MergeEntry {
+    std::string path;
+    MergeAction action;
+    MergeSide side;
+    Digest base;
+    Digest ours;
+    Digest theirs;
+    std::string renamedFrom; // Rename/rename conflicts: the base path both sides moved, to different names
+};
+
+struct TreeMergeResult {
+    Tree tree;                       // Conflicting paths keep our version
+    std::vector<MergeEntry> changes; // Every path that is not Unchanged, in path order
+    size_t conflicts = 0;
+};
 
 class MergeHandler {
 public:
+    // Best common ancestor of two commits, following all parents; "" if the histories are unrelated
+    static std::string mergeBase(const std::string& ours, const std::string& theirs);
+    // Merge base of two branches' heads
     static std::string findCommonAncestor(const std::string& branch1, const std::string& branch2);
-    static nlohmann::json threeWayMerge(
-        const nlohmann::json& base, 
-        const nlohmann::json& branch1, 
-        const nlohmann::json& branch2
+
+    // One sorted merge-join over the three trees: O(base + ours + theirs)
+    static TreeMergeResult mergeTrees(const Tree& base, const Tree& ours, const Tree& theirs);
+    // mergeTrees after following renames: a file one side moved and the other side still has at
+    // the old path (possibly modified) is merged under the new path instead of conflicting as a
+    // modify/delete. `followed` lists the renames that were applied. A file both sides renamed,
+    // to different names, makes both new paths conflicts.
+    static TreeMergeResult mergeTreesFollowingRenames(const Tree& base, const Tree& ours, const Tree& theirs,
+                                                      std::vector<Rename>& followed);
+    static Tree threeWayMerge(
+        const Tree& base, 
+        const Tree& branch1, 
+        const Tree& branch2
     );
 };
 
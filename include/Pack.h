@@ -0,0 +1,49 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Digest.h"
+
+struct PackSummary {
+    size_t commits = 0;
+    size_t objects = 0;
+    size_t chunks = 0;
+    uint64_t bytes = 0; // Whole pack, trailer included
+};
+
+// A single sequential stream of commits and objects, used to move history between repositories.
+//
+//   "VCSPACK1"
+//   'H' <json>                                   header: {"refs": {...}}, passed through untouched
+//   'K' <digest> <u64 size> <bytes>              a chunk, before the first object that lists it
+//   'O' <digest> <name> <hash.json> <u64 size> <bytes>   a whole object (the name is informational)
+//   'M' <digest> <hash.json> <chunks.json>       a chunked object
+//   'C' <id> <commit json>
+//   'E' <sha256 of everything before it>
+//
+// Strings are a little-endian u64 length and the bytes; digests are 32 raw bytes. Paths are
+// repository roots (the directory holding `.vcs`).
+class Pack {
+public:
+    // Writes `commits` and `objects` from the repository at sourceRoot. Chunks for which
+    // `skipChunk` returns true are left out because the receiver already has them.
+    static bool write(std::ostream& out, const std::string& sourceRoot, const nlohmann::json& refs,
+                      const std::vector<std::string>& commits, const std::vector<Digest>& objects,
+                      const std::function<bool(const Digest&)>& skipChunk, PackSummary& summary, std::string& error);
+
+    // Unpacks into the repository at targetRoot in one pass. Chunks and objects are checked
+    // against their digests as they arrive; commits are only written once the trailing checksum
+    // matches, so a damaged or truncated pack never adds history. Returns the header's refs, which
+    // are rejected up front if a branch name is not a plain file name or a ref is malformed, and
+    // at the end if a head is neither in the pack nor already in the repository.
+    static bool read(std::istream& in, const std::string& targetRoot, nlohmann::json& refs, PackSummary& summary,
+                     std::string& error);
+};
+
+#endif // PACK_H
@@ -0,0 +1,61 @@
+#ifndef REACHABILITY_INDEX_H
+#define REACHABILITY_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Digest.h"
+#include "EwahBitmap.h"
+
+class Repository;
+
+// Reachability bitmaps (`vcs bitmap`): for selected commits, `.vcs/bitmaps/<commit>.ewah` holds
+// every commit and object reachable from it, one bit per position. `.vcs/bitmaps/positions`
+// numbers commits and objects in the order they were first indexed and is only ever appended
+// to, so a position never changes and a bitmap, like the commit it describes, never goes stale.
+//
+// reachable() ORs in the bitmap of every commit it meets that has one and walks trees only for
+// the commits in between, so "reachable from X but not Y" is two short walks and an AND NOT.
+class ReachabilityIndex {
+private:
+    struct Entry {
+        bool commit;
+        Digest object;        // Objects
+        std::string commitId; // Commits
+    };
+
+    Repository& repository;
+    std::vector<Entry> entries;
+    size_t persisted = 0; // Entries already in the positions file
+    uint64_t validBytes = 0;
+    std::unordered_map<Digest, uint32_t> objectPositions;
+    std::unordered_map<std::string, uint32_t> commitPositions;
+    std::unordered_set<std::string> bitmapCommits;
+    std::unordered_map<std::string, EwahBitmap> loaded;
+
+    uint32_t positionOf(const std::string& commitId);
+    uint32_t positionOf(const Digest& object);
+    bool savePositions();
+
+public:
+    explicit ReachabilityIndex(Repository& repository);
+
+    // Commits and objects reachable from any of `tips`
+    EwahBitmap reachable(const std::vector<std::string>& tips);
+
+    // Branch heads, plus every `spacing`th commit in topological order; ancestors come first, so
+    // each bitmap built can start from the previous ones
+    std::vector<std::string> selectCommits(size_t spacing = 100);
+    // Writes bitmaps for those of `commits` that have none yet; returns how many were written
+    size_t build(const std::vector<std::string>& commits);
+
+    size_t size() const { return entries.size(); }
+    size_t bitmapCount() const { return bitmapCommits.size(); }
+    bool isCommit(uint64_t position) const { return entries[position].commit; }
+    const std::string& commitId(uint64_t position) const { return entries[position].commitId; }
+    const Digest& object(uint64_t position) const { return entries[position].object; }
+};
+
+#endif // REACHABILITY_INDEX_H
@@ -0,0 +1,58 @@
+#ifndef REFS_H
+#define REFS_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Whole-repository reader/writer lock on `.vcs/lock`: read-only commands share it, commands that
+// change the repository hold it exclusively. Blocks until granted; released on destruction.
+// Advisory (flock) where available, a no-op elsewhere.
+class RepositoryLock {
+private:
+    int fd = -1;
+    bool held = true;
+
+public:
+    enum class Mode { Shared, Exclusive };
+    RepositoryLock(const std::string& vcsDirectory, Mode mode);
+    // Gives up after `timeoutMs`; check acquired(). For a second repository's lock, where two
+    // processes taking each other's locks in opposite order must not wait forever.
+    RepositoryLock(const std::string& vcsDirectory, Mode mode, int timeoutMs);
+    bool acquired() const { return held; }
+    ~RepositoryLock();
+    RepositoryLock(const RepositoryLock&) = delete;
+    RepositoryLock& operator=(const RepositoryLock&) = delete;
+};
+
+// Branch and current-branch files ("refs") are only changed through compare-and-swap: the ref's
+// `<ref>.lock` is created exclusively, the ref's "head" is checked against the value the caller
+// based its change on, and the new content is written to the lock file and renamed over the ref.
+// Readers therefore never see a half-written ref, and a writer that lost a race fails instead
+// of silently overwriting the winner.
+class Refs {
+public:
+    static constexpr int lockTimeoutMs = 5000;
+
+    // Applies `change` to the ref's JSON if its "head" is still `expectedHead` ("" matches a ref
+    // that does not exist yet or has no head). On failure the ref is untouched and `error` says why.
+    static bool update(const std::string& refPath, const std::string& expectedHead,
+                       const std::function<void(nlohmann::json&)>& change, std::string& error);
+    // One ref's part in a multi-ref update
+    struct Change {
+        std::string refPath;
+        std::string expectedHead;
+        std::function<void(nlohmann::json&)> change;
+    };
+    // Locks every ref and checks every expected head before writing any of them, so a lost race
+    // on any ref leaves all of them untouched. Only a failed write can leave the refs before it
+    // updated and the rest not.
+    static bool update(const std::vector<Change>& changes, std::string& error);
+    // Creates a ref that must not exist yet
+    static bool create(const std::string& refPath, const nlohmann::json& value, std::string& error);
+    // The ref's "head", or "" if it does not exist
+    static std::string head(const std::string& refPath);
+};
+
+#endif // REFS_H
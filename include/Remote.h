@@ -0,0 +1,49 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Pack.h"
+
+class Repository;
+
+struct RefUpdate {
+    enum class Kind { UpToDate, Create, FastForward, NonFastForward };
+
+    std::string branch;
+    std::string oldHead; // "" if the receiver does not have the branch
+    std::string newHead;
+    Kind kind = Kind::UpToDate;
+    nlohmann::json ref; // The sender's branch file, written as is
+};
+
+// Moves history between two repositories on local paths (push/pull). The receiver advertises
+// what it has simply by its `.vcs/commits` listing: the sender walks back from the heads being
+// sent and stops at the first commit the receiver already has, then sends only the objects and
+// chunks of the new commits the receiver lacks, as one pack.
+class Remote {
+public:
+    // How long push/pull wait for the other repository's lock. The local one is already held, so
+    // two processes pushing/pulling between the same repositories in opposite directions would
+    // otherwise wait for each other forever.
+    static constexpr int lockTimeoutMs = 10000;
+
+    // Root of the repository at `path`, which may be a working tree or its `.vcs` directory;
+    // "" if there is none
+    static std::string locate(const std::string& path);
+
+    // True if `ancestor` is `tip` or reachable from it
+    static bool isAncestor(Repository& repository, const std::string& ancestor, const std::string& tip);
+
+    // Compares `branches` (all of the sender's if empty) between the two repositories, transfers
+    // whatever the creates and fast-forwards need, and returns one update per branch. Refs are not
+    // touched; apply the updates with updateRef().
+    static bool fetch(const std::string& fromRoot, const std::string& toRoot, const std::vector<std::string>& branches,
+                      std::vector<RefUpdate>& updates, PackSummary& summary, std::string& error);
+
+    // Compare-and-swap of the receiver's branch file from update.oldHead to update.newHead
+    static bool updateRef(const std::string& root, const RefUpdate& update, std::string& error);
+};
+
+#endif // REMOTE_H
@@ -0,0 +1,30 @@
+#ifndef RENAME_DETECTOR_H
+#define RENAME_DETECTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Tree.h"
+
+struct Rename {
+    std::string from;
+    std::string to;
+    uint32_t similarity; // Percent; 100 for identical content
+    bool copy;           // The source is still present in the new tree
+};
+
+// Finds files that moved between two trees. Identical blobs are paired by digest first. The
+// remaining deleted and added files get a MinHash sketch of their lines, and LSH buckets over the
+// sketch bands pick the candidate pairs, so only files likely to be similar are ever compared;
+// thousands of moved files cost about one sketch each rather than one comparison per pair.
+class RenameDetector {
+public:
+    static constexpr uint32_t defaultMinSimilarity = 50;
+    static constexpr uint64_t maxSketchBytes = 32 * 1024 * 1024; // Larger files only match exactly
+
+    // With `copies`, added files identical to a file still present in the old tree are reported too
+    static std::vector<Rename> detect(const Tree& oldTree, const Tree& newTree,
+                                      uint32_t minSimilarity = defaultMinSimilarity, bool copies = false);
+};
+
+#endif // RENAME_DETECTOR_H
@@ -0,0 +1,106 @@
+#ifndef REPOSITORY_H
+#define REPOSITORY_H
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Tree.h"
+#include "WorkingTreeIndex.h"
+
+// A commit as stored in `.vcs/commits/<id>.json`, parsed once
+struct CommitInfo {
+    std::string id;
+    std::string branch;
+    std::vector<std::string> parents; // First parent first; empty for a root commit
+    std::string message;
+    std::string timestamp;
+    Tree tree;
+
+    std::string firstParent() const { return parents.empty() ? "" : parents.front(); }
+};
+
+// An open repository, for tools that embed vcscore instead of running the CLI. Keeps what the
+// commands would otherwise re-read on every call: refs (re-validated by size and mtime, so writes
+// by other processes are seen), recently used commits (LRU), and the working-tree index.
+//
+// VCSCommands works on paths relative to the working directory; run() switches to this
+// repository's root for the duration of a command and routes the commands' reads through this
+// handle's caches. Not thread-safe, and only one repository can be running a command at a time.
+class Repository {
+private:
+    struct CachedRef {
+        std::filesystem::file_time_type mtime;
+        uintmax_t size;
+        nlohmann::json value;
+    };
+    using CommitList = std::list<std::pair<std::string, std::shared_ptr<const CommitInfo>>>;
+
+    std::filesystem::path rootPath;
+    std::unordered_map<std::string, CachedRef> refs; // Keyed by path below `.vcs/`
+    size_t commitCapacity;
+    CommitList commits; // Most recently used first
+    std::unordered_map<std::string, CommitList::iterator> commitsById;
+    WorkingTreeIndex index;
+    bool indexLoaded = false;
+
+    const nlohmann::json& readRef(const std::string& relativePath);
+
+public:
+    explicit Repository(const std::filesystem::path& root = ".", size_t commitCacheSize = 4096);
+
+    // The repository whose commands are running: the one inside run(), else the working directory's
+    static Repository& active();
+
+    bool exists() const;
+    const std::filesystem::path& root() const { return rootPath; }
+    // Absolute path of a file below `.vcs/`
+    std::string vcsPath(const std::string& relativePath) const;
+
+    std::string currentBranch();
+    // Head of the checked-out branch as recorded in current_branch.json ("" before the first commit)
+    std::string head();
+    // "" if the branch does not exist or has no commits
+    std::string branchHead(const std::string& branch);
+    std::vector<std::string> branches();
+    // Branch name or commit ID to a commit ID; "" if neither exists
+    std::string resolve(const std::string& revision);
+
+    // Null for "", "null" or a missing commit
+    std::shared_ptr<const CommitInfo> commit(const std::string& commitId);
+    // Empty for "", "null" or a missing commit
+    Tree commitTree(const std::string& commitId);
+
+    // The working tree with `.vcs/`, ignored and non-sparse paths pruned; only files whose size or
+    // mtime changed since the last scan are hashed. Keys are "./"-prefixed like commit trees.
+    Tree workingTree();
+
+    // Writes everything held back while FileSystem writes are deferred, and the index
+    bool checkpoint();
+
+    // Runs `command` (typically a VCSCommands call) with this repository as the working directory
+    template <typename Command>
+    void run(Command&& command);
+
+private:
+    class Session {
+    private:
+        Repository* previousActive;
+        std::filesystem::path previousDirectory;
+
+    public:
+        explicit Session(Repository& repository);
+        ~Session();
+    };
+};
+
+template <typename Command>
+void Repository::run(Command&& command) {
+    Session session(*this);
+    command();
+}
+
+#endif // REPOSITORY_H
@@ -0,0 +1,30 @@
+#ifndef SPARSE_CHECKOUT_H
+#define SPARSE_CHECKOUT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The path prefixes a sparse checkout materializes, kept as `sparse_paths` in `.vcs/config.json`.
+// With no prefixes configured every path is included. Paths use '/' separators and no leading "./".
+class SparseCheckout {
+private:
+    std::vector<std::string> prefixes; // Normalized and sorted
+
+public:
+    SparseCheckout() = default;
+    explicit SparseCheckout(const std::vector<std::string>& paths);
+    // Reads `<root>/.vcs/config.json`; a missing file or key means a full checkout
+    static SparseCheckout load(const std::string& root);
+    // Strips "./", leading and trailing '/' and backslashes; "" or "." selects the whole tree
+    static std::string normalize(std::string_view path);
+
+    bool enabled() const { return !prefixes.empty(); }
+    const std::vector<std::string>& paths() const { return prefixes; }
+    // The file is one of the prefixes or lies below one
+    bool includes(std::string_view relativePath) const;
+    // A scan must enter the directory: it is included or leads to an included prefix
+    bool shouldDescend(std::string_view relativeDirectory) const;
+};
+
+#endif // SPARSE_CHECKOUT_H
@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <nlohmann/json.hpp>
+
+enum class Counter {
+    FilesStatted,
+    FilesHashed,
+    BytesHashed,
+    BytesWritten,
+    ObjectsCreated,
+    ObjectsDeduplicated,
+    JsonBytesParsed,
+    JsonBytesSerialized,
+    CacheHits,
+    CacheMisses,
+    ChunksCreated,
+    ChunksDeduplicated,
+    ChunkBytesLogical,
+    ChunkBytesStored,
+    BloomChecks,
+    BloomNegatives,
+    BloomFalsePositives,
+    IndexHits,
+    Count
+};
+
+// Process-wide operation counters; relaxed atomics so they are cheap enough to leave on everywhere
+class Stats {
+private:
+    static std::atomic<uint64_t> counters[static_cast<size_t>(Counter::Count)];
+
+public:
+    static void add(Counter counter, uint64_t amount = 1) {
+        counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    static uint64_t get(Counter counter) {
+        return counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    static const char* name(Counter counter);
+    static nlohmann::json snapshot();
+    static void print(std::ostream& out, const nlohmann::json& values);
+    // Adds this process's counters to the per-command totals in .vcs/stats.json
+    static void persist(const std::string& command);
+    static void report(); // Prints the cumulative totals (`vcs stats`)
+};
+
+#endif // STATS_H
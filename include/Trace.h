@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Opt-in phase tracing. Events go to a per-thread buffer and are written as Chrome trace-event JSON
+// (viewable in Perfetto / chrome://tracing). When tracing is off a scope costs one relaxed load.
+class Trace {
+private:
+    static std::atomic<bool> active;
+
+public:
+    static void enable();
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+    static uint64_t nowMicros();
+    static void record(const char* name, uint64_t startMicros, uint64_t durationMicros);
+    static bool writeChromeTrace(const std::string& path);
+};
+
+class TraceScope {
+private:
+    const char* name;
+    uint64_t start;
+
+public:
+    explicit TraceScope(const char* name) : name(name), start(Trace::enabled() ? Trace::nowMicros() : 0) {}
+    ~TraceScope() {
+        if (start) Trace::record(name, start, Trace::nowMicros() - start);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define VCS_TRACE_CONCAT_INNER(a, b) a##b
+#define VCS_TRACE_CONCAT(a, b) VCS_TRACE_CONCAT_INNER(a, b)
+#define VCS_TRACE_SCOPE(name) TraceScope VCS_TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,79 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "Digest.h"
+
+// A directory tree (path -> SHA-256 of the file) as one sorted array of fixed-size entries.
+// Paths live back to back in a single arena string, and digests are stored as 32 raw bytes,
+// so an entry costs 40 bytes plus its path instead of a map node and two heap strings.
+// JSON (`{"./path": "<hex>"}`) is only produced or parsed at the storage boundary.
+class Tree {
+private:
+    struct Entry {
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        Digest digest;
+    };
+
+    std::string arena;
+    std::vector<Entry> entries;
+    bool inOrder = true; // Entries were inserted in strictly increasing path order
+
+    std::string_view pathOf(const Entry& entry) const { return {arena.data() + entry.pathOffset, entry.pathLength}; }
+    std::vector<Entry>::const_iterator lowerBound(std::string_view path) const;
+
+public:
+    class const_iterator;
+
+    // What iteration yields; the path points into the tree's arena
+    struct EntryView {
+        std::string_view path;
+        const Digest& digest;
+    };
+
+    // Appends an entry; call finalize() after a batch of out-of-order inserts
+    void insert(std::string_view path, const Digest& digest);
+    // Sorts by path, keeping the last insert of a duplicated path
+    void finalize();
+    // Finalizes first if needed
+    bool erase(std::string_view path);
+
+    // Binary search once finalized; before that, a scan that sees the pending inserts
+    const Digest* find(std::string_view path) const;
+    bool contains(std::string_view path) const { return find(path) != nullptr; }
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void reserve(size_t count, size_t pathBytes);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Entries whose value is not a 64-digit hex digest are dropped
+    static Tree fromJson(const nlohmann::json& tree);
+    nlohmann::json toJson() const;
+
+    bool operator==(const Tree& other) const;
+};
+
+class Tree::const_iterator {
+private:
+    const Tree* tree;
+    std::vector<Entry>::const_iterator it;
+
+public:
+    const_iterator(const Tree* tree, std::vector<Entry>::const_iterator it) : tree(tree), it(it) {}
+    EntryView operator*() const { return {tree->pathOf(*it), it->digest}; }
+    const_iterator& operator++() { ++it; return *this; }
+    bool operator!=(const const_iterator& other) const { return it != other.it; }
+    bool operator==(const const_iterator& other) const { return it == other.it; }
+};
+
+inline Tree::const_iterator Tree::begin() const { return {this, entries.begin()}; }
+inline Tree::const_iterator Tree::end() const { return {this, entries.end()}; }
+
+#endif // TREE_H
@@ -2,11 +2,16 @@
 #define UTILITIES_H
 
 #include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
 
 class Utilities {
 public:
     static std::string generateUUID();
     static std::string getCurrentTimestamp();
+    // SHA-256 over the canonical tree, parents, message and timestamp; identical commits get identical IDs
+    static std::string generateContentId(const nlohmann::json& directoryTree, const std::vector<std::string>& parents,
+                                         const std::string& message, const std::string& timestamp);
 };
 
 #endif // UTILITIES_H
@@ -2,18 +2,46 @@
 #define VCS_COMMANDS_H
 
 #include <string>
+#include <vector>
 
 class VCSCommands {
 public:
-    static void init();
+    static void init(bool contentIds = false);
     static void add(const std::string& filePath);
-    static void commit(const std::string& message);
-    static void branch(const std::string& branchName);
-    static void checkout(const std::string& branchName);
+    // commit, branch, checkout and merge return false if they failed or left the refs unchanged
+    static bool commit(const std::string& message, const std::vector<std::string>& mergeParents = {});
+    static bool branch(const std::string& branchName);
+    static bool checkout(const std::string& branchName);
     static void revert(const std::string& commitId);
-    static void merge(const std::string& sourceBranch);
-    static void log();
-    static void graph();
+    static bool merge(const std::string& sourceBranch);
+    // With a path, only the commits that changed that file or directory
+    static void log(const std::string& path = "");
+    static void graph(const std::string& tip = "", size_t limit = 0);
+    // action: set|add <prefix>..., list, disable
+    static void sparse(const std::string& action, const std::vector<std::string>& paths = {});
+    // Writes a tar of a branch head or commit to outputPath ("" or "-" for stdout); false if the
+    // revision is unknown or the archive is incomplete
+    static bool archive(const std::string& revision, const std::string& outputPath, const std::string& prefix = "", bool gzip = false);
+    // Shows the commit that last changed each line of a file, as of revision (default: head)
+    static void blame(const std::string& filePath, const std::string& revision = "");
+    // Verifies objects, commits and refs; false if anything is corrupt or missing
+    static bool fsck(bool quick = false);
+    // Sends branches (all if none given) to the repository at `path`, fast-forward only; false if
+    // nothing could be sent or any branch was rejected or failed
+    static bool push(const std::string& path, const std::vector<std::string>& branches = {});
+    // Fetches branches (all if none given) from the repository at `path` and fast-forwards the local
+    // ones; false if nothing could be fetched or any branch was rejected or failed
+    static bool pull(const std::string& path, const std::vector<std::string>& branches = {});
+    // Writes the history of `branches` (all if none given) to one bundle file ("-" for stdout)
+    static bool bundleCreate(const std::string& file, const std::vector<std::string>& branches = {});
+    // Unpacks a bundle ("-" for stdin) and creates or fast-forwards its branches; a repository with
+    // no commits yet checks one of them out. False if the bundle is unusable or any branch was
+    // rejected or not updated.
+    static bool unbundle(const std::string& file);
+    // Writes reachability bitmaps for the branch heads and every `spacing`th commit
+    static void bitmap(size_t spacing = 100);
+    // Lists (or counts) the commits and objects reachable from `include` but from none of `exclude`
+    static void reachable(const std::vector<std::string>& include, const std::vector<std::string>& exclude, bool countOnly = false);
 
 };
 
@@ -0,0 +1,41 @@
+#ifndef WORKING_TREE_INDEX_H
+#define WORKING_TREE_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "Digest.h"
+
+// Digests of working-tree files keyed by tree path, remembered together with the file's size and
+// modification time. A scan reuses the digest of any file whose size and mtime are unchanged and
+// only hashes the rest. Saved as `.vcs/index.json` between runs.
+class WorkingTreeIndex {
+private:
+    struct Entry {
+        uint64_t size;
+        int64_t mtime; // Nanoseconds, as reported by the filesystem clock
+        Digest digest;
+    };
+    // Files modified this close to the scan could change again within the filesystem's timestamp
+    // granularity without their mtime moving, so they are never trusted from the index
+    static constexpr int64_t racyWindowNs = 2'000'000'000;
+
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<std::string, Entry> scanned; // Entries confirmed or recorded by the current scan
+    int64_t scanStart = 0;
+    bool dirty = false;
+
+public:
+    // Entries neither looked up successfully nor recorded before finishScan() are dropped
+    void beginScan();
+    const Digest* lookup(const std::string& path, uint64_t size, int64_t mtime);
+    void record(const std::string& path, uint64_t size, int64_t mtime, const Digest& digest);
+    void finishScan();
+
+    size_t size() const { return entries.size(); }
+    bool load(const std::string& indexPath);
+    // No-op unless the last scan changed something
+    bool save(const std::string& indexPath);
+};
+
+#endif // WORKING_TREE_INDEX_H
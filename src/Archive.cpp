@@ -0,0 +1,254 @@
+#include "../include/Archive.h"
+#include "../include/BlobStore.h"
+#include "../include/FileSystem.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef VCS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static constexpr size_t blockSize = 512;
+static constexpr size_t copyBufferSize = 1 << 20;
+
+// Where archive bytes go: the output stream directly, or through a gzip deflater first
+class ArchiveSink {
+private:
+    std::ostream& out;
+    bool gzip;
+    bool ok = true;
+    std::vector<char> compressed;
+#ifdef VCS_HAVE_ZLIB
+    z_stream stream{};
+#endif
+
+    void emit(const char* data, size_t length) {
+        out.write(data, static_cast<std::streamsize>(length));
+        if (!out) ok = false;
+        Stats::add(Counter::BytesWritten, length);
+    }
+
+#ifdef VCS_HAVE_ZLIB
+    void deflateInput(const char* data, size_t length, int flush) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in = static_cast<uInt>(length);
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+            stream.avail_out = static_cast<uInt>(compressed.size());
+            if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                ok = false;
+                return;
+            }
+            emit(compressed.data(), compressed.size() - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+#endif
+
+public:
+    ArchiveSink(std::ostream& out, bool gzip) : out(out), gzip(gzip) {
+#ifdef VCS_HAVE_ZLIB
+        if (gzip) {
+            compressed.resize(copyBufferSize);
+            // 15 + 16: the largest window, with a gzip header and trailer instead of a zlib one
+            if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) ok = false;
+        }
+#else
+        if (gzip) ok = false;
+#endif
+    }
+
+    ~ArchiveSink() {
+#ifdef VCS_HAVE_ZLIB
+        if (gzip) deflateEnd(&stream);
+#endif
+    }
+
+    void write(const char* data, size_t length) {
+        if (!ok || length == 0) return;
+#ifdef VCS_HAVE_ZLIB
+        if (gzip) {
+            deflateInput(data, length, Z_NO_FLUSH);
+            return;
+        }
+#endif
+        emit(data, length);
+    }
+
+    bool finish() {
+#ifdef VCS_HAVE_ZLIB
+        if (gzip && ok) deflateInput(nullptr, 0, Z_FINISH);
+#endif
+        out.flush();
+        return ok && out;
+    }
+
+    bool good() const { return ok; }
+};
+
+// Numeric header fields are NUL-terminated octal; values too large for that use base-256
+static void putNumber(char* field, size_t width, uint64_t value) {
+    uint64_t octalLimit = width - 1 >= 22 ? UINT64_MAX : (uint64_t(1) << (3 * (width - 1))) - 1;
+    if (value <= octalLimit) {
+        std::memset(field, '0', width - 1);
+        field[width - 1] = '\0';
+        for (size_t i = width - 1; i-- > 0 && value; value >>= 3) {
+            field[i] = static_cast<char>('0' + (value & 7));
+        }
+        return;
+    }
+    std::memset(field, 0, width);
+    for (size_t i = width; i-- > 1; value >>= 8) {
+        field[i] = static_cast<char>(value & 0xff);
+    }
+    field[0] = static_cast<char>(0x80);
+}
+
+// ustar names: up to 100 bytes, or a '/'-split into a 155-byte prefix plus a 100-byte name
+static bool splitUstarName(const std::string& name, std::string& prefix, std::string& base) {
+    if (name.size() <= 100) {
+        prefix.clear();
+        base = name;
+        return true;
+    }
+    // The rightmost usable '/' leaves the shortest name; any split further left is longer still
+    size_t split = name.rfind('/', 155);
+    if (split == std::string::npos || split == 0 || name.size() - split - 1 > 100) return false;
+    prefix = name.substr(0, split);
+    base = name.substr(split + 1);
+    return true;
+}
+
+static void writeHeader(ArchiveSink& sink, const std::string& name, uint64_t size, uint32_t mode, int64_t mtime, char type) {
+    std::array<char, blockSize> header{};
+    std::string prefix;
+    std::string base;
+    if (!splitUstarName(name, prefix, base)) {
+        base = name.substr(0, 100); // Only reached after a GNU long-name member carrying the full name
+        prefix.clear();
+    }
+    std::memcpy(&header[0], base.data(), std::min<size_t>(base.size(), 100));
+    putNumber(&header[100], 8, mode);
+    putNumber(&header[108], 8, 0);                                       // uid
+    putNumber(&header[116], 8, 0);                                       // gid
+    putNumber(&header[124], 12, size);
+    putNumber(&header[136], 12, static_cast<uint64_t>(std::max<int64_t>(mtime, 0)));
+    header[156] = type;
+    std::memcpy(&header[257], "ustar", 6);
+    std::memcpy(&header[263], "00", 2);
+    std::memcpy(&header[345], prefix.data(), std::min<size_t>(prefix.size(), 155));
+
+    // The checksum is computed with its own field set to spaces
+    std::memset(&header[148], ' ', 8);
+    unsigned sum = 0;
+    for (char c : header) sum += static_cast<unsigned char>(c);
+    putNumber(&header[148], 7, sum);
+    header[155] = ' ';
+    sink.write(header.data(), header.size());
+}
+
+static void writePadding(ArchiveSink& sink, uint64_t size) {
+    static const std::array<char, blockSize> zeros{};
+    size_t remainder = static_cast<size_t>(size % blockSize);
+    if (remainder) sink.write(zeros.data(), blockSize - remainder);
+}
+
+static void writeMemberHeader(ArchiveSink& sink, const std::string& name, uint64_t size, uint32_t mode, int64_t mtime) {
+    std::string prefix;
+    std::string base;
+    if (!splitUstarName(name, prefix, base)) {
+        // GNU long-name member: the full name as data, followed by the real header
+        writeHeader(sink, "././@LongLink", name.size() + 1, 0644, 0, 'L');
+        sink.write(name.c_str(), name.size() + 1);
+        writePadding(sink, name.size() + 1);
+    }
+    writeHeader(sink, name, size, mode, mtime, '0');
+}
+
+// Copies `length` bytes of `path` into the archive; false if the file is short or unreadable
+static bool copyInto(ArchiveSink& sink, const std::string& path, uint64_t length, std::vector<char>& buffer) {
+    std::ifstream file(path, std::ios::binary);
+    uint64_t remaining = length;
+    while (file && remaining > 0) {
+        file.read(buffer.data(), static_cast<std::streamsize>(std::min<uint64_t>(buffer.size(), remaining)));
+        size_t got = static_cast<size_t>(file.gcount());
+        sink.write(buffer.data(), got);
+        remaining -= got;
+    }
+    if (remaining == 0) return true;
+
+    // Keep the archive well-formed: the header promised `length` bytes
+    std::fill(buffer.begin(), buffer.end(), 0);
+    while (remaining > 0) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size(), remaining));
+        sink.write(buffer.data(), count);
+        remaining -= count;
+    }
+    return false;
+}
+
+bool Archive::gzipAvailable() {
+#ifdef VCS_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Archive::write(const Tree& tree, std::ostream& out, const ArchiveOptions& options) {
+    VCS_TRACE_SCOPE("Archive::write");
+    ArchiveSink sink(out, options.gzip);
+    std::vector<char> buffer(copyBufferSize);
+    bool complete = true;
+
+    for (const auto& [path, digest] : tree) {
+        std::string name(path);
+        if (name.starts_with("./")) name.erase(0, 2);
+        if (name.empty() || name == ".vcs" || name.starts_with(".vcs/")) continue;
+        name = options.prefix + name;
+
+        // Each member is either a list of chunks or a single whole-file blob
+        std::string folder = BlobStore::objectPath(digest);
+        std::vector<std::pair<std::string, uint64_t>> pieces;
+        uint32_t mode = 0644;
+        std::error_code ec;
+        if (BlobStore::isChunked(folder)) {
+            nlohmann::json manifest = FileSystem::readJson(folder + "/chunks.json");
+            for (const auto& chunk : manifest["chunks"]) {
+                pieces.emplace_back(BlobStore::chunkPath(chunk["hash"].get<Digest>()), chunk["size"].get<uint64_t>());
+            }
+        } else {
+            std::string content = BlobStore::contentPath(folder);
+            if (!content.empty()) {
+                pieces.emplace_back(content, fs::file_size(content, ec));
+                // Stored blobs keep the file's permission bits (e.g. executables)
+                mode = static_cast<uint32_t>(fs::status(content, ec).permissions() & fs::perms::all);
+            }
+        }
+        if (pieces.empty()) {
+            complete = false; // Missing object: leave the member out rather than write a broken one
+            continue;
+        }
+
+        uint64_t size = 0;
+        for (const auto& piece : pieces) size += piece.second;
+        writeMemberHeader(sink, name, size, mode, options.mtime);
+        for (const auto& [piecePath, pieceSize] : pieces) {
+            if (!copyInto(sink, piecePath, pieceSize, buffer)) complete = false;
+        }
+        writePadding(sink, size);
+        if (!sink.good()) break;
+    }
+
+    // End of archive: two zero blocks
+    static const std::array<char, 2 * blockSize> trailer{};
+    sink.write(trailer.data(), trailer.size());
+    return sink.finish() && complete;
+}
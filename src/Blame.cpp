@@ -0,0 +1,345 @@
+#include "../include/Blame.h"
+#include "../include/BlobStore.h"
+#include "../include/Digest.h"
+#include "../include/FileSystem.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// What the walk needs from a commit: its parents and the blob at the blamed path
+struct CommitInfo {
+    std::vector<std::string> parents;
+    std::string timestamp;
+    bool hasBlob = false;
+    Digest blob;
+};
+
+// A line's origin: index into the run's commit table plus the 1-based line number there
+struct Origin {
+    uint32_t commit;
+    uint32_t line;
+};
+
+// One version of the file, newest first: the commit that introduced `blob`
+struct Segment {
+    std::string commitId;
+    Digest blob;
+    bool cached = false;
+    std::vector<Origin> origins;
+};
+
+class BlameRun {
+public:
+    std::string key;                                          // Tree key, "./<path>"
+    std::unordered_map<std::string, CommitInfo> commits;
+    std::vector<std::pair<std::string, std::string>> table;   // (commit ID, timestamp)
+    std::unordered_map<std::string, uint32_t> tableIndex;
+
+    const CommitInfo* commit(const std::string& id);
+    uint32_t intern(const std::string& id, const std::string& timestamp);
+    std::string cachePath(const std::string& commitId) const;
+    bool loadCache(Segment& segment);
+    void storeCache(const Segment& segment);
+};
+
+const CommitInfo* BlameRun::commit(const std::string& id) {
+    auto found = commits.find(id);
+    if (found != commits.end()) return &found->second;
+
+    std::string path = ".vcs/commits/" + id + ".json";
+    if (!FileSystem::fileExists(path)) return nullptr;
+    nlohmann::json data = FileSystem::readJson(path);
+
+    CommitInfo info;
+    if (data.contains("parents") && data["parents"].is_array()) {
+        info.parents = data["parents"].get<std::vector<std::string>>();
+    } else {
+        std::string parent = data.value("parent", "");
+        if (!parent.empty() && parent != "null") info.parents.push_back(parent);
+    }
+    info.timestamp = data.value("timestamp", "");
+    const auto& tree = data["directory_tree"];
+    auto entry = tree.is_object() ? tree.find(key) : tree.end();
+    if (entry != tree.end() && entry->is_string()) {
+        info.hasBlob = Digest::fromHex(entry->get_ref<const std::string&>(), info.blob);
+    }
+    return &commits.emplace(id, std::move(info)).first->second;
+}
+
+uint32_t BlameRun::intern(const std::string& id, const std::string& timestamp) {
+    auto [it, inserted] = tableIndex.emplace(id, static_cast<uint32_t>(table.size()));
+    if (inserted) table.emplace_back(id, timestamp);
+    return it->second;
+}
+
+std::string BlameRun::cachePath(const std::string& commitId) const {
+    std::string name = commitId + '\n' + key;
+    return ".vcs/cache/blame/" + Digest::of(name).hex() + ".json";
+}
+
+bool BlameRun::loadCache(Segment& segment) {
+    std::string path = cachePath(segment.commitId);
+    if (!FileSystem::fileExists(path)) {
+        Stats::add(Counter::CacheMisses);
+        return false;
+    }
+    nlohmann::json cache = FileSystem::readJson(path);
+    Digest blob;
+    if (!cache.contains("blob") || !Digest::fromHex(cache.value("blob", ""), blob) || blob != segment.blob ||
+        !cache["commits"].is_array() || !cache["timestamps"].is_array() || !cache["origins"].is_array()) {
+        Stats::add(Counter::CacheMisses);
+        return false; // Stale or damaged; recompute and overwrite it
+    }
+    std::vector<uint32_t> remap;
+    for (size_t i = 0; i < cache["commits"].size(); ++i) {
+        remap.push_back(intern(cache["commits"][i].get<std::string>(), cache["timestamps"][i].get<std::string>()));
+    }
+    segment.origins.clear();
+    for (const auto& origin : cache["origins"]) {
+        uint32_t commit = origin[0].get<uint32_t>();
+        if (commit >= remap.size()) {
+            Stats::add(Counter::CacheMisses);
+            return false;
+        }
+        segment.origins.push_back({remap[commit], origin[1].get<uint32_t>()});
+    }
+    segment.cached = true;
+    Stats::add(Counter::CacheHits);
+    return true;
+}
+
+void BlameRun::storeCache(const Segment& segment) {
+    // Only the commits this version references, renumbered densely
+    std::unordered_map<uint32_t, uint32_t> local;
+    nlohmann::json cache;
+    cache["blob"] = segment.blob;
+    cache["commits"] = nlohmann::json::array();
+    cache["timestamps"] = nlohmann::json::array();
+    cache["origins"] = nlohmann::json::array();
+    for (const auto& origin : segment.origins) {
+        auto [it, inserted] = local.emplace(origin.commit, static_cast<uint32_t>(local.size()));
+        if (inserted) {
+            cache["commits"].push_back(table[origin.commit].first);
+            cache["timestamps"].push_back(table[origin.commit].second);
+        }
+        cache["origins"].push_back({it->second, origin.line});
+    }
+    FileSystem::createDirectory(".vcs/cache/blame");
+    // Blame runs under the shared repository lock, so concurrent runs may write the same entry
+    FileSystem::replaceFile(cachePath(segment.commitId), cache.dump());
+}
+
+std::vector<std::string_view> splitLines(const std::string& content) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) end = content.size();
+        lines.emplace_back(content.data() + start, end - start);
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Largest region the quadratic LCS fallback will take on (cells of its table)
+constexpr size_t lcsCellLimit = size_t(1) << 22;
+
+void matchByLcs(const std::vector<uint32_t>& a, size_t a0, size_t a1, const std::vector<uint32_t>& b, size_t b0, size_t b1,
+                std::vector<int32_t>& match) {
+    size_t n = a1 - a0;
+    size_t m = b1 - b0;
+    if ((n + 1) * (m + 1) > lcsCellLimit) return; // Too big to align exhaustively; leave unmatched
+    std::vector<uint32_t> length((n + 1) * (m + 1), 0);
+    auto at = [m](size_t i, size_t j) { return i * (m + 1) + j; };
+    for (size_t i = n; i-- > 0;) {
+        for (size_t j = m; j-- > 0;) {
+            length[at(i, j)] = a[a0 + i] == b[b0 + j] ? length[at(i + 1, j + 1)] + 1
+                                                      : std::max(length[at(i + 1, j)], length[at(i, j + 1)]);
+        }
+    }
+    for (size_t i = 0, j = 0; i < n && j < m;) {
+        if (a[a0 + i] == b[b0 + j]) {
+            match[b0 + j] = static_cast<int32_t>(a0 + i);
+            i++;
+            j++;
+        } else if (length[at(i + 1, j)] >= length[at(i, j + 1)]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+}
+
+// Patience diff: anchor on lines unique to both sides, then recurse into the gaps between anchors
+void matchRange(const std::vector<uint32_t>& a, size_t a0, size_t a1, const std::vector<uint32_t>& b, size_t b0, size_t b1,
+                std::vector<int32_t>& match) {
+    while (a0 < a1 && b0 < b1 && a[a0] == b[b0]) match[b0++] = static_cast<int32_t>(a0++);
+    while (a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1]) match[--b1] = static_cast<int32_t>(--a1);
+    if (a0 == a1 || b0 == b1) return;
+
+    struct Count {
+        uint32_t inA = 0;
+        uint32_t inB = 0;
+        size_t positionB = 0;
+    };
+    std::unordered_map<uint32_t, Count> counts;
+    for (size_t i = a0; i < a1; ++i) counts[a[i]].inA++;
+    for (size_t j = b0; j < b1; ++j) {
+        auto it = counts.find(b[j]);
+        if (it != counts.end()) {
+            it->second.inB++;
+            it->second.positionB = j;
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> unique; // (position in a, position in b), by position in a
+    for (size_t i = a0; i < a1; ++i) {
+        const Count& count = counts[a[i]];
+        if (count.inA == 1 && count.inB == 1) unique.emplace_back(i, count.positionB);
+    }
+    if (unique.empty()) {
+        matchByLcs(a, a0, a1, b, b0, b1, match);
+        return;
+    }
+
+    // Longest run of unique pairs increasing in b as well (patience sorting)
+    std::vector<size_t> tails;                  // Index into `unique` ending each pile
+    std::vector<int64_t> previous(unique.size(), -1);
+    for (size_t k = 0; k < unique.size(); ++k) {
+        auto pile = std::lower_bound(tails.begin(), tails.end(), unique[k].second,
+                                     [&unique](size_t index, size_t positionB) { return unique[index].second < positionB; });
+        if (pile != tails.begin()) previous[k] = static_cast<int64_t>(*(pile - 1));
+        if (pile == tails.end()) tails.push_back(k);
+        else *pile = k;
+    }
+    std::vector<std::pair<size_t, size_t>> anchors;
+    for (int64_t k = static_cast<int64_t>(tails.back()); k >= 0; k = previous[k]) anchors.push_back(unique[k]);
+    std::reverse(anchors.begin(), anchors.end());
+
+    size_t nextA = a0;
+    size_t nextB = b0;
+    for (const auto& [anchorA, anchorB] : anchors) {
+        matchRange(a, nextA, anchorA, b, nextB, anchorB, match);
+        match[anchorB] = static_cast<int32_t>(anchorA);
+        nextA = anchorA + 1;
+        nextB = anchorB + 1;
+    }
+    matchRange(a, nextA, a1, b, nextB, b1, match);
+}
+
+} // namespace
+
+bool Blame::run(const std::string& commitId, const std::string& path, std::vector<BlameLine>& lines, std::string& error) {
+    VCS_TRACE_SCOPE("Blame::run");
+    BlameRun run;
+    run.key = "./" + FileSystem::relativePath(path, ".");
+
+    const CommitInfo* start = run.commit(commitId);
+    if (!start) {
+        error = "Commit '" + commitId + "' does not exist!";
+        return false;
+    }
+    if (!start->hasBlob) {
+        error = "'" + path + "' is not in commit " + commitId;
+        return false;
+    }
+
+    // Walk back to each commit that introduced a new version of the file, stopping at a cached one
+    std::vector<Segment> segments;
+    {
+        VCS_TRACE_SCOPE("blame: walk history");
+        std::string current = commitId;
+        Digest blob = start->blob;
+        while (true) {
+            // Pass over commits that left the file alone (through any parent that has the same blob)
+            for (bool moved = true; moved;) {
+                moved = false;
+                for (const auto& parent : run.commit(current)->parents) {
+                    const CommitInfo* info = run.commit(parent);
+                    if (info && info->hasBlob && info->blob == blob) {
+                        current = parent;
+                        moved = true;
+                        break;
+                    }
+                }
+            }
+
+            Segment segment;
+            segment.commitId = current;
+            segment.blob = blob;
+            bool hit = run.loadCache(segment);
+            segments.push_back(std::move(segment));
+            if (hit) break;
+
+            // Continue into the first parent that has some version of the file
+            const CommitInfo* next = nullptr;
+            for (const auto& parent : run.commit(current)->parents) {
+                const CommitInfo* info = run.commit(parent);
+                if (info && info->hasBlob) {
+                    next = info;
+                    current = parent;
+                    break;
+                }
+            }
+            if (!next) break; // The file was added here
+            blob = next->blob;
+        }
+    }
+
+    // Replay oldest to newest, carrying origins across each diff
+    VCS_TRACE_SCOPE("blame: diff versions");
+    std::unordered_map<std::string, uint32_t> lineIds;
+    std::vector<uint32_t> previousIds;
+    std::vector<Origin> previousOrigins;
+    std::string content;
+    std::vector<std::string_view> text;
+    for (size_t s = segments.size(); s-- > 0;) {
+        Segment& segment = segments[s];
+        if (!BlobStore::read(BlobStore::objectPath(segment.blob), content)) {
+            error = "Object " + segment.blob.hex() + " is missing from the store";
+            return false;
+        }
+        if (s == 0 && std::memchr(content.data(), '\0', std::min<size_t>(content.size(), 8000))) {
+            error = "'" + path + "' is a binary file";
+            return false;
+        }
+        text = splitLines(content);
+
+        std::vector<uint32_t> ids;
+        ids.reserve(text.size());
+        for (auto line : text) {
+            ids.push_back(lineIds.emplace(std::string(line), static_cast<uint32_t>(lineIds.size())).first->second);
+        }
+
+        if (segment.cached && segment.origins.size() != ids.size()) {
+            segment.cached = false; // Cache does not describe this blob; fall through and recompute
+        }
+        if (!segment.cached) {
+            const CommitInfo* info = run.commit(segment.commitId);
+            uint32_t self = run.intern(segment.commitId, info ? info->timestamp : "");
+            std::vector<int32_t> match(ids.size(), -1);
+            if (s + 1 < segments.size()) {
+                matchRange(previousIds, 0, previousIds.size(), ids, 0, ids.size(), match);
+            }
+            segment.origins.resize(ids.size());
+            for (size_t j = 0; j < ids.size(); ++j) {
+                segment.origins[j] = match[j] >= 0 ? previousOrigins[match[j]] : Origin{self, static_cast<uint32_t>(j + 1)};
+            }
+            run.storeCache(segment);
+        }
+        previousIds = std::move(ids);
+        previousOrigins = segment.origins;
+    }
+
+    lines.clear();
+    lines.reserve(text.size());
+    for (size_t j = 0; j < text.size(); ++j) {
+        const Origin& origin = previousOrigins[j];
+        lines.push_back({run.table[origin.commit].first, run.table[origin.commit].second, origin.line, std::string(text[j])});
+    }
+    return true;
+}
@@ -0,0 +1,185 @@
+#include "../include/BlobStore.h"
+#include "../include/Chunker.h"
+#include "../include/FileSystem.h"
+#include "../include/IoEngine.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+std::string BlobStore::objectPath(const Digest& hash) {
+    return ".vcs/data/hash/" + hash.hex();
+}
+
+std::string BlobStore::chunkPath(const Digest& chunkHash) {
+    // Two-character fan-out keeps directory sizes manageable for large chunk counts
+    std::string hex = chunkHash.hex();
+    return ".vcs/data/chunks/" + hex.substr(0, 2) + "/" + hex;
+}
+
+bool BlobStore::isChunked(const std::string& hashFolderPath) {
+    return FileSystem::fileExists(hashFolderPath + "/chunks.json") && !FileSystem::fileExists(hashFolderPath + "/blob");
+}
+
+std::string BlobStore::contentPath(const std::string& hashFolderPath) {
+    std::string blobPath = hashFolderPath + "/blob";
+    if (FileSystem::fileExists(blobPath)) return blobPath;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(hashFolderPath, ec)) {
+        if (entry.is_regular_file() && entry.path().filename() != "hash.json") {
+            return entry.path().string();
+        }
+    }
+    return "";
+}
+
+bool BlobStore::store(const std::string& sourcePath, const std::string& hashFolderPath) {
+    VCS_TRACE_SCOPE("BlobStore::store");
+    std::error_code ec;
+    uint64_t size = fs::file_size(sourcePath, ec);
+    if (ec) return false;
+    if (size < chunkThreshold) {
+        return FileSystem::copyFile(sourcePath, hashFolderPath + "/blob");
+    }
+
+    nlohmann::json manifest;
+    manifest["size"] = size;
+    manifest["chunks"] = nlohmann::json::array();
+    // Separate from chunkFile's own result, which would otherwise overwrite a failed chunk write
+    bool chunksWritten = true;
+    bool chunked = Chunker::chunkFile(sourcePath, [&](const uint8_t* data, size_t length) {
+        Digest chunkHash = Digest::of(data, length);
+        manifest["chunks"].push_back({{"hash", chunkHash}, {"size", length}});
+        Stats::add(Counter::ChunkBytesLogical, length);
+
+        std::string path = chunkPath(chunkHash);
+        if (FileSystem::fileExists(path)) {
+            Stats::add(Counter::ChunksDeduplicated);
+            return;
+        }
+        FileSystem::createDirectory(fs::path(path).parent_path().string());
+        // Written aside and renamed, so a short chunk never passes for the real one when deduplicated
+        std::string tempPath = path + ".tmp";
+        std::ofstream chunk(tempPath, std::ios::binary | std::ios::trunc);
+        bool written = chunk.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length)) &&
+                       chunk.flush();
+        chunk.close();
+        std::error_code renameError;
+        if (written) fs::rename(tempPath, path, renameError);
+        if (!written || renameError) {
+            std::error_code removeError;
+            fs::remove(tempPath, removeError);
+            chunksWritten = false;
+            return;
+        }
+        Stats::add(Counter::ChunksCreated);
+        Stats::add(Counter::ChunkBytesStored, length);
+        Stats::add(Counter::BytesWritten, length);
+    });
+    // Part of the object itself and found by listing its folder, so never deferred like metadata
+    return chunked && chunksWritten && FileSystem::writeFile(hashFolderPath + "/chunks.json", manifest.dump(4));
+}
+
+bool BlobStore::restore(const std::string& hashFolderPath, const std::string& destinationPath) {
+    VCS_TRACE_SCOPE("BlobStore::restore");
+    if (isChunked(hashFolderPath)) {
+        // Reassemble chunk by chunk; each chunk is copied kernel-side, so nothing is buffered here
+        nlohmann::json manifest = FileSystem::readJson(hashFolderPath + "/chunks.json");
+        std::vector<std::string> chunkPaths;
+        chunkPaths.reserve(manifest["chunks"].size());
+        for (const auto& chunk : manifest["chunks"]) {
+            chunkPaths.push_back(chunkPath(chunk["hash"].get<Digest>()));
+        }
+        return FileSystem::concatenateFiles(chunkPaths, destinationPath);
+    }
+
+    std::string content = contentPath(hashFolderPath);
+    return !content.empty() && FileSystem::copyFile(content, destinationPath);
+}
+
+bool BlobStore::size(const std::string& hashFolderPath, uint64_t& size) {
+    if (isChunked(hashFolderPath)) {
+        nlohmann::json manifest = nlohmann::json::parse(FileSystem::readFile(hashFolderPath + "/chunks.json"), nullptr, false);
+        if (!manifest.is_object() || !manifest.contains("size") || !manifest["size"].is_number_unsigned()) return false;
+        size = manifest["size"].get<uint64_t>();
+        return true;
+    }
+    std::string content = contentPath(hashFolderPath);
+    if (content.empty()) return false;
+    std::error_code ec;
+    size = fs::file_size(content, ec);
+    return !ec;
+}
+
+bool BlobStore::read(const std::string& hashFolderPath, std::string& content) {
+    VCS_TRACE_SCOPE("BlobStore::read");
+    content.clear();
+    std::vector<std::string> sources;
+    if (isChunked(hashFolderPath)) {
+        nlohmann::json manifest = FileSystem::readJson(hashFolderPath + "/chunks.json");
+        content.reserve(manifest.value("size", uint64_t(0)));
+        for (const auto& chunk : manifest["chunks"]) {
+            sources.push_back(chunkPath(chunk["hash"].get<Digest>()));
+        }
+    } else {
+        std::string source = contentPath(hashFolderPath);
+        if (!source.empty()) sources.push_back(source);
+    }
+    if (sources.empty()) return false;
+    for (const auto& source : sources) {
+        std::ifstream file(source, std::ios::binary);
+        if (!file) return false;
+        content.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    return true;
+}
+
+std::vector<bool> BlobStore::restoreMany(const std::vector<std::pair<std::string, std::string>>& jobs) {
+    VCS_TRACE_SCOPE("BlobStore::restoreMany");
+    std::vector<bool> restored(jobs.size(), false);
+
+    // Whole blobs are small by construction (< chunkThreshold), so a window of them fits in memory
+    std::vector<std::string> sources;
+    std::vector<size_t> jobIndex;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const auto& [hashFolderPath, destinationPath] = jobs[i];
+        if (isChunked(hashFolderPath)) {
+            try {
+                restored[i] = restore(hashFolderPath, destinationPath);
+            } catch (const std::exception&) {
+            }
+            continue;
+        }
+        std::string source = contentPath(hashFolderPath);
+        if (source.empty()) continue;
+        sources.push_back(source);
+        jobIndex.push_back(i);
+    }
+
+    const size_t window = IoEngine::queueDepth;
+    for (size_t begin = 0; begin < sources.size(); begin += window) {
+        size_t end = std::min(sources.size(), begin + window);
+        std::vector<std::string> batch(sources.begin() + begin, sources.begin() + end);
+        std::vector<WriteJob> writes;
+        std::vector<size_t> writeJobIndex;
+        IoEngine::readFiles(batch, [&](size_t index, bool ok, std::string& content, uint32_t mode) {
+            if (!ok) return;
+            writes.push_back({jobs[jobIndex[begin + index]].second, std::move(content), mode});
+            writeJobIndex.push_back(jobIndex[begin + index]);
+        });
+        if (IoEngine::writeFiles(writes)) {
+            for (size_t index : writeJobIndex) restored[index] = true;
+        } else {
+            // Find out which ones failed
+            for (size_t k = 0; k < writes.size(); ++k) {
+                std::error_code ec;
+                restored[writeJobIndex[k]] = fs::file_size(writes[k].path, ec) == writes[k].data.size() && !ec;
+            }
+        }
+    }
+    return restored;
+}
@@ -0,0 +1,115 @@
+#include "../include/ChangedPathFilter.h"
+#include "../include/FileSystem.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// On-disk layout: magic, flags, bit count, then the bit words (host byte order)
+static const char filterMagic[4] = {'V', 'B', 'F', '1'};
+static constexpr uint32_t saturatedFlag = 1;
+
+// Two independent 64-bit hashes of the path, combined by double hashing into hashCount probes
+static void pathHashes(std::string_view path, uint64_t& first, uint64_t& second) {
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    for (unsigned char c : path) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    first = hash;
+    uint64_t mixed = hash + 0x9e3779b97f4a7c15ULL; // splitmix64 finalizer
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    second = (mixed ^ (mixed >> 31)) | 1;
+}
+
+ChangedPathFilter ChangedPathFilter::build(const std::vector<std::string>& paths) {
+    ChangedPathFilter filter;
+    if (paths.size() > maxPaths) {
+        filter.saturated = true;
+        return filter;
+    }
+    size_t bitCount = std::max<size_t>(64, paths.size() * bitsPerPath);
+    filter.bits.assign((bitCount + 63) / 64, 0);
+    bitCount = filter.bits.size() * 64;
+    for (const auto& path : paths) {
+        uint64_t first, second;
+        pathHashes(path, first, second);
+        for (uint32_t i = 0; i < hashCount; ++i) {
+            uint64_t bit = (first + i * second) % bitCount;
+            filter.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+    return filter;
+}
+
+bool ChangedPathFilter::mightContain(std::string_view path) const {
+    if (saturated) return true;
+    if (bits.empty()) return false; // Nothing changed
+    uint64_t bitCount = bits.size() * 64;
+    uint64_t first, second;
+    pathHashes(path, first, second);
+    for (uint32_t i = 0; i < hashCount; ++i) {
+        uint64_t bit = (first + i * second) % bitCount;
+        if (!(bits[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+std::string ChangedPathFilter::filterPath(const std::string& commitId) {
+    return ".vcs/bloom/" + commitId + ".bloom";
+}
+
+bool ChangedPathFilter::save(const std::string& commitId) const {
+    FileSystem::createDirectory(".vcs/bloom");
+    uint32_t header[2] = {saturated ? saturatedFlag : 0, static_cast<uint32_t>(bits.size() * 64)};
+    std::string content(filterMagic, sizeof(filterMagic));
+    content.append(reinterpret_cast<const char*>(header), sizeof(header));
+    content.append(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(uint64_t));
+    // `log` backfills filters under the shared repository lock, so replace rather than rewrite
+    return FileSystem::replaceFile(filterPath(commitId), content);
+}
+
+bool ChangedPathFilter::load(const std::string& commitId, ChangedPathFilter& filter) {
+    std::ifstream file(filterPath(commitId), std::ios::binary);
+    char magic[4];
+    uint32_t header[2];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, filterMagic, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[1] % 64 != 0) {
+        return false;
+    }
+    filter.saturated = (header[0] & saturatedFlag) != 0;
+    filter.bits.assign(header[1] / 64, 0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(filter.bits.data()),
+                                       static_cast<std::streamsize>(filter.bits.size() * sizeof(uint64_t))));
+}
+
+std::vector<std::string> ChangedPathFilter::changedPaths(const Tree& parent, const Tree& tree) {
+    std::vector<std::string> paths;
+    auto addPath = [&paths](std::string_view key) {
+        std::string path(key.starts_with("./") ? key.substr(2) : key);
+        // The file and every directory above it
+        for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            paths.push_back(path.substr(0, slash));
+        }
+        paths.push_back(std::move(path));
+    };
+
+    // Both trees are sorted, so one merge-join finds every difference
+    auto a = parent.begin();
+    auto b = tree.begin();
+    while (a != parent.end() || b != tree.end()) {
+        if (b == tree.end() || (a != parent.end() && (*a).path < (*b).path)) {
+            addPath((*a).path);
+            ++a;
+        } else if (a == parent.end() || (*b).path < (*a).path) {
+            addPath((*b).path);
+            ++b;
+        } else {
+            if ((*a).digest != (*b).digest) addPath((*a).path);
+            ++a;
+            ++b;
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    return paths;
+}
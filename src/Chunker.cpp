@@ -0,0 +1,71 @@
+#include "../include/Chunker.h"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Deterministic gear table (splitmix64), identical on every platform so chunk boundaries are stable
+static const std::array<uint64_t, 256> gear = [] {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (auto& value : table) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}();
+
+// log2(averageSize) = 16; the stricter mask before the average size and the looser one after it
+// pull chunk sizes toward the average (FastCDC normalization level 1). Masks use the high bits,
+// which have mixed in the most bytes of the left-shifting gear hash.
+static constexpr uint64_t maskStrict = ((1ULL << 17) - 1) << (64 - 17);
+static constexpr uint64_t maskLoose = ((1ULL << 15) - 1) << (64 - 15);
+
+size_t Chunker::cut(const uint8_t* data, size_t length) {
+    if (length <= minSize) return length;
+
+    size_t normal = length < averageSize ? length : averageSize;
+    size_t end = length < maxSize ? length : maxSize;
+    uint64_t fingerprint = 0;
+    size_t i = minSize; // Bytes before the minimum size can never be a boundary, so they are not hashed
+
+    for (; i < normal; ++i) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if (!(fingerprint & maskStrict)) return i + 1;
+    }
+    for (; i < end; ++i) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if (!(fingerprint & maskLoose)) return i + 1;
+    }
+    return end;
+}
+
+bool Chunker::chunkFile(const std::string& filePath, const std::function<void(const uint8_t*, size_t)>& onChunk) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) return false;
+
+    // Window of several max-size chunks; unconsumed bytes are moved to the front before refilling
+    std::vector<uint8_t> buffer(4 * maxSize);
+    size_t begin = 0;
+    size_t filled = 0;
+    bool eof = false;
+
+    while (true) {
+        if (!eof && filled - begin < maxSize) {
+            std::memmove(buffer.data(), buffer.data() + begin, filled - begin);
+            filled -= begin;
+            begin = 0;
+            file.read(reinterpret_cast<char*>(buffer.data() + filled), buffer.size() - filled);
+            filled += static_cast<size_t>(file.gcount());
+            eof = !file;
+        }
+        if (begin == filled) break;
+
+        size_t length = cut(buffer.data() + begin, filled - begin);
+        onChunk(buffer.data() + begin, length);
+        begin += length;
+    }
+    return !file.bad();
+}
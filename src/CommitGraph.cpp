@@ -1,12 +1,35 @@
 #include "../include/CommitGraph.h"
+#include "../include/Stats.h"
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
 #include <nlohmann/json.hpp> // Use nlohmann JSON for parsing
 
 using json = nlohmann::json;
 
 CommitGraph::CommitGraph() {}
 
+uint32_t CommitGraph::intern(const std::string &commitId)
+{
+    auto [it, inserted] = index.try_emplace(commitId, static_cast<uint32_t>(commitIds.size()));
+    if (inserted)
+    {
+        commitIds.push_back(commitId);
+        loaded.push_back(0);
+        messages.emplace_back();
+        timestamps.emplace_back();
+    }
+    return it->second;
+}
+
+PoolSpan CommitGraph::pool(const std::string &value)
+{
+    PoolSpan span{static_cast<uint32_t>(stringPool.size()), static_cast<uint32_t>(value.size())};
+    stringPool += value;
+    return span;
+}
+
 void CommitGraph::loadBranch(const std::string &branchFilePath)
 {
     std::ifstream branchFile(branchFilePath);
@@ -19,17 +42,27 @@ void CommitGraph::loadBranch(const std::string &branchFilePath)
     json branchJson;
     branchFile >> branchJson;
 
-    std::string branchName = branchJson["branch_name"];
-    std::vector<std::string> commits = branchJson["commits"];
-
-    for (const std::string &commitId : commits)
+    for (const auto &commitId : branchJson["commits"])
     {
-        loadCommit(".vcs/commits/" + commitId + ".json");
+        // Branches share most of their history; parse each commit file only once
+        uint32_t i = intern(commitId.get<std::string>());
+        if (loaded[i])
+        {
+            Stats::add(Counter::CacheHits);
+        }
+        else
+        {
+            Stats::add(Counter::CacheMisses);
+            loadCommit(i);
+        }
     }
 }
 
-void CommitGraph::loadCommit(const std::string &commitFilePath)
+void CommitGraph::loadCommit(uint32_t self)
 {
+    loaded[self] = 1;
+
+    std::string commitFilePath = vcsPath + "/commits/" + commitIds[self] + ".json";
     std::ifstream commitFile(commitFilePath);
     if (!commitFile)
     {
@@ -40,18 +73,31 @@ void CommitGraph::loadCommit(const std::string &commitFilePath)
     json commitJson;
     commitFile >> commitJson;
 
-    std::string commitId = commitJson["commit_id"];
-    std::string message = commitJson["message"];
-    std::string timestamp = commitJson["timestamp"];
-    std::vector<std::string> parents; // Parents of the commit
+    std::string message = commitJson.value("message", "");
+    messages[self] = pool(message);
+    timestamps[self] = pool(commitJson.value("timestamp", ""));
+
+    // Commits record every parent explicitly, first parent first
+    if (commitJson.contains("parents"))
+    {
+        for (const auto &parent : commitJson["parents"])
+        {
+            pendingEdges.emplace_back(self, intern(parent.get<std::string>()));
+        }
+        return;
+    }
 
-    // Add primary parent (if it exists)
+    // Older commits only stored the primary parent (if it exists)
     if (commitJson.contains("parent"))
     {
-        parents.push_back(commitJson["parent"]);
+        std::string parent = commitJson["parent"];
+        if (!parent.empty() && parent != "null")
+        {
+            pendingEdges.emplace_back(self, intern(parent));
+        }
     }
 
-    // Identify and handle merge commits
+    // Older merge commits: fall back to the source branch's current head
     if (message.rfind("Merged branch", 0) == 0)
     { // Check if the message starts with "Merged branch"
         // Parse the source branch name
@@ -62,7 +108,7 @@ void CommitGraph::loadCommit(const std::string &commitFilePath)
             std::string sourceBranch = message.substr(pos1 + 1, pos2 - pos1 - 1);
 
             // Load source branch head
-            std::string sourceBranchPath = ".vcs/branches/" + sourceBranch + ".json";
+            std::string sourceBranchPath = vcsPath + "/branches/" + sourceBranch + ".json";
             std::ifstream sourceFile(sourceBranchPath);
             if (sourceFile.is_open())
             {
@@ -71,59 +117,221 @@ void CommitGraph::loadCommit(const std::string &commitFilePath)
 
                 if (sourceBranchJson.contains("head"))
                 {
-                    parents.push_back(sourceBranchJson["head"]); // Add source branch head as an additional parent
+                    // Add source branch head as an additional parent
+                    pendingEdges.emplace_back(self, intern(sourceBranchJson["head"].get<std::string>()));
                 }
             }
         }
     }
+}
 
-    // Add the commit node to the graph
-    auto node = std::make_shared<CommitNode>(commitId, message, timestamp, parents);
-    nodes[commitId] = node;
+void CommitGraph::finalize()
+{
+    // Counting sort of the collected edges into CSR form, preserving parent order per commit
+    size_t n = commitIds.size();
+    parentOffsets.assign(n + 1, 0);
+    for (const auto &[child, parent] : pendingEdges)
+    {
+        parentOffsets[child + 1]++;
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        parentOffsets[i + 1] += parentOffsets[i];
+    }
+
+    parentIndices.resize(pendingEdges.size());
+    std::vector<uint32_t> cursor(parentOffsets.begin(), parentOffsets.end() - 1);
+    for (const auto &[child, parent] : pendingEdges)
+    {
+        parentIndices[cursor[child]++] = parent;
+    }
+
+    pendingEdges.clear();
+    pendingEdges.shrink_to_fit();
 }
 
 void CommitGraph::buildGraph(const std::string &vcsPath)
 {
-    // Iterate through branch files to load all branches
+    this->vcsPath = vcsPath;
+
+    // Iterate through branch files to load all branches; `<ref>.lock` and temp files left by
+    // ref updates are not branches
     for (const auto &entry : std::filesystem::directory_iterator(vcsPath + "/branches"))
     {
-        loadBranch(entry.path().string());
+        if (entry.path().extension() == ".json")
+        {
+            loadBranch(entry.path().string());
+        }
+    }
+
+    // Parents that no branch lists (e.g. heads of deleted branches) are still loaded once
+    for (uint32_t i = 0; i < commitIds.size(); ++i)
+    {
+        if (!loaded[i])
+        {
+            loadCommit(i);
+        }
     }
+
+    finalize();
 }
 
-void CommitGraph::displayGraph()
+std::vector<uint32_t> CommitGraph::topologicalOrder(const GraphRange &range) const
 {
-    std::cout << "Commit History Graph:\n";
-    for (const auto &[commitId, node] : nodes)
+    size_t n = commitIds.size();
+
+    // Restrict to ancestors of the requested tip, if any
+    std::vector<uint8_t> inRange(n, 1);
+    if (!range.tip.empty())
     {
-        std::cout << "Commit: " << commitId << "\n";
-        std::cout << "Message: " << node->message << "\n";
-        std::cout << "Timestamp: " << node->timestamp << "\n";
+        std::fill(inRange.begin(), inRange.end(), 0);
+        auto it = index.find(range.tip);
+        if (it == index.end())
+        {
+            std::cerr << "Unknown commit: " << range.tip << std::endl;
+            return {};
+        }
+        std::vector<uint32_t> stack = {it->second};
+        inRange[it->second] = 1;
+        while (!stack.empty())
+        {
+            uint32_t i = stack.back();
+            stack.pop_back();
+            for (const uint32_t *p = parentsBegin(i); p != parentsEnd(i); ++p)
+            {
+                if (!inRange[*p])
+                {
+                    inRange[*p] = 1;
+                    stack.push_back(*p);
+                }
+            }
+        }
+    }
+
+    // Kahn's algorithm over child counts: a commit is emitted only after all of its children
+    std::vector<uint32_t> childCount(n, 0);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (!inRange[i])
+            continue;
+        for (const uint32_t *p = parentsBegin(i); p != parentsEnd(i); ++p)
+        {
+            childCount[*p]++;
+        }
+    }
+
+    std::vector<uint32_t> ready;
+    for (uint32_t i = n; i-- > 0;)
+    {
+        if (inRange[i] && childCount[i] == 0)
+        {
+            ready.push_back(i);
+        }
+    }
+
+    std::vector<uint32_t> order;
+    size_t limit = range.limit ? range.limit : n;
+    while (!ready.empty() && order.size() < limit)
+    {
+        uint32_t i = ready.back();
+        ready.pop_back();
+        order.push_back(i);
+
+        // Push parents in reverse so the first parent is visited next
+        for (const uint32_t *p = parentsEnd(i); p != parentsBegin(i);)
+        {
+            --p;
+            if (--childCount[*p] == 0)
+            {
+                ready.push_back(*p);
+            }
+        }
+    }
+    return order;
+}
+
+void CommitGraph::writeAscii(std::ostream &out, const GraphRange &range) const
+{
+    // Each lane holds the commit expected next in that column
+    std::vector<uint32_t> lanes;
+    std::string row;
+
+    for (uint32_t i : topologicalOrder(range))
+    {
+        auto column = std::find(lanes.begin(), lanes.end(), i);
+        if (column == lanes.end())
+        {
+            column = lanes.insert(lanes.end(), i); // New head starts its own lane
+        }
+        size_t col = column - lanes.begin();
+
+        row.clear();
+        for (size_t c = 0; c < lanes.size(); ++c)
+        {
+            row += (c == col) ? "* " : "| ";
+        }
+        out << row << commitIds[i].substr(0, 8) << " " << message(i) << "\n";
+
+        // Lanes of other children waiting for this commit join here
+        for (size_t c = lanes.size(); c-- > col + 1;)
+        {
+            if (lanes[c] == i)
+            {
+                lanes.erase(lanes.begin() + c);
+            }
+        }
+
+        const uint32_t *first = parentsBegin(i);
+        const uint32_t *last = parentsEnd(i);
+        if (first == last)
+        {
+            lanes.erase(lanes.begin() + col); // Root commit ends its lane
+            continue;
+        }
 
-        if (!node->parents.empty())
+        lanes[col] = *first;
+        for (const uint32_t *p = first + 1; p != last; ++p)
         {
-            std::cout << "Parents: ";
-            for (const auto &parent : node->parents)
+            if (std::find(lanes.begin(), lanes.end(), *p) == lanes.end())
             {
-                std::cout << parent << " ";
+                lanes.insert(lanes.begin() + col + 1, *p); // Merge parent opens a lane beside it
             }
-            std::cout << "\n";
         }
-        std::cout << "-------------------\n";
     }
 }
 
-std::string CommitGraph::exportToDOT()
+static void writeDOTString(std::ostream &out, std::string_view value)
+{
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+}
+
+void CommitGraph::exportToDOT(std::ostream &out, const GraphRange &range) const
 {
-    std::string dot = "digraph CommitGraph {\n";
-    for (const auto &[commitId, node] : nodes)
+    std::vector<uint32_t> order = topologicalOrder(range);
+    std::vector<uint8_t> emitted(commitIds.size(), 0);
+    for (uint32_t i : order)
+    {
+        emitted[i] = 1;
+    }
+
+    out << "digraph CommitGraph {\n";
+    for (uint32_t i : order)
     {
-        dot += "    \"" + commitId + "\" [label=\"" + node->message + "\\n" + node->timestamp + "\"];\n";
-        for (const auto &parent : node->parents)
+        out << "    \"" << commitIds[i] << "\" [label=\"";
+        writeDOTString(out, message(i));
+        out << "\\n" << timestamp(i) << "\"];\n";
+        for (const uint32_t *p = parentsBegin(i); p != parentsEnd(i); ++p)
         {
-            dot += "    \"" + parent + "\" -> \"" + commitId + "\";\n";
+            if (emitted[*p])
+            {
+                out << "    \"" << commitIds[*p] << "\" -> \"" << commitIds[i] << "\";\n";
+            }
         }
     }
-    dot += "}\n";
-    return dot;
+    out << "}\n";
 }
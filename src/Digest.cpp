@@ -0,0 +1,49 @@
+#include "../include/Digest.h"
+#include "../picosha2.h"
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string Digest::hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        text[2 * i] = digits[bytes[i] >> 4];
+        text[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+    return text;
+}
+
+bool Digest::fromHex(std::string_view hex, Digest& digest) {
+    if (hex.size() != size * 2) return false;
+    Digest parsed;
+    for (size_t i = 0; i < size; ++i) {
+        int high = hexValue(hex[2 * i]);
+        int low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return false;
+        parsed.bytes[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    digest = parsed;
+    return true;
+}
+
+Digest Digest::of(const void* data, size_t length) {
+    Digest digest;
+    const auto* begin = static_cast<const uint8_t*>(data);
+    picosha2::hash256(begin, begin + length, digest.bytes.begin(), digest.bytes.end());
+    return digest;
+}
+
+void to_json(nlohmann::json& json, const Digest& digest) {
+    json = digest.hex();
+}
+
+void from_json(const nlohmann::json& json, Digest& digest) {
+    if (!Digest::fromHex(json.get_ref<const std::string&>(), digest)) {
+        throw std::invalid_argument("Not a SHA-256 hex digest: " + json.get<std::string>());
+    }
+}
@@ -0,0 +1,245 @@
+#include "../include/EwahBitmap.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr uint64_t allOnes = ~uint64_t(0);
+constexpr uint64_t maxRunLength = (uint64_t(1) << 32) - 1;
+constexpr uint64_t maxLiterals = (uint64_t(1) << 31) - 1;
+
+uint64_t markerRunBit(uint64_t marker) { return marker & 1; }
+uint64_t markerRunLength(uint64_t marker) { return (marker >> 1) & maxRunLength; }
+uint64_t markerLiterals(uint64_t marker) { return marker >> 33; }
+
+// Walks the compressed words as a sequence of runs and literals; past the end it is an endless
+// run of zeros, so bitmaps of different lengths combine naturally
+class Cursor {
+private:
+    const std::vector<uint64_t>& words;
+    size_t next = 0;        // Next marker
+    size_t literal = 0;     // Current literal word
+    uint64_t run = 0;       // Words left in the current run
+    uint64_t literals = 0;  // Literal words left after it
+    bool runBit = false;
+
+    void advance() {
+        while (run == 0 && literals == 0 && next < words.size()) {
+            uint64_t marker = words[next];
+            runBit = markerRunBit(marker);
+            run = markerRunLength(marker);
+            literals = markerLiterals(marker);
+            literal = next + 1;
+            next = literal + literals;
+        }
+    }
+
+public:
+    explicit Cursor(const std::vector<uint64_t>& compressed) : words(compressed) { advance(); }
+
+    bool done() const { return run == 0 && literals == 0; }
+    bool inRun() const { return run > 0 || done(); }
+    bool bit() const { return run > 0 && runBit; }
+    // Words left in the current run (unbounded once done)
+    uint64_t runLength() const { return done() ? UINT64_MAX : run; }
+    uint64_t word() const { return run > 0 ? (runBit ? allOnes : 0) : (done() ? 0 : words[literal]); }
+
+    void skip(uint64_t count) {
+        while (count > 0 && !done()) {
+            if (run > 0) {
+                uint64_t step = std::min(count, run);
+                run -= step;
+                count -= step;
+            } else {
+                uint64_t step = std::min(count, literals);
+                literal += step;
+                literals -= step;
+                count -= step;
+            }
+            advance();
+        }
+    }
+};
+
+} // namespace
+
+// Appends runs and words, merging runs and keeping all-0/all-1 literals out of the stream
+class EwahEncoder {
+private:
+    EwahBitmap bitmap;
+    size_t marker = 0;
+
+    void newMarker() {
+        marker = bitmap.words.size();
+        bitmap.words.push_back(0);
+    }
+
+public:
+    EwahEncoder() { newMarker(); }
+
+    void addRun(bool bit, uint64_t count) {
+        if (count == 0) return;
+        bitmap.wordCount += count;
+        while (count > 0) {
+            uint64_t& current = bitmap.words[marker];
+            bool extendable = markerLiterals(current) == 0 &&
+                              (markerRunLength(current) == 0 || markerRunBit(current) == uint64_t(bit)) &&
+                              markerRunLength(current) < maxRunLength;
+            if (!extendable) {
+                newMarker();
+                continue;
+            }
+            uint64_t step = std::min(count, maxRunLength - markerRunLength(current));
+            current = (current & ~(maxRunLength << 1) & ~uint64_t(1)) | ((markerRunLength(current) + step) << 1) |
+                      uint64_t(bit);
+            count -= step;
+        }
+    }
+
+    void addWord(uint64_t word) {
+        if (word == 0 || word == allOnes) {
+            addRun(word != 0, 1);
+            return;
+        }
+        if (markerLiterals(bitmap.words[marker]) == maxLiterals) newMarker();
+        bitmap.words[marker] += uint64_t(1) << 33;
+        bitmap.words.push_back(word);
+        ++bitmap.wordCount;
+    }
+
+    EwahBitmap finish() {
+        // A trailing run of zeros carries no information
+        uint64_t last = bitmap.words[marker];
+        if (markerLiterals(last) == 0 && markerRunBit(last) == 0) {
+            bitmap.wordCount -= markerRunLength(last);
+            bitmap.words.pop_back();
+        }
+        return std::move(bitmap);
+    }
+};
+
+EwahBitmap EwahBitmap::fromWords(const std::vector<uint64_t>& plain) {
+    EwahEncoder encoder;
+    for (size_t i = 0; i < plain.size();) {
+        if (plain[i] == 0 || plain[i] == allOnes) {
+            size_t end = i + 1;
+            while (end < plain.size() && plain[end] == plain[i]) ++end;
+            encoder.addRun(plain[i] != 0, end - i);
+            i = end;
+        } else {
+            encoder.addWord(plain[i++]);
+        }
+    }
+    return encoder.finish();
+}
+
+void EwahBitmap::orInto(std::vector<uint64_t>& plain) const {
+    if (plain.size() < wordCount) plain.resize(wordCount, 0);
+    Cursor cursor(words);
+    for (uint64_t position = 0; !cursor.done();) {
+        if (cursor.inRun()) {
+            uint64_t length = cursor.runLength();
+            if (cursor.bit()) std::fill_n(plain.begin() + static_cast<std::ptrdiff_t>(position), length, allOnes);
+            position += length;
+            cursor.skip(length);
+        } else {
+            plain[position++] |= cursor.word();
+            cursor.skip(1);
+        }
+    }
+}
+
+// Both operations combine run against run in one step and only go word by word over literals
+template <typename Op>
+static EwahBitmap combine(const std::vector<uint64_t>& left, const std::vector<uint64_t>& right, Op op) {
+    EwahEncoder encoder;
+    Cursor a(left), b(right);
+    while (!a.done() || !b.done()) {
+        if (a.inRun() && b.inRun()) {
+            uint64_t length = std::min(a.runLength(), b.runLength());
+            encoder.addRun(op(a.word(), b.word()) != 0, length);
+            a.skip(length);
+            b.skip(length);
+        } else {
+            encoder.addWord(op(a.word(), b.word()));
+            a.skip(1);
+            b.skip(1);
+        }
+    }
+    return encoder.finish();
+}
+
+EwahBitmap EwahBitmap::operator|(const EwahBitmap& other) const {
+    return combine(words, other.words, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+EwahBitmap EwahBitmap::andNot(const EwahBitmap& other) const {
+    return combine(words, other.words, [](uint64_t a, uint64_t b) { return a & ~b; });
+}
+
+uint64_t EwahBitmap::count() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < words.size();) {
+        uint64_t marker = words[i];
+        if (markerRunBit(marker)) total += 64 * markerRunLength(marker);
+        for (uint64_t j = 0; j < markerLiterals(marker); ++j) total += std::popcount(words[i + 1 + j]);
+        i += 1 + markerLiterals(marker);
+    }
+    return total;
+}
+
+bool EwahBitmap::get(uint64_t position) const {
+    Cursor cursor(words);
+    cursor.skip(position / 64);
+    return (cursor.word() >> (position % 64)) & 1;
+}
+
+void EwahBitmap::forEach(const std::function<void(uint64_t)>& visit) const {
+    Cursor cursor(words);
+    for (uint64_t base = 0; !cursor.done();) {
+        if (cursor.inRun()) {
+            uint64_t length = cursor.runLength();
+            if (cursor.bit()) {
+                for (uint64_t position = base; position < base + 64 * length; ++position) visit(position);
+            }
+            base += 64 * length;
+            cursor.skip(length);
+        } else {
+            for (uint64_t word = cursor.word(); word != 0; word &= word - 1) {
+                visit(base + static_cast<uint64_t>(std::countr_zero(word)));
+            }
+            base += 64;
+            cursor.skip(1);
+        }
+    }
+}
+
+std::string EwahBitmap::serialize() const {
+    std::string data;
+    data.reserve(8 * (words.size() + 1));
+    auto put = [&](uint64_t value) {
+        for (int i = 0; i < 8; ++i) data.push_back(static_cast<char>(value >> (8 * i)));
+    };
+    put(wordCount);
+    for (uint64_t word : words) put(word);
+    return data;
+}
+
+bool EwahBitmap::deserialize(const std::string& data, EwahBitmap& bitmap) {
+    if (data.size() < 8 || data.size() % 8 != 0) return false;
+    auto at = [&](size_t index) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(static_cast<unsigned char>(data[8 * index + i])) << (8 * i);
+        return value;
+    };
+    EwahBitmap result;
+    result.wordCount = at(0);
+    result.words.reserve(data.size() / 8 - 1);
+    for (size_t i = 1; i < data.size() / 8; ++i) result.words.push_back(at(i));
+    // Every marker's literals must fit in the data
+    for (size_t i = 0; i < result.words.size(); i += 1 + markerLiterals(result.words[i])) {
+        if (i + 1 + markerLiterals(result.words[i]) > result.words.size()) return false;
+    }
+    bitmap = std::move(result);
+    return true;
+}
@@ -1,56 +1,380 @@
 #include "../include/FileSystem.h"
+#include "../include/Trace.h"
+#include "../include/Stats.h"
+#include "../include/IgnoreMatcher.h"
+#include "../include/SparseCheckout.h"
+#include "../include/IoEngine.h"
+#include "../include/WorkingTreeIndex.h"
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <map>
+#include <random>
 
 #include "../picosha2.h"
 
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace fs = std::filesystem;
 
+#ifdef __linux__
+// Copies `length` bytes from in to out at their current offsets, inside the kernel when possible:
+// copy_file_range (may reflink/offload), then sendfile, then a plain read/write loop
+static bool copyDescriptor(int in, int out, uint64_t length) {
+    bool useCopyRange = true;
+    bool useSendfile = true;
+    uint64_t done = 0;
+    while (done < length) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(length - done, 1ULL << 30));
+        ssize_t n = -1;
+        if (useCopyRange) {
+            n = copy_file_range(in, nullptr, out, nullptr, want, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                useCopyRange = false;
+                continue;
+            }
+        } else if (useSendfile) {
+            n = sendfile(out, in, nullptr, want);
+            if (n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                useSendfile = false;
+                continue;
+            }
+        } else {
+            char buffer[1 << 16];
+            n = read(in, buffer, std::min(want, sizeof(buffer)));
+            for (ssize_t written = 0; n > 0 && written < n;) {
+                ssize_t w = write(out, buffer + written, n - written);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                written += w;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) break; // Source shrank underneath us
+        done += static_cast<uint64_t>(n);
+    }
+    Stats::add(Counter::BytesWritten, done);
+    return done == length; // A short copy is a failure, not a smaller file
+}
+
+// Opens a blob source for one sequential pass
+static int openSequential(const std::string& path, struct stat& info) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+}
+#endif
+
 bool FileSystem::createDirectory(const std::string& path) {
     return fs::create_directories(path);
 }
 
+// Pending writeJson() values while writes are deferred, by absolute path
+static bool deferring = false;
+static std::map<std::string, nlohmann::json> deferredWrites;
+
+static std::string deferredKey(const std::string& path) {
+    return fs::absolute(path).lexically_normal().generic_string();
+}
+
+static const nlohmann::json* findDeferred(const std::string& path) {
+    if (deferredWrites.empty()) return nullptr;
+    auto it = deferredWrites.find(deferredKey(path));
+    return it == deferredWrites.end() ? nullptr : &it->second;
+}
+
 bool FileSystem::fileExists(const std::string& path) {
-    return fs::exists(path);
+    Stats::add(Counter::FilesStatted);
+    return findDeferred(path) || fs::exists(path);
 }
 
-std::string FileSystem::calculateHash(const std::string& filePath) {
+Digest FileSystem::calculateHash(const std::string& filePath) {
+    VCS_TRACE_SCOPE("FileSystem::calculateHash");
     std::ifstream file(filePath, std::ios::binary);
-    if (!file) return "";
-    std::ostringstream oss;
-    oss << file.rdbuf();
-    return picosha2::hash256_hex_string(oss.str());
+    if (!file) return Digest{};
+    // Streamed in fixed blocks so large files are never held in memory whole
+    picosha2::hash256_one_by_one hasher;
+    std::vector<char> buffer(1 << 20);
+    uint64_t total = 0;
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = file.gcount();
+        if (got <= 0) break;
+        hasher.process(buffer.begin(), buffer.begin() + got);
+        total += static_cast<uint64_t>(got);
+    }
+    hasher.finish();
+    Stats::add(Counter::FilesHashed);
+    Stats::add(Counter::BytesHashed, total);
+    Digest digest;
+    hasher.get_hash_bytes(digest.bytes.begin(), digest.bytes.end());
+    return digest;
+}
+
+std::string FileSystem::relativePath(const fs::path& path, const fs::path& root) {
+    return path.lexically_relative(root).generic_string();
 }
 
-nlohmann::json FileSystem::getDirectoryTree(const std::string& directoryPath) {
-    nlohmann::json tree = nlohmann::json::object();
-    for (const auto& entry : fs::recursive_directory_iterator(directoryPath)) {
-        if (entry.is_regular_file()) {
-            tree[entry.path().string()] = calculateHash(entry.path().string());
+// Files below this size are hashed from one batched read each
+static constexpr uintmax_t batchHashLimit = 1024 * 1024;
+
+// A file that failed to hash is only left out if it was deleted since the walk; leaving out
+// one that is merely unreadable would record it as deleted
+static void checkVanished(const std::string& path) {
+    std::error_code ec;
+    if (fs::exists(path, ec) || ec) throw std::runtime_error("Could not read " + path);
+}
+
+Tree FileSystem::getDirectoryTree(const std::string& directoryPath, const IgnoreMatcher* ignore,
+                                  const SparseCheckout* sparse, WorkingTreeIndex* index) {
+    VCS_TRACE_SCOPE("FileSystem::getDirectoryTree");
+    Tree tree;
+    std::vector<std::string> paths, keys;
+    struct Stamp {
+        uint64_t size;
+        int64_t mtime;
+        bool known;
+    };
+    std::vector<Stamp> stamps; // Of each file in `paths`, for the index
+    bool filtered = ignore || (sparse && sparse->enabled());
+    if (index) index->beginScan();
+    for (auto it = fs::recursive_directory_iterator(directoryPath); it != fs::recursive_directory_iterator(); ++it) {
+        Stats::add(Counter::FilesStatted);
+        const auto& entry = *it;
+        bool isDirectory = entry.is_directory();
+        std::string relative = relativePath(entry.path(), directoryPath);
+        if (filtered) {
+            bool skipped = ignore && ignore->isIgnored(relative, isDirectory);
+            if (!skipped && sparse) {
+                skipped = isDirectory ? !sparse->shouldDescend(relative) : !sparse->includes(relative);
+            }
+            if (skipped) {
+                if (isDirectory) it.disable_recursion_pending();
+                continue;
+            }
+        }
+        if (!entry.is_regular_file()) continue;
+
+        // Keys are "./"-prefixed and relative to the scanned directory, as stored in commits
+        std::string key = "./" + relative;
+        std::error_code ec;
+        uint64_t size = entry.file_size(ec);
+        int64_t mtime = ec ? 0 : entry.last_write_time(ec).time_since_epoch().count();
+        if (index && !ec) {
+            if (const Digest* digest = index->lookup(key, size, mtime)) {
+                Stats::add(Counter::IndexHits);
+                tree.insert(key, *digest);
+                continue;
+            }
+        }
+        if (size >= batchHashLimit) {
+            // Large files are streamed through the hasher instead of being read whole
+            Digest digest = calculateHash(entry.path().string());
+            if (digest.isNull()) {
+                checkVanished(entry.path().string());
+                continue;
+            }
+            tree.insert(key, digest);
+            if (index && !ec) index->record(key, size, mtime, digest);
+        } else {
+            paths.push_back(entry.path().string());
+            keys.push_back(std::move(key));
+            stamps.push_back(Stamp{size, mtime, !ec});
         }
     }
+
+    // Walk first, then hash the whole set in batches
+    std::vector<Digest> hashes = calculateHashes(paths);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (hashes[i].isNull()) {
+            checkVanished(paths[i]);
+            continue;
+        }
+        tree.insert(keys[i], hashes[i]);
+        if (index && stamps[i].known) index->record(keys[i], stamps[i].size, stamps[i].mtime, hashes[i]);
+    }
+    if (index) index->finishScan();
+    tree.finalize();
     return tree;
 }
 
+std::vector<Digest> FileSystem::calculateHashes(const std::vector<std::string>& filePaths) {
+    VCS_TRACE_SCOPE("FileSystem::calculateHashes");
+    std::vector<Digest> hashes(filePaths.size());
+    IoEngine::readFiles(filePaths, [&hashes](size_t index, bool ok, std::string& content, uint32_t) {
+        if (!ok) return;
+        VCS_TRACE_SCOPE("sha256");
+        Stats::add(Counter::FilesHashed);
+        Stats::add(Counter::BytesHashed, content.size());
+        hashes[index] = Digest::of(content);
+    });
+    return hashes;
+}
+
 std::string FileSystem::readFile(const std::string& filePath) {
+    VCS_TRACE_SCOPE("FileSystem::readFile");
+    if (const nlohmann::json* pending = findDeferred(filePath)) return pending->dump(4);
     std::ifstream file(filePath);
     if (!file) return "";
     return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 }
 
 bool FileSystem::writeFile(const std::string& filePath, const std::string& content) {
+    VCS_TRACE_SCOPE("FileSystem::writeFile");
     std::ofstream file(filePath);
     if (!file) return false;
     file << content;
+    Stats::add(Counter::BytesWritten, content.size());
     return true;
 }
 
+bool FileSystem::replaceFile(const std::string& filePath, const std::string& content) {
+    std::string tempPath = filePath + ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(content.data(), static_cast<std::streamsize>(content.size()))) return false;
+    }
+    Stats::add(Counter::BytesWritten, content.size());
+    std::error_code ec;
+    std::filesystem::rename(tempPath, filePath, ec);
+    if (ec) std::filesystem::remove(tempPath, ec);
+    return !ec;
+}
+
 bool FileSystem::copyFile(const std::string& source, const std::string& destination) {
+    VCS_TRACE_SCOPE("FileSystem::copyFile");
+#ifdef __linux__
+    struct stat info;
+    int in = openSequential(source, info);
+    if (in < 0) return false;
+    int out = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool ok = copyDescriptor(in, out, static_cast<uint64_t>(info.st_size));
+    posix_fadvise(in, 0, 0, POSIX_FADV_DONTNEED); // The source was read once; don't let it evict hotter pages
+    close(in);
+    return close(out) == 0 && ok;
+#else
     try {
         fs::copy(source, destination, fs::copy_options::overwrite_existing);
+        Stats::add(Counter::BytesWritten, fs::file_size(destination));
         return true;
     } catch (...) {
         return false;
     }
+#endif
+}
+
+bool FileSystem::concatenateFiles(const std::vector<std::string>& sources, const std::string& destination) {
+    VCS_TRACE_SCOPE("FileSystem::concatenateFiles");
+#ifdef __linux__
+    int out = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) return false;
+    bool ok = true;
+    for (const auto& source : sources) {
+        struct stat info;
+        int in = openSequential(source, info);
+        if (in < 0) {
+            ok = false;
+            break;
+        }
+        ok = copyDescriptor(in, out, static_cast<uint64_t>(info.st_size));
+        close(in);
+        if (!ok) break;
+    }
+    return close(out) == 0 && ok;
+#else
+    std::ofstream out(destination, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    for (const auto& source : sources) {
+        std::ifstream in(source, std::ios::binary);
+        if (!in) return false;
+        out << in.rdbuf();
+        Stats::add(Counter::BytesWritten, fs::file_size(source));
+    }
+    return static_cast<bool>(out);
+#endif
+}
+
+nlohmann::json FileSystem::readJson(const std::string& filePath) {
+    if (const nlohmann::json* pending = findDeferred(filePath)) return *pending;
+    std::string text = readFile(filePath);
+    VCS_TRACE_SCOPE("json parse");
+    Stats::add(Counter::JsonBytesParsed, text.size());
+    return nlohmann::json::parse(text);
+}
+
+bool FileSystem::writeJson(const std::string& filePath, const nlohmann::json& value) {
+    if (deferring) {
+        deferredWrites[deferredKey(filePath)] = value;
+        return true;
+    }
+    std::string text;
+    {
+        VCS_TRACE_SCOPE("json dump");
+        text = value.dump(4);
+    }
+    Stats::add(Counter::JsonBytesSerialized, text.size());
+    return writeFile(filePath, text);
+}
+
+void FileSystem::deferWrites(bool enabled) {
+    if (!enabled) flushWrites();
+    deferring = enabled;
+}
+
+bool FileSystem::deferringWrites() {
+    return deferring;
+}
+
+bool FileSystem::flushWrites() {
+    VCS_TRACE_SCOPE("FileSystem::flushWrites");
+    // Refs last, so a crash part-way leaves them pointing at commits that were fully written
+    auto isRef = [](const std::string& path) {
+        return path.find("/.vcs/branches/") != std::string::npos || path.find("/.vcs/current_branch/") != std::string::npos;
+    };
+    bool ok = true;
+    for (bool refs : {false, true}) {
+        for (const auto& [path, value] : deferredWrites) {
+            if (isRef(path) != refs) continue;
+            std::string text = value.dump(4);
+            Stats::add(Counter::JsonBytesSerialized, text.size());
+            ok = (refs ? replaceFile(path, text) : writeFile(path, text)) && ok;
+        }
+    }
+    deferredWrites.clear();
+    return ok;
+}
+
+void FileSystem::removeAll(const std::string& path) {
+    if (!deferredWrites.empty()) {
+        std::string key = deferredKey(path);
+        auto it = deferredWrites.lower_bound(key);
+        while (it != deferredWrites.end() && it->first.starts_with(key) &&
+               (it->first.size() == key.size() || it->first[key.size()] == '/')) {
+            it = deferredWrites.erase(it);
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(path, ec);
 }
@@ -0,0 +1,246 @@
+#include "../include/Fsck.h"
+#include "../include/BlobStore.h"
+#include "../include/Digest.h"
+#include "../include/FileSystem.h"
+#include "../include/Trace.h"
+#include "../picosha2.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Runs check(i) for i in [0, count) on `threads` workers; each item's problems go into its own slot
+void parallelFor(size_t count, unsigned threads, const std::function<void(size_t, std::vector<std::string>&)>& check,
+                 std::vector<std::string>& errors) {
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    auto worker = [&]() {
+        std::vector<std::string> local;
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                check(i, local);
+            } catch (const std::exception& e) {
+                local.push_back(e.what());
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        errors.insert(errors.end(), local.begin(), local.end());
+    };
+    std::vector<std::thread> pool;
+    unsigned extra = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(count, 1))) - 1;
+    for (unsigned t = 0; t < extra; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Feeds a file into `hasher` in blocks; returns bytes read, or -1 if it cannot be opened
+int64_t hashInto(const std::string& path, picosha2::hash256_one_by_one& hasher, Digest* ownDigest) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return -1;
+    picosha2::hash256_one_by_one own;
+    std::vector<char> buffer(1 << 20);
+    int64_t total = 0;
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize got = file.gcount();
+        if (got <= 0) break;
+        hasher.process(buffer.begin(), buffer.begin() + got);
+        if (ownDigest) own.process(buffer.begin(), buffer.begin() + got);
+        total += got;
+    }
+    if (ownDigest) {
+        own.finish();
+        own.get_hash_bytes(ownDigest->bytes.begin(), ownDigest->bytes.end());
+    }
+    return total;
+}
+
+void checkObject(const fs::path& folder, bool quick, std::vector<std::string>& errors) {
+    std::string name = folder.filename().string();
+    Digest expected;
+    if (!Digest::fromHex(name, expected)) {
+        errors.push_back("object " + name + ": folder name is not a digest");
+        return;
+    }
+    std::string folderPath = folder.string();
+    if (!FileSystem::fileExists(folderPath + "/hash.json")) {
+        errors.push_back("object " + name + ": missing hash.json");
+    }
+
+    picosha2::hash256_one_by_one hasher;
+    if (BlobStore::isChunked(folderPath)) {
+        nlohmann::json manifest = FileSystem::readJson(folderPath + "/chunks.json");
+        for (const auto& chunk : manifest["chunks"]) {
+            Digest chunkDigest = chunk["hash"].get<Digest>();
+            std::string chunkPath = BlobStore::chunkPath(chunkDigest);
+            uint64_t size = chunk["size"].get<uint64_t>();
+            if (quick) {
+                std::error_code ec;
+                uint64_t actual = fs::file_size(chunkPath, ec);
+                if (ec) {
+                    errors.push_back("object " + name + ": missing chunk " + chunkDigest.hex());
+                } else if (actual != size) {
+                    errors.push_back("object " + name + ": chunk " + chunkDigest.hex() + " is " + std::to_string(actual) +
+                                     " bytes, expected " + std::to_string(size));
+                }
+                continue;
+            }
+            Digest actual;
+            int64_t read = hashInto(chunkPath, hasher, &actual);
+            if (read < 0) {
+                errors.push_back("object " + name + ": missing chunk " + chunkDigest.hex());
+                return; // The whole-object hash cannot be right either
+            }
+            if (actual != chunkDigest || static_cast<uint64_t>(read) != size) {
+                errors.push_back("chunk " + chunkDigest.hex() + ": content does not match its name");
+            }
+        }
+    } else {
+        // A whole object is the one file next to hash.json; any other file makes it ambiguous
+        std::string content = BlobStore::contentPath(folderPath);
+        if (content.empty()) {
+            errors.push_back("object " + name + ": no content file");
+            return;
+        }
+        size_t files = 0;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(folder, ec)) {
+            if (entry.is_regular_file() && entry.path().filename() != "hash.json") ++files;
+        }
+        if (files > 1) {
+            errors.push_back("object " + name + ": " + std::to_string(files) + " content files");
+        }
+        if (quick) return;
+        if (hashInto(content, hasher, nullptr) < 0) {
+            errors.push_back("object " + name + ": cannot read " + content);
+            return;
+        }
+    }
+    if (quick) return;
+
+    hasher.finish();
+    Digest actual;
+    hasher.get_hash_bytes(actual.bytes.begin(), actual.bytes.end());
+    if (actual != expected) {
+        errors.push_back("object " + name + ": content hashes to " + actual.hex());
+    }
+}
+
+void checkCommit(const fs::path& file, const std::unordered_set<std::string>& commitIds,
+                 const std::unordered_set<std::string>& objects, std::vector<std::string>& errors) {
+    std::string id = file.stem().string();
+    nlohmann::json commit = FileSystem::readJson(file.string());
+    if (commit.value("commit_id", "") != id) {
+        errors.push_back("commit " + id + ": commit_id field is '" + commit.value("commit_id", "") + "'");
+    }
+    std::vector<std::string> parents;
+    if (commit.contains("parents") && commit["parents"].is_array()) {
+        parents = commit["parents"].get<std::vector<std::string>>();
+    } else if (commit.value("parent", "null") != "null" && !commit.value("parent", "").empty()) {
+        parents.push_back(commit["parent"].get<std::string>());
+    }
+    for (const auto& parent : parents) {
+        if (!commitIds.count(parent)) errors.push_back("commit " + id + ": parent " + parent + " does not exist");
+    }
+    if (!commit.contains("directory_tree") || !commit["directory_tree"].is_object()) {
+        errors.push_back("commit " + id + ": missing directory_tree");
+        return;
+    }
+    for (const auto& [path, hash] : commit["directory_tree"].items()) {
+        if (!hash.is_string() || !objects.count(hash.get<std::string>())) {
+            errors.push_back("commit " + id + ": " + path + " references missing object " +
+                             (hash.is_string() ? hash.get<std::string>() : std::string("(invalid)")));
+        }
+    }
+}
+
+} // namespace
+
+FsckReport Fsck::run(const FsckOptions& options) {
+    VCS_TRACE_SCOPE("Fsck::run");
+    FsckReport report;
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<fs::path> objectFolders, commitFiles;
+    std::unordered_set<std::string> objects, commitIds;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(".vcs/data/hash", ec)) {
+        if (!entry.is_directory()) continue;
+        objectFolders.push_back(entry.path());
+        objects.insert(entry.path().filename().string());
+    }
+    for (const auto& entry : fs::directory_iterator(".vcs/commits", ec)) {
+        if (entry.path().extension() != ".json") continue;
+        commitFiles.push_back(entry.path());
+        commitIds.insert(entry.path().stem().string());
+    }
+
+    {
+        VCS_TRACE_SCOPE("fsck: objects");
+        parallelFor(objectFolders.size(), threads, [&](size_t i, std::vector<std::string>& errors) {
+            checkObject(objectFolders[i], options.quick, errors);
+        }, report.errors);
+    }
+    {
+        VCS_TRACE_SCOPE("fsck: commits");
+        parallelFor(commitFiles.size(), threads, [&](size_t i, std::vector<std::string>& errors) {
+            checkCommit(commitFiles[i], commitIds, objects, errors);
+        }, report.errors);
+    }
+    report.objects = objectFolders.size();
+    report.commits = commitFiles.size();
+    std::error_code chunkError;
+    for (auto it = fs::recursive_directory_iterator(".vcs/data/chunks", chunkError); !chunkError && it != fs::recursive_directory_iterator(); ++it) {
+        if (it->is_regular_file()) ++report.chunks;
+    }
+
+    // Refs: few and small, checked inline
+    auto checkHead = [&](const std::string& what, const std::string& head) {
+        if (!head.empty() && !commitIds.count(head)) report.errors.push_back(what + ": head " + head + " does not exist");
+    };
+    for (const auto& entry : fs::directory_iterator(".vcs/branches", ec)) {
+        if (entry.path().extension() != ".json") continue;
+        ++report.branches;
+        std::string name = "branch " + entry.path().stem().string();
+        try {
+            nlohmann::json branch = FileSystem::readJson(entry.path().string());
+            checkHead(name, branch.value("head", ""));
+            for (const auto& commitId : branch.value("commits", nlohmann::json::array())) {
+                if (!commitIds.count(commitId.get<std::string>())) {
+                    report.errors.push_back(name + ": lists missing commit " + commitId.get<std::string>());
+                }
+            }
+        } catch (const std::exception& e) {
+            report.errors.push_back(name + ": " + e.what());
+        }
+    }
+    std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
+    if (FileSystem::fileExists(currentBranchPath)) {
+        try {
+            nlohmann::json current = FileSystem::readJson(currentBranchPath);
+            std::string name = current.value("name", "");
+            if (!FileSystem::fileExists(".vcs/branches/" + name + ".json")) {
+                report.errors.push_back("current branch: '" + name + "' does not exist");
+            }
+            checkHead("current branch", current.value("head", ""));
+        } catch (const std::exception& e) {
+            report.errors.push_back(std::string("current branch: ") + e.what());
+        }
+    }
+
+    std::sort(report.errors.begin(), report.errors.end());
+    return report;
+}
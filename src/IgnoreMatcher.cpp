@@ -0,0 +1,255 @@
+#include "../include/IgnoreMatcher.h"
+#include "../include/FileSystem.h"
+#include <sstream>
+
+IgnoreMatcher::IgnoreMatcher()
+{
+    addPattern("/vcs.exe"); // The tool's own binary, historically excluded from every snapshot
+}
+
+std::vector<IgnoreMatcher::Token> IgnoreMatcher::compile(const std::string &pattern)
+{
+    std::vector<Token> tokens;
+    auto appendLiteral = [&tokens](char c)
+    {
+        if (tokens.empty() || tokens.back().type != TokenType::Literal)
+        {
+            tokens.push_back({TokenType::Literal, "", {}});
+        }
+        tokens.back().literal += c;
+    };
+
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size())
+        {
+            appendLiteral(pattern[++i]);
+        }
+        else if (c == '*' && i + 1 < pattern.size() && pattern[i + 1] == '*')
+        {
+            // `**/` matches zero or more whole directories; a bare `**` matches anything
+            i++;
+            Token token{TokenType::DoubleStar, "", {}};
+            if (i + 1 < pattern.size() && pattern[i + 1] == '/')
+            {
+                token.literal = "/";
+                i++;
+            }
+            tokens.push_back(token);
+        }
+        else if (c == '*')
+        {
+            tokens.push_back({TokenType::Star, "", {}});
+        }
+        else if (c == '?')
+        {
+            tokens.push_back({TokenType::AnySingle, "", {}});
+        }
+        else if (c == '[' && pattern.find(']', i + 2) != std::string::npos)
+        {
+            Token token{TokenType::Class, "", {}};
+            size_t j = i + 1;
+            bool negate = pattern[j] == '!' || pattern[j] == '^';
+            if (negate)
+                j++;
+            for (bool first = true; j < pattern.size() && (first || pattern[j] != ']'); ++j, first = false)
+            {
+                unsigned char lo = pattern[j];
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']')
+                {
+                    unsigned char hi = pattern[j + 2];
+                    for (unsigned v = lo; v <= hi; ++v)
+                        token.set.set(v);
+                    j += 2;
+                }
+                else
+                {
+                    token.set.set(lo);
+                }
+            }
+            if (negate)
+                token.set.flip();
+            token.set.reset('/');
+            tokens.push_back(token);
+            i = j;
+        }
+        else
+        {
+            appendLiteral(c);
+        }
+    }
+    return tokens;
+}
+
+bool IgnoreMatcher::matchTokens(const std::vector<Token> &tokens, size_t t, std::string_view text, size_t i)
+{
+    for (; t < tokens.size(); ++t)
+    {
+        const Token &token = tokens[t];
+        switch (token.type)
+        {
+        case TokenType::Literal:
+            if (text.compare(i, token.literal.size(), token.literal) != 0)
+                return false;
+            i += token.literal.size();
+            break;
+        case TokenType::AnySingle:
+            if (i >= text.size() || text[i] == '/')
+                return false;
+            i++;
+            break;
+        case TokenType::Class:
+            if (i >= text.size() || !token.set.test(static_cast<unsigned char>(text[i])))
+                return false;
+            i++;
+            break;
+        case TokenType::Star:
+            // Try every length that stays within the current path component
+            for (size_t end = i;; ++end)
+            {
+                if (matchTokens(tokens, t + 1, text, end))
+                    return true;
+                if (end >= text.size() || text[end] == '/')
+                    return false;
+            }
+        case TokenType::DoubleStar:
+            if (token.literal.empty())
+            {
+                for (size_t end = i; end <= text.size(); ++end)
+                {
+                    if (matchTokens(tokens, t + 1, text, end))
+                        return true;
+                }
+                return false;
+            }
+            // `**/`: resume at the start or right after any later '/'
+            if (matchTokens(tokens, t + 1, text, i))
+                return true;
+            for (size_t end = i; end < text.size(); ++end)
+            {
+                if (text[end] == '/' && matchTokens(tokens, t + 1, text, end + 1))
+                    return true;
+            }
+            return false;
+        }
+    }
+    return i == text.size();
+}
+
+void IgnoreMatcher::addPattern(const std::string &rawLine)
+{
+    std::string line = rawLine;
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+    {
+        line.pop_back();
+    }
+    if (line.empty() || line[0] == '#')
+        return;
+
+    bool negated = false;
+    if (line[0] == '!')
+    {
+        negated = true;
+        line.erase(0, 1);
+    }
+    else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#'))
+    {
+        line.erase(0, 1);
+    }
+
+    bool directoryOnly = false;
+    if (!line.empty() && line.back() == '/')
+    {
+        directoryOnly = true;
+        line.pop_back();
+    }
+
+    bool anchored = line.find('/') != std::string::npos;
+    if (!line.empty() && line[0] == '/')
+    {
+        line.erase(0, 1);
+    }
+    if (line.empty())
+        return;
+
+    int order = ruleCount++;
+    if (line.find_first_of("*?[\\") == std::string::npos)
+    {
+        auto &bucket = anchored ? literalPaths[line] : literalNames[line];
+        bucket.push_back({order, negated, directoryOnly});
+        return;
+    }
+    globRules.push_back({order, negated, directoryOnly, anchored, compile(line)});
+}
+
+IgnoreMatcher IgnoreMatcher::load(const std::string &root)
+{
+    IgnoreMatcher matcher;
+    std::string ignorePath = root + "/.vcsignore";
+    if (FileSystem::fileExists(ignorePath))
+    {
+        std::istringstream lines(FileSystem::readFile(ignorePath));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            matcher.addPattern(line);
+        }
+    }
+    return matcher;
+}
+
+bool IgnoreMatcher::isIgnored(std::string_view relativePath, bool isDirectory) const
+{
+    // The repository's own metadata can never be tracked
+    if (relativePath == ".vcs" || relativePath.starts_with(".vcs/"))
+        return true;
+
+    size_t slash = relativePath.rfind('/');
+    std::string_view basename = slash == std::string_view::npos ? relativePath : relativePath.substr(slash + 1);
+
+    int best = -1;
+    bool negated = false;
+    auto consider = [&](const std::unordered_map<std::string, std::vector<LiteralRule>> &rules, std::string_view key)
+    {
+        if (rules.empty())
+            return;
+        auto it = rules.find(std::string(key));
+        if (it == rules.end())
+            return;
+        for (const auto &rule : it->second)
+        {
+            if (rule.order > best && (!rule.directoryOnly || isDirectory))
+            {
+                best = rule.order;
+                negated = rule.negated;
+            }
+        }
+    };
+    consider(literalNames, basename);
+    consider(literalPaths, relativePath);
+
+    // Globs in reverse file order; anything older than the best literal hit cannot change the answer
+    for (auto it = globRules.rbegin(); it != globRules.rend() && it->order > best; ++it)
+    {
+        if (it->directoryOnly && !isDirectory)
+            continue;
+        if (matchTokens(it->tokens, 0, it->anchored ? relativePath : basename, 0))
+        {
+            best = it->order;
+            negated = it->negated;
+            break;
+        }
+    }
+    return best >= 0 && !negated;
+}
+
+bool IgnoreMatcher::isPathIgnored(std::string_view relativePath) const
+{
+    for (size_t slash = relativePath.find('/'); slash != std::string_view::npos; slash = relativePath.find('/', slash + 1))
+    {
+        if (isIgnored(relativePath.substr(0, slash), true))
+            return true;
+    }
+    return isIgnored(relativePath, false);
+}
@@ -0,0 +1,505 @@
+#include "../include/IoEngine.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <initializer_list>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define VCS_HAVE_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Blocking fallbacks, also used for anything the ring could not handle
+
+static void readFileBlocking(const std::string& path, size_t index,
+                             const std::function<void(size_t, bool, std::string&, uint32_t)>& onFile) {
+    std::string data;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        onFile(index, false, data, 0);
+        return;
+    }
+    std::error_code ec;
+    uint32_t mode = static_cast<uint32_t>(fs::status(path, ec).permissions()) & 07777;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    onFile(index, true, data, mode ? mode : 0644);
+}
+
+static bool writeFileBlocking(const WriteJob& job) {
+    std::ofstream file(job.path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file.write(job.data.data(), static_cast<std::streamsize>(job.data.size()));
+    if (!file) return false;
+    file.close();
+    std::error_code ec;
+    fs::permissions(job.path, static_cast<fs::perms>(job.mode), ec);
+    Stats::add(Counter::BytesWritten, job.data.size());
+    return true;
+}
+
+#ifdef VCS_HAVE_IO_URING
+
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency)
+class Ring {
+private:
+    int fd = -1;
+    unsigned entries = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    unsigned queued = 0; // SQEs filled but not yet submitted
+
+public:
+    bool init(unsigned depth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        if (fd < 0) return false;
+        entries = params.sq_entries;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMemory == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE});
+    }
+
+    // A kernel that can set up a ring may still reject some opcodes with -EINVAL on every request
+    bool supports(std::initializer_list<unsigned> opcodes) const {
+        std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        for (unsigned opcode : opcodes) {
+            if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+    }
+
+    unsigned capacity() const { return entries; }
+
+    // Next free SQE, zeroed; callers keep at most capacity() requests in flight
+    io_uring_sqe* next() {
+        unsigned tail = *sqTail + queued;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        queued++;
+        return sqe;
+    }
+
+    // Submits everything queued and waits for at least `waitFor` completions
+    bool submit(unsigned waitFor) {
+        __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+        unsigned toSubmit = queued;
+        queued = 0;
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret >= 0) return true;
+            if (errno != EINTR) return false;
+            toSubmit = 0;
+        }
+    }
+
+    // Queued requests the kernel has not taken yet; they never run if the ring is dropped
+    unsigned unsubmitted() const { return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE); }
+
+    // Waits for a completion without submitting anything
+    bool wait() {
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (ret >= 0) return true;
+            if (errno != EINTR) return false;
+        }
+    }
+
+    template <typename Handler>
+    unsigned drain(Handler&& handler) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            handler(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+};
+
+// One ring per thread, created on first use; null means "use blocking I/O"
+static thread_local std::unique_ptr<Ring> ring;
+static thread_local bool ringAttempted = false;
+
+static Ring* threadRing() {
+    if (!ringAttempted) {
+        ringAttempted = true;
+        if (!std::getenv("VCS_NO_IO_URING")) {
+            auto candidate = std::make_unique<Ring>();
+            if (candidate->init(IoEngine::queueDepth)) ring = std::move(candidate);
+        }
+    }
+    return ring.get();
+}
+
+// After a failed submit the ring may still hold requests from the abandoned batch, whose
+// completions would be mistaken for the next batch's; this thread goes on with blocking I/O
+static void dropThreadRing() {
+    ring.reset();
+}
+
+enum Operation : uint64_t { OpOpen = 0, OpStat = 1, OpIo = 2, OpClose = 3 };
+
+static uint64_t tag(size_t index, Operation op) { return (static_cast<uint64_t>(index) << 2) | op; }
+
+// Runs the ring until `outstanding` reaches zero, dispatching every completion to handler.
+// If submitting fails, it still waits for every request the kernel already took, so nothing
+// writes into the caller's buffers after it returns; the caller must then drop the ring.
+template <typename Handler>
+static bool runRing(Ring& ring, unsigned& outstanding, Handler&& handler) {
+    auto dispatch = [&](uint64_t userData, int res) {
+        handler(static_cast<size_t>(userData >> 2), static_cast<Operation>(userData & 3), res);
+    };
+    while (outstanding > 0) {
+        if (!ring.submit(1)) {
+            // Requests queued by the handlers below are never submitted, so they are not waited for
+            unsigned inFlight = outstanding - ring.unsubmitted();
+            for (int failures = 0; inFlight > 0 && failures < 100;) {
+                if (!ring.wait()) {
+                    ++failures;
+                    continue;
+                }
+                inFlight -= std::min(inFlight, ring.drain(dispatch));
+            }
+            return false;
+        }
+        outstanding -= ring.drain(dispatch);
+    }
+    return true;
+}
+
+static bool readBatch(Ring& ring, const std::vector<std::string>& paths, size_t begin, size_t end,
+                      const std::function<void(size_t, bool, std::string&, uint32_t)>& onFile) {
+    struct Slot {
+        int fd = -1;
+        bool statOk = false;
+        struct statx info;
+        std::string data;
+        size_t done = 0;
+    };
+    std::vector<Slot> slots(end - begin);
+    unsigned outstanding = 0;
+
+    // Phase 1: open and statx every file of the batch at once
+    for (size_t i = begin; i < end; ++i) {
+        io_uring_sqe* open = ring.next();
+        open->opcode = IORING_OP_OPENAT;
+        open->fd = AT_FDCWD;
+        open->addr = reinterpret_cast<uint64_t>(paths[i].c_str());
+        open->open_flags = O_RDONLY | O_CLOEXEC;
+        open->user_data = tag(i - begin, OpOpen);
+
+        io_uring_sqe* stat = ring.next();
+        stat->opcode = IORING_OP_STATX;
+        stat->fd = AT_FDCWD;
+        stat->addr = reinterpret_cast<uint64_t>(paths[i].c_str());
+        stat->len = STATX_SIZE | STATX_MODE;
+        stat->off = reinterpret_cast<uint64_t>(&slots[i - begin].info);
+        stat->user_data = tag(i - begin, OpStat);
+        outstanding += 2;
+    }
+    // Descriptors the ring opened but did not get to close
+    auto closeLeftovers = [&]() {
+        for (Slot& s : slots) {
+            if (s.fd >= 0) close(s.fd);
+        }
+        return false;
+    };
+    bool ok = runRing(ring, outstanding, [&](size_t slot, Operation op, int res) {
+        if (op == OpOpen) {
+            slots[slot].fd = res;
+        } else {
+            Stats::add(Counter::FilesStatted);
+            slots[slot].statOk = res >= 0;
+        }
+    });
+    if (!ok) return closeLeftovers();
+
+    // Phase 2: one read per file (re-queued on short reads), then its close, as completions arrive
+    auto queueRead = [&](size_t slot) {
+        Slot& s = slots[slot];
+        io_uring_sqe* read = ring.next();
+        read->opcode = IORING_OP_READ;
+        read->fd = s.fd;
+        read->addr = reinterpret_cast<uint64_t>(s.data.data() + s.done);
+        read->len = static_cast<uint32_t>(std::min<size_t>(s.data.size() - s.done, 1U << 30));
+        read->off = s.done;
+        read->user_data = tag(slot, OpIo);
+        outstanding++;
+    };
+    auto queueClose = [&](size_t slot) {
+        io_uring_sqe* close = ring.next();
+        close->opcode = IORING_OP_CLOSE;
+        close->fd = slots[slot].fd;
+        close->user_data = tag(slot, OpClose);
+        outstanding++;
+    };
+    auto finish = [&](size_t slot, bool success) {
+        Slot& s = slots[slot];
+        s.data.resize(s.done);
+        uint32_t mode = s.statOk ? (s.info.stx_mode & 07777) : 0644;
+        onFile(begin + slot, success, s.data, mode);
+        std::string().swap(s.data); // Release the buffer as soon as it has been consumed
+        if (s.fd >= 0) queueClose(slot);
+    };
+
+    for (size_t slot = 0; slot < slots.size(); ++slot) {
+        Slot& s = slots[slot];
+        if (s.fd < 0 || !s.statOk) {
+            finish(slot, false);
+        } else if (s.info.stx_size == 0) {
+            finish(slot, true);
+        } else {
+            s.data.resize(s.info.stx_size);
+            queueRead(slot);
+        }
+    }
+    ok = runRing(ring, outstanding, [&](size_t slot, Operation op, int res) {
+        if (op == OpClose) {
+            slots[slot].fd = -1;
+            return;
+        }
+        if (op != OpIo) return;
+        Slot& s = slots[slot];
+        if (res < 0) {
+            finish(slot, false);
+            return;
+        }
+        s.done += static_cast<size_t>(res);
+        if (res == 0 || s.done == s.data.size()) {
+            finish(slot, true);
+        } else {
+            queueRead(slot);
+        }
+    });
+    return ok || closeLeftovers();
+}
+
+// Adds the jobs whose write failed to `failed`; `ringFailed` says the ring itself broke and the
+// batch must be redone
+static void writeBatch(Ring& ring, const std::vector<WriteJob>& jobs, size_t begin, size_t end,
+                       std::vector<size_t>& failed, bool& ringFailed) {
+    std::vector<int> fds(end - begin, -1);
+    std::vector<size_t> done(end - begin, 0);
+    std::vector<uint8_t> ok(end - begin, 1);
+    unsigned outstanding = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        io_uring_sqe* open = ring.next();
+        open->opcode = IORING_OP_OPENAT;
+        open->fd = AT_FDCWD;
+        open->addr = reinterpret_cast<uint64_t>(jobs[i].path.c_str());
+        open->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        open->len = jobs[i].mode;
+        open->user_data = tag(i - begin, OpOpen);
+        outstanding++;
+    }
+    auto closeLeftovers = [&]() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+        ringFailed = true;
+    };
+    if (!runRing(ring, outstanding, [&](size_t slot, Operation, int res) {
+            if (res < 0) {
+                ok[slot] = 0;
+                return;
+            }
+            // O_CREAT's mode is masked and ignored for existing files; match the blocking path
+            fds[slot] = res;
+            fchmod(res, jobs[begin + slot].mode);
+        })) {
+        closeLeftovers();
+        return;
+    }
+
+    auto queueWrite = [&](size_t slot) {
+        const WriteJob& job = jobs[begin + slot];
+        io_uring_sqe* write = ring.next();
+        write->opcode = IORING_OP_WRITE;
+        write->fd = fds[slot];
+        write->addr = reinterpret_cast<uint64_t>(job.data.data() + done[slot]);
+        write->len = static_cast<uint32_t>(std::min<size_t>(job.data.size() - done[slot], 1U << 30));
+        write->off = done[slot];
+        write->user_data = tag(slot, OpIo);
+        outstanding++;
+    };
+    auto queueClose = [&](size_t slot) {
+        io_uring_sqe* close = ring.next();
+        close->opcode = IORING_OP_CLOSE;
+        close->fd = fds[slot];
+        close->user_data = tag(slot, OpClose);
+        outstanding++;
+    };
+
+    for (size_t slot = 0; slot < fds.size(); ++slot) {
+        if (fds[slot] < 0) continue;
+        if (jobs[begin + slot].data.empty()) queueClose(slot);
+        else queueWrite(slot);
+    }
+    bool ringOk = runRing(ring, outstanding, [&](size_t slot, Operation op, int res) {
+        if (op == OpClose) {
+            if (res < 0) ok[slot] = 0;
+            fds[slot] = -1;
+            return;
+        }
+        if (res <= 0) {
+            ok[slot] = 0;
+            queueClose(slot);
+            return;
+        }
+        done[slot] += static_cast<size_t>(res);
+        Stats::add(Counter::BytesWritten, static_cast<uint64_t>(res));
+        if (done[slot] == jobs[begin + slot].data.size()) queueClose(slot);
+        else queueWrite(slot);
+    });
+    if (!ringOk) {
+        closeLeftovers();
+        return;
+    }
+    for (size_t slot = 0; slot < ok.size(); ++slot) {
+        if (!ok[slot]) failed.push_back(begin + slot);
+    }
+}
+
+#endif // VCS_HAVE_IO_URING
+
+bool IoEngine::usingIoUring() {
+#ifdef VCS_HAVE_IO_URING
+    return threadRing() != nullptr;
+#else
+    return false;
+#endif
+}
+
+void IoEngine::readFiles(const std::vector<std::string>& paths,
+                         const std::function<void(size_t, bool, std::string&, uint32_t)>& onFile) {
+    VCS_TRACE_SCOPE("IoEngine::readFiles");
+#ifdef VCS_HAVE_IO_URING
+    if (Ring* ring = threadRing()) {
+        std::vector<uint8_t> delivered(paths.size(), 0);
+        auto deliver = [&](size_t index, bool ok, std::string& data, uint32_t mode) {
+            delivered[index] = 1;
+            // A file the ring could not read gets a second chance, so only a really unreadable one fails
+            if (ok) onFile(index, ok, data, mode);
+            else readFileBlocking(paths[index], index, onFile);
+        };
+
+        // Two SQEs per file in the open/statx phase, so a batch is half the ring
+        size_t batch = ring->capacity() / 2;
+        for (size_t begin = 0; begin < paths.size(); begin += batch) {
+            size_t end = std::min(paths.size(), begin + batch);
+            if (!readBatch(*ring, paths, begin, end, deliver)) {
+                // The ring itself failed mid-batch; finish whatever is left without it
+                dropThreadRing();
+                for (size_t i = begin; i < paths.size(); ++i) {
+                    if (!delivered[i]) readFileBlocking(paths[i], i, onFile);
+                }
+                return;
+            }
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < paths.size(); ++i) {
+        readFileBlocking(paths[i], i, onFile);
+    }
+}
+
+bool IoEngine::writeFiles(const std::vector<WriteJob>& jobs) {
+    VCS_TRACE_SCOPE("IoEngine::writeFiles");
+    bool success = true;
+#ifdef VCS_HAVE_IO_URING
+    if (Ring* ring = threadRing()) {
+        size_t batch = ring->capacity();
+        for (size_t begin = 0; begin < jobs.size(); begin += batch) {
+            size_t end = std::min(jobs.size(), begin + batch);
+            std::vector<size_t> failed;
+            bool ringFailed = false;
+            writeBatch(*ring, jobs, begin, end, failed, ringFailed);
+            if (ringFailed) {
+                // Redo this batch and write the rest without the ring
+                dropThreadRing();
+                for (size_t i = begin; i < jobs.size(); ++i) {
+                    if (!writeFileBlocking(jobs[i])) success = false;
+                }
+                return success;
+            }
+            // As with reads, a failed write is retried without the ring before it counts
+            for (size_t i : failed) {
+                if (!writeFileBlocking(jobs[i])) success = false;
+            }
+        }
+        return success;
+    }
+#endif
+    for (const auto& job : jobs) {
+        if (!writeFileBlocking(job)) success = false;
+    }
+    return success;
+}
@@ -1,78 +1,208 @@
 #include "../include/MergeHandler.h"
-#include "../include/FileSystem.h"
-#include "../include/Utilities.h"
+#include "../include/Repository.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 using namespace std;
-// Find the common ancestor commit between two branches
-std::string MergeHandler::findCommonAncestor(const std::string& branch1, const std::string& branch2) {
-    // Load commit timelines for both branches
-    std::string branch1Path = ".vcs/branches/" + branch1 + ".json";
-    std::string branch2Path = ".vcs/branches/" + branch2 + ".json";
-
-    cout<<branch1Path<<endl<<branch2Path<<endl;
-    if (!FileSystem::fileExists(branch1Path) || !FileSystem::fileExists(branch2Path)) {
-        std::cerr << "Error: One or both branches do not exist!" << std::endl;
-        return "";
+
+// Every commit reachable from `start` through any parent, `start` included
+static std::unordered_set<std::string> ancestors(Repository& repository, const std::string& start) {
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> stack = {start};
+    while (!stack.empty()) {
+        std::string commitId = std::move(stack.back());
+        stack.pop_back();
+        if (!seen.insert(commitId).second) continue;
+        if (auto commit = repository.commit(commitId)) {
+            stack.insert(stack.end(), commit->parents.begin(), commit->parents.end());
+        }
     }
+    return seen;
+}
 
-    auto branch1Data = nlohmann::json::parse(FileSystem::readFile(branch1Path));
-    auto branch2Data = nlohmann::json::parse(FileSystem::readFile(branch2Path));
+std::string MergeHandler::mergeBase(const std::string& ours, const std::string& theirs) {
+    VCS_TRACE_SCOPE("MergeHandler::mergeBase");
+    if (ours.empty() || theirs.empty()) return "";
+    Repository& repository = Repository::active();
+    std::unordered_set<std::string> reachableFromOurs = ancestors(repository, ours);
 
-    const std::vector<std::string>& commits1 = branch1Data["commits"];
-    const std::vector<std::string>& commits2 = branch2Data["commits"];
+    // Breadth-first from theirs; each path stops at the first commit ours can also reach
+    std::vector<std::string> candidates;
+    std::unordered_set<std::string> visited = {theirs};
+    std::deque<std::string> queue = {theirs};
+    while (!queue.empty()) {
+        std::string commitId = std::move(queue.front());
+        queue.pop_front();
+        if (reachableFromOurs.count(commitId)) {
+            candidates.push_back(commitId);
+            continue;
+        }
+        if (auto commit = repository.commit(commitId)) {
+            for (const auto& parent : commit->parents) {
+                if (visited.insert(parent).second) queue.push_back(parent);
+            }
+        }
+    }
 
-    // Find the last common commit in the two histories
-    for (auto it1 = commits1.rbegin(); it1 != commits1.rend(); ++it1) {
-        for (auto it2 = commits2.rbegin(); it2 != commits2.rend(); ++it2) {
-            if (*it1 == *it2) {
-                return *it1;
+    // Criss-cross histories can give several; one that is an ancestor of another is not the best
+    for (const auto& candidate : candidates) {
+        bool redundant = false;
+        for (const auto& other : candidates) {
+            if (other != candidate && ancestors(repository, other).count(candidate)) {
+                redundant = true;
+                break;
             }
         }
+        if (!redundant) return candidate;
     }
+    return "";
+}
 
-    return ""; // No common ancestor found
+std::string MergeHandler::findCommonAncestor(const std::string& branch1, const std::string& branch2) {
+    Repository& repository = Repository::active();
+    return mergeBase(repository.branchHead(branch1), repository.branchHead(branch2));
 }
 
-// Perform a three-way merge between base, branch1, and branch2 JSON trees
-nlohmann::json MergeHandler::threeWayMerge(
-    const nlohmann::json& base, 
-    const nlohmann::json& branch1, 
-    const nlohmann::json& branch2
-) {
-    nlohmann::json merged = base;
-
-    for (const auto& [key, baseValue] : base.items()) {
-        const auto& branch1Value = branch1.contains(key) ? branch1[key] : nlohmann::json();
-        const auto& branch2Value = branch2.contains(key) ? branch2[key] : nlohmann::json();
-
-        if (branch1Value == branch2Value) {
-            // No conflict, use branch1 (or branch2 since they're identical)
-            merged[key] = branch1Value;
-        } else if (branch1Value != baseValue && branch2Value == baseValue) {
-            // Change only in branch1
-            merged[key] = branch1Value;
-        } else if (branch2Value != baseValue && branch1Value == baseValue) {
-            // Change only in branch2
-            merged[key] = branch2Value;
+TreeMergeResult MergeHandler::mergeTrees(const Tree& base, const Tree& ours, const Tree& theirs) {
+    VCS_TRACE_SCOPE("MergeHandler::mergeTrees");
+    TreeMergeResult result;
+
+    // A missing entry is a null digest pointer; two missing entries compare equal
+    auto same = [](const Digest* a, const Digest* b) {
+        return a == b || (a && b && *a == *b);
+    };
+    auto orNull = [](const Digest* digest) { return digest ? *digest : Digest{}; };
+
+    auto b = base.begin(), o = ours.begin(), t = theirs.begin();
+    while (b != base.end() || o != ours.end() || t != theirs.end()) {
+        // The smallest path at the three cursors; every tree holding it advances past it
+        std::string_view path;
+        bool found = false;
+        auto consider = [&](const Tree::const_iterator& cursor, const Tree& tree) {
+            if (cursor != tree.end() && (!found || (*cursor).path < path)) {
+                path = (*cursor).path;
+                found = true;
+            }
+        };
+        consider(b, base);
+        consider(o, ours);
+        consider(t, theirs);
+        const Digest* baseDigest = b != base.end() && (*b).path == path ? &(*b).digest : nullptr;
+        const Digest* ourDigest = o != ours.end() && (*o).path == path ? &(*o).digest : nullptr;
+        const Digest* theirDigest = t != theirs.end() && (*t).path == path ? &(*t).digest : nullptr;
+
+        const Digest* chosen;
+        MergeEntry entry{std::string(path), MergeAction::Unchanged, MergeSide::Both,
+                         orNull(baseDigest), orNull(ourDigest), orNull(theirDigest), ""};
+        const Digest* changed = nullptr; // The version the merge takes when exactly one story applies
+        if (same(ourDigest, theirDigest)) {
+            chosen = ourDigest;
+            entry.side = MergeSide::Both;
+            if (!same(baseDigest, ourDigest)) changed = ourDigest;
+        } else if (same(ourDigest, baseDigest)) {
+            chosen = changed = theirDigest;
+            entry.side = MergeSide::Theirs;
+        } else if (same(theirDigest, baseDigest)) {
+            chosen = changed = ourDigest;
+            entry.side = MergeSide::Ours;
         } else {
-            // Conflict: use branch1's value, but could prompt the user to resolve manually
-            std::cerr << "Conflict detected for key: " << key << std::endl;
-            merged[key] = branch1Value; // Default to branch1
+            chosen = ourDigest;
+            entry.side = MergeSide::Ours;
+            entry.action = MergeAction::Conflict;
+            ++result.conflicts;
         }
+        if (entry.action != MergeAction::Conflict && !same(baseDigest, chosen)) {
+            entry.action = !baseDigest ? MergeAction::Added : !changed ? MergeAction::Deleted : MergeAction::Modified;
+        }
+        if (chosen) result.tree.insert(path, *chosen); // Input order is sorted, so no re-sort needed
+        if (entry.action != MergeAction::Unchanged) result.changes.push_back(std::move(entry));
+
+        if (baseDigest) ++b;
+        if (ourDigest) ++o;
+        if (theirDigest) ++t;
     }
+    result.tree.finalize();
+    return result;
+}
 
-    // Handle keys added in branch1 or branch2 but missing in base
-    for (const auto& [key, value] : branch1.items()) {
-        if (!base.contains(key)) {
-            merged[key] = value;
-        }
+// The tree with each path in `moves` stored under its new name
+static Tree applyMoves(const Tree& tree, const std::unordered_map<std::string, std::string>& moves) {
+    if (moves.empty()) return tree;
+    Tree moved;
+    for (const auto& [path, digest] : tree) {
+        auto it = moves.find(std::string(path));
+        moved.insert(it == moves.end() ? path : std::string_view(it->second), digest);
     }
+    moved.finalize();
+    return moved;
+}
+
+TreeMergeResult MergeHandler::mergeTreesFollowingRenames(const Tree& base, const Tree& ours, const Tree& theirs,
+                                                         std::vector<Rename>& followed) {
+    VCS_TRACE_SCOPE("MergeHandler::mergeTreesFollowingRenames");
+    followed.clear();
+    std::unordered_map<std::string, std::string> baseMoves, ourMoves, theirMoves;
 
-    for (const auto& [key, value] : branch2.items()) {
-        if (!base.contains(key) && !branch1.contains(key)) {
-            merged[key] = value;
+    std::vector<Rename> ourRenames = RenameDetector::detect(base, ours);
+    std::vector<Rename> theirRenames = RenameDetector::detect(base, theirs);
+
+    // A rename on one side is carried over to the base and the other side, provided the other
+    // side still has the old path and has not put anything at the new one
+    auto follow = [&](const std::vector<Rename>& renames, const Tree& otherSide,
+                      std::unordered_map<std::string, std::string>& otherMoves) {
+        for (const auto& rename : renames) {
+            if (rename.copy || !otherSide.contains(rename.from) || otherSide.contains(rename.to) ||
+                baseMoves.count(rename.from)) {
+                continue;
+            }
+            baseMoves[rename.from] = rename.to;
+            otherMoves[rename.from] = rename.to;
+            followed.push_back(rename);
         }
+    };
+    follow(ourRenames, theirs, theirMoves);
+    follow(theirRenames, ours, ourMoves);
+
+    TreeMergeResult result = mergeTrees(applyMoves(base, baseMoves), applyMoves(ours, ourMoves), applyMoves(theirs, theirMoves));
+
+    // Both sides moved the same file to different names: the join alone would see a deletion and
+    // two unrelated additions and keep both copies, so both new paths are conflicts instead
+    std::unordered_map<std::string, std::string> theirTargets;
+    for (const auto& rename : theirRenames) {
+        if (!rename.copy) theirTargets[rename.from] = rename.to;
     }
+    auto markConflict = [&](const std::string& path, const std::string& from) {
+        auto it = std::lower_bound(result.changes.begin(), result.changes.end(), path,
+                                   [](const MergeEntry& entry, const std::string& key) { return entry.path < key; });
+        if (it == result.changes.end() || it->path != path || it->action == MergeAction::Conflict) return;
+        it->action = MergeAction::Conflict;
+        it->renamedFrom = from;
+        ++result.conflicts;
+    };
+    for (const auto& rename : ourRenames) {
+        auto their = theirTargets.find(rename.from);
+        if (rename.copy || their == theirTargets.end() || their->second == rename.to) continue;
+        markConflict(rename.to, rename.from);
+        markConflict(their->second, rename.from);
+    }
+    return result;
+}
 
-    return merged;
+// Perform a three-way merge between base, branch1, and branch2 trees
+Tree MergeHandler::threeWayMerge(
+    const Tree& base, 
+    const Tree& branch1, 
+    const Tree& branch2
+) {
+    TreeMergeResult result = mergeTrees(base, branch1, branch2);
+    for (const auto& change : result.changes) {
+        if (change.action == MergeAction::Conflict) {
+            // Conflict: branch1's value is kept, but could prompt the user to resolve manually
+            std::cerr << "Conflict detected for key: " << change.path << std::endl;
+        }
+    }
+    return result.tree;
 }
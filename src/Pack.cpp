@@ -0,0 +1,405 @@
+#include "../include/Pack.h"
+#include "../include/BlobStore.h"
+#include "../include/FileSystem.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include "../picosha2.h"
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char magic[8] = {'V', 'C', 'S', 'P', 'A', 'C', 'K', '1'};
+constexpr size_t blockSize = 1 << 20;
+
+// Everything written goes through the running checksum that ends the pack
+struct PackWriter {
+    std::ostream& out;
+    picosha2::hash256_one_by_one hasher;
+    uint64_t bytes = 0;
+
+    explicit PackWriter(std::ostream& out) : out(out) {}
+
+    void put(const void* data, size_t length) {
+        const char* begin = static_cast<const char*>(data);
+        out.write(begin, static_cast<std::streamsize>(length));
+        hasher.process(begin, begin + length);
+        bytes += length;
+    }
+    void putByte(char value) { put(&value, 1); }
+    void putU64(uint64_t value) {
+        unsigned char encoded[8];
+        for (int i = 0; i < 8; ++i) encoded[i] = static_cast<unsigned char>(value >> (8 * i));
+        put(encoded, sizeof(encoded));
+    }
+    void putString(const std::string& value) {
+        putU64(value.size());
+        put(value.data(), value.size());
+    }
+    void putDigest(const Digest& digest) { put(digest.bytes.data(), Digest::size); }
+    // Streams a file as <u64 size> <bytes>; false if it cannot be read or changes size meanwhile
+    bool putFile(const std::string& path, std::string& error) {
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        std::ifstream file(path, std::ios::binary);
+        if (ec || !file) {
+            error = "cannot read " + path;
+            return false;
+        }
+        putU64(size);
+        std::vector<char> buffer(blockSize);
+        uint64_t remaining = size;
+        while (remaining > 0) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if (!file.read(buffer.data(), static_cast<std::streamsize>(want))) {
+                error = path + " changed while it was being packed";
+                return false;
+            }
+            put(buffer.data(), want);
+            if (!out) {
+                error = "cannot write the pack";
+                return false;
+            }
+            remaining -= want;
+        }
+        return true;
+    }
+};
+
+struct PackReader {
+    std::istream& in;
+    picosha2::hash256_one_by_one hasher;
+    uint64_t bytes = 0;
+
+    explicit PackReader(std::istream& in) : in(in) {}
+
+    bool get(void* data, size_t length) {
+        char* begin = static_cast<char*>(data);
+        if (!in.read(begin, static_cast<std::streamsize>(length))) return false;
+        hasher.process(begin, begin + length);
+        bytes += length;
+        return true;
+    }
+    bool getU64(uint64_t& value) {
+        unsigned char encoded[8];
+        if (!get(encoded, sizeof(encoded))) return false;
+        value = 0;
+        for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(encoded[i]) << (8 * i);
+        return true;
+    }
+    bool getString(std::string& value, uint64_t limit = uint64_t(1) << 30) {
+        uint64_t length;
+        if (!getU64(length) || length > limit) return false;
+        value.resize(static_cast<size_t>(length));
+        return get(value.data(), value.size());
+    }
+    bool getDigest(Digest& digest) { return get(digest.bytes.data(), Digest::size); }
+    // Reads <u64 size> <bytes> into `path` (or nowhere if empty), returning the bytes' digest
+    bool getFile(const std::string& path, Digest& digest, std::string& error) {
+        uint64_t size;
+        if (!getU64(size)) return false;
+        std::ofstream file;
+        if (!path.empty()) {
+            file.open(path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                error = "cannot write " + path;
+                return false;
+            }
+        }
+        picosha2::hash256_one_by_one content;
+        std::vector<char> buffer(blockSize);
+        while (size > 0) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+            if (!get(buffer.data(), want)) return false;
+            content.process(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(want));
+            if (file.is_open()) file.write(buffer.data(), static_cast<std::streamsize>(want));
+            size -= want;
+        }
+        content.finish();
+        content.get_hash_bytes(digest.bytes.begin(), digest.bytes.end());
+        if (file.is_open() && !file.flush()) {
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+    }
+};
+
+std::string under(const std::string& root, const std::string& relativePath) {
+    return (fs::path(root) / relativePath).string();
+}
+
+// Names that come out of a pack become file names below `.vcs/`
+bool safeName(const std::string& name) {
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string::npos &&
+           name.find('\\') == std::string::npos && name != "hash.json" && name != "chunks.json";
+}
+
+// Branch names become `.vcs/branches/<name>.json`; a head, if set, must name a commit
+bool validRefs(const nlohmann::json& refs, std::string& error) {
+    if (!refs.is_object()) {
+        error = "the pack's refs are not an object";
+        return false;
+    }
+    for (const auto& [name, ref] : refs.items()) {
+        if (!safeName(name)) {
+            error = "invalid branch name '" + name + "' in the pack";
+            return false;
+        }
+        bool valid = ref.is_object();
+        if (valid && ref.contains("head")) {
+            const nlohmann::json& head = ref["head"];
+            valid = head.is_string() && (head.get_ref<const std::string&>().empty() ||
+                                         safeName(head.get_ref<const std::string&>()));
+        }
+        if (!valid) {
+            error = "branch '" + name + "' in the pack is malformed";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool Pack::write(std::ostream& out, const std::string& sourceRoot, const nlohmann::json& refs,
+                 const std::vector<std::string>& commits, const std::vector<Digest>& objects,
+                 const std::function<bool(const Digest&)>& skipChunk, PackSummary& summary, std::string& error) {
+    VCS_TRACE_SCOPE("Pack::write");
+    summary = PackSummary{};
+    PackWriter writer(out);
+    writer.put(magic, sizeof(magic));
+    writer.putByte('H');
+    writer.putString(nlohmann::json{{"refs", refs}}.dump());
+
+    std::unordered_set<Digest> sentChunks;
+    for (const auto& digest : objects) {
+        std::string folder = under(sourceRoot, BlobStore::objectPath(digest));
+        std::string hashJson = FileSystem::readFile(folder + "/hash.json");
+        if (hashJson.empty()) {
+            error = "object " + digest.hex() + " is missing from " + sourceRoot;
+            return false;
+        }
+        if (BlobStore::isChunked(folder)) {
+            std::string manifestText = FileSystem::readFile(folder + "/chunks.json");
+            nlohmann::json manifest = nlohmann::json::parse(manifestText);
+            for (const auto& chunk : manifest["chunks"]) {
+                Digest chunkDigest = chunk["hash"].get<Digest>();
+                if (skipChunk(chunkDigest) || !sentChunks.insert(chunkDigest).second) continue;
+                writer.putByte('K');
+                writer.putDigest(chunkDigest);
+                if (!writer.putFile(under(sourceRoot, BlobStore::chunkPath(chunkDigest)), error)) return false;
+                ++summary.chunks;
+            }
+            writer.putByte('M');
+            writer.putDigest(digest);
+            writer.putString(hashJson);
+            writer.putString(manifestText);
+        } else {
+            std::string contentPath = BlobStore::contentPath(folder);
+            if (contentPath.empty()) {
+                error = "object " + digest.hex() + " has no content in " + sourceRoot;
+                return false;
+            }
+            writer.putByte('O');
+            writer.putDigest(digest);
+            writer.putString(fs::path(contentPath).filename().string());
+            writer.putString(hashJson);
+            if (!writer.putFile(contentPath, error)) return false;
+        }
+        ++summary.objects;
+    }
+
+    for (const auto& commitId : commits) {
+        std::string commitText = FileSystem::readFile(under(sourceRoot, ".vcs/commits/" + commitId + ".json"));
+        if (commitText.empty()) {
+            error = "commit " + commitId + " is missing from " + sourceRoot;
+            return false;
+        }
+        writer.putByte('C');
+        writer.putString(commitId);
+        writer.putString(commitText);
+        ++summary.commits;
+    }
+
+    writer.putByte('E');
+    writer.hasher.finish();
+    Digest checksum;
+    writer.hasher.get_hash_bytes(checksum.bytes.begin(), checksum.bytes.end());
+    out.write(reinterpret_cast<const char*>(checksum.bytes.data()), Digest::size);
+    summary.bytes = writer.bytes + Digest::size;
+    Stats::add(Counter::BytesWritten, summary.bytes);
+    if (!out.flush()) {
+        error = "cannot write the pack";
+        return false;
+    }
+    return true;
+}
+
+bool Pack::read(std::istream& in, const std::string& targetRoot, nlohmann::json& refs, PackSummary& summary,
+                std::string& error) {
+    VCS_TRACE_SCOPE("Pack::read");
+    summary = PackSummary{};
+    refs = nlohmann::json::object();
+    PackReader reader(in);
+    char header[sizeof(magic)];
+    if (!reader.get(header, sizeof(header)) || !std::equal(header, header + sizeof(header), magic)) {
+        error = "not a pack";
+        return false;
+    }
+
+    auto truncated = [&]() {
+        if (error.empty()) error = "the pack is truncated or malformed";
+        return false;
+    };
+    std::vector<std::pair<std::string, std::string>> commits; // Held back until the checksum matches
+    for (;;) {
+        char type;
+        if (!reader.get(&type, 1)) return truncated();
+
+        if (type == 'H') {
+            std::string text;
+            if (!reader.getString(text)) return truncated();
+            nlohmann::json header = nlohmann::json::parse(text, nullptr, false);
+            if (!header.is_object()) return truncated();
+            refs = header.value("refs", nlohmann::json::object());
+            // Checked before anything else in the pack is written
+            if (!validRefs(refs, error)) return false;
+        } else if (type == 'K') {
+            Digest digest, actual;
+            if (!reader.getDigest(digest)) return truncated();
+            std::string path = under(targetRoot, BlobStore::chunkPath(digest));
+            bool have = FileSystem::fileExists(path);
+            std::string tempPath = have ? "" : path + ".incoming";
+            if (!have) FileSystem::createDirectory(fs::path(path).parent_path().string());
+            if (!reader.getFile(tempPath, actual, error)) return truncated();
+            if (actual != digest) {
+                std::error_code ec;
+                if (!have) fs::remove(tempPath, ec);
+                error = "chunk " + digest.hex() + " does not match its digest";
+                return false;
+            }
+            std::error_code ec;
+            if (!have) fs::rename(tempPath, path, ec);
+            if (ec) {
+                error = "cannot write " + path;
+                return false;
+            }
+            ++summary.chunks;
+        } else if (type == 'O') {
+            Digest digest, actual;
+            std::string name, hashJson;
+            if (!reader.getDigest(digest) || !reader.getString(name) || !reader.getString(hashJson)) return truncated();
+            // hash.json is written last: an object folder without one is incomplete and gets redone
+            std::string folder = under(targetRoot, BlobStore::objectPath(digest));
+            bool have = FileSystem::fileExists(folder + "/hash.json");
+            if (!have) FileSystem::createDirectory(folder);
+            if (!reader.getFile(have ? "" : folder + "/blob", actual, error)) return truncated();
+            if (actual != digest) {
+                std::error_code ec;
+                if (!have) fs::remove_all(folder, ec);
+                error = "object " + digest.hex() + " does not match its digest";
+                return false;
+            }
+            if (!have && !FileSystem::writeFile(folder + "/hash.json", hashJson)) {
+                error = "cannot write " + folder;
+                return false;
+            }
+            ++summary.objects;
+        } else if (type == 'M') {
+            Digest digest;
+            std::string hashJson, manifestText;
+            if (!reader.getDigest(digest) || !reader.getString(hashJson) || !reader.getString(manifestText)) {
+                return truncated();
+            }
+            std::string folder = under(targetRoot, BlobStore::objectPath(digest));
+            if (!FileSystem::fileExists(folder + "/hash.json")) {
+                nlohmann::json manifest = nlohmann::json::parse(manifestText, nullptr, false);
+                if (manifest.is_discarded() || !manifest.contains("chunks") || !manifest["chunks"].is_array()) {
+                    return truncated();
+                }
+                // Each chunk matched its own digest, but only the chunks in manifest order prove the object
+                picosha2::hash256_one_by_one content;
+                std::vector<char> buffer(blockSize);
+                for (const auto& chunk : manifest["chunks"]) {
+                    Digest chunkDigest;
+                    if (!chunk.is_object() || !chunk.contains("hash") || !chunk["hash"].is_string() ||
+                        !Digest::fromHex(chunk["hash"].get_ref<const std::string&>(), chunkDigest)) {
+                        return truncated();
+                    }
+                    std::ifstream file(under(targetRoot, BlobStore::chunkPath(chunkDigest)), std::ios::binary);
+                    if (!file) {
+                        error = "object " + digest.hex() + " lists a chunk that was not sent";
+                        return false;
+                    }
+                    while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || file.gcount() > 0) {
+                        content.process(buffer.begin(), buffer.begin() + file.gcount());
+                    }
+                }
+                Digest actual;
+                content.finish();
+                content.get_hash_bytes(actual.bytes.begin(), actual.bytes.end());
+                if (actual != digest) {
+                    error = "object " + digest.hex() + " does not match its digest";
+                    return false;
+                }
+                FileSystem::createDirectory(folder);
+                if (!FileSystem::writeFile(folder + "/chunks.json", manifestText) ||
+                    !FileSystem::writeFile(folder + "/hash.json", hashJson)) {
+                    error = "cannot write " + folder;
+                    return false;
+                }
+            }
+            ++summary.objects;
+        } else if (type == 'C') {
+            std::string commitId, commitText;
+            if (!reader.getString(commitId) || !reader.getString(commitText)) return truncated();
+            if (!safeName(commitId)) {
+                error = "invalid commit ID in the pack";
+                return false;
+            }
+            commits.emplace_back(std::move(commitId), std::move(commitText));
+        } else if (type == 'E') {
+            break;
+        } else {
+            return truncated();
+        }
+    }
+
+    reader.hasher.finish();
+    Digest expected, actual;
+    reader.hasher.get_hash_bytes(expected.bytes.begin(), expected.bytes.end());
+    if (!in.read(reinterpret_cast<char*>(actual.bytes.data()), Digest::size)) return truncated();
+    if (actual != expected) {
+        error = "pack checksum mismatch";
+        return false;
+    }
+    summary.bytes = reader.bytes + Digest::size;
+
+    // Every head must arrive with the pack or already be here, or the refs would dangle
+    std::unordered_set<std::string> received;
+    for (const auto& commit : commits) received.insert(commit.first);
+    for (const auto& [name, ref] : refs.items()) {
+        std::string head = ref.value("head", "");
+        if (!head.empty() && !received.count(head) &&
+            !FileSystem::fileExists(under(targetRoot, ".vcs/commits/" + head + ".json"))) {
+            error = "branch '" + name + "' points to commit " + head + ", which is neither in the pack nor here";
+            return false;
+        }
+    }
+
+    FileSystem::createDirectory(under(targetRoot, ".vcs/commits"));
+    for (const auto& [commitId, commitText] : commits) {
+        std::string path = under(targetRoot, ".vcs/commits/" + commitId + ".json");
+        if (FileSystem::fileExists(path)) continue;
+        if (!FileSystem::writeFile(path, commitText)) {
+            error = "cannot write " + path;
+            return false;
+        }
+    }
+    summary.commits = commits.size();
+    return true;
+}
@@ -0,0 +1,206 @@
+#include "../include/ReachabilityIndex.h"
+#include "../include/FileSystem.h"
+#include "../include/Repository.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string positionsMagic = "VCSPOS1\n";
+const std::string bitmapMagic = "VCSEWAH1";
+
+} // namespace
+
+ReachabilityIndex::ReachabilityIndex(Repository& repository) : repository(repository) {
+    VCS_TRACE_SCOPE("ReachabilityIndex load");
+    std::string data;
+    {
+        std::ifstream file(repository.vcsPath("bitmaps/positions"), std::ios::binary);
+        if (file) data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    // Records: 'o' <32-byte digest> or 'c' <u8 length> <commit ID>. A torn last record (a crash
+    // mid-append) is ignored and overwritten by the next save.
+    if (data.compare(0, positionsMagic.size(), positionsMagic) == 0) {
+        size_t offset = positionsMagic.size();
+        while (offset < data.size()) {
+            Entry entry{};
+            if (data[offset] == 'o' && offset + 1 + Digest::size <= data.size()) {
+                entry.commit = false;
+                std::memcpy(entry.object.bytes.data(), data.data() + offset + 1, Digest::size);
+                offset += 1 + Digest::size;
+                objectPositions.emplace(entry.object, static_cast<uint32_t>(entries.size()));
+            } else if (data[offset] == 'c' && offset + 2 <= data.size() &&
+                       offset + 2 + static_cast<unsigned char>(data[offset + 1]) <= data.size()) {
+                size_t length = static_cast<unsigned char>(data[offset + 1]);
+                entry.commit = true;
+                entry.commitId = data.substr(offset + 2, length);
+                offset += 2 + length;
+                commitPositions.emplace(entry.commitId, static_cast<uint32_t>(entries.size()));
+            } else {
+                break;
+            }
+            entries.push_back(std::move(entry));
+            validBytes = offset;
+        }
+        validBytes = std::max<uint64_t>(validBytes, positionsMagic.size());
+    }
+    persisted = entries.size();
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(repository.vcsPath("bitmaps"), ec)) {
+        if (entry.path().extension() == ".ewah") bitmapCommits.insert(entry.path().stem().string());
+    }
+}
+
+uint32_t ReachabilityIndex::positionOf(const std::string& commitId) {
+    auto [it, added] = commitPositions.emplace(commitId, static_cast<uint32_t>(entries.size()));
+    if (added) entries.push_back(Entry{true, Digest{}, commitId});
+    return it->second;
+}
+
+uint32_t ReachabilityIndex::positionOf(const Digest& object) {
+    auto [it, added] = objectPositions.emplace(object, static_cast<uint32_t>(entries.size()));
+    if (added) entries.push_back(Entry{false, object, ""});
+    return it->second;
+}
+
+bool ReachabilityIndex::savePositions() {
+    if (persisted == entries.size()) return true;
+    std::string path = repository.vcsPath("bitmaps/positions");
+    FileSystem::createDirectory(repository.vcsPath("bitmaps"));
+    std::string records;
+    if (validBytes == 0) {
+        records = positionsMagic;
+    } else {
+        std::error_code ec;
+        fs::resize_file(path, validBytes, ec); // Drop a torn record before appending
+        if (ec) return false;
+    }
+    for (size_t i = persisted; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        if (entry.commit) {
+            records.push_back('c');
+            records.push_back(static_cast<char>(entry.commitId.size()));
+            records += entry.commitId;
+        } else {
+            records.push_back('o');
+            records.append(reinterpret_cast<const char*>(entry.object.bytes.data()), Digest::size);
+        }
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    if (!file || !file.write(records.data(), static_cast<std::streamsize>(records.size())) || !file.flush()) {
+        return false;
+    }
+    validBytes += records.size();
+    persisted = entries.size();
+    return true;
+}
+
+EwahBitmap ReachabilityIndex::reachable(const std::vector<std::string>& tips) {
+    VCS_TRACE_SCOPE("ReachabilityIndex::reachable");
+    std::vector<uint64_t> plain;
+    auto test = [&](uint32_t position) { return position / 64 < plain.size() && ((plain[position / 64] >> (position % 64)) & 1); };
+    auto set = [&](uint32_t position) {
+        if (position / 64 >= plain.size()) plain.resize(position / 64 + 1, 0);
+        plain[position / 64] |= uint64_t(1) << (position % 64);
+    };
+
+    std::unordered_set<std::string> visited;
+    std::deque<std::string> queue;
+    for (const auto& tip : tips) {
+        if (!tip.empty() && visited.insert(tip).second) queue.push_back(tip);
+    }
+    while (!queue.empty()) {
+        std::string commitId = std::move(queue.front());
+        queue.pop_front();
+        auto known = commitPositions.find(commitId);
+        if (known != commitPositions.end() && test(known->second)) continue; // Covered by a bitmap already
+
+        if (bitmapCommits.count(commitId)) {
+            auto cached = loaded.find(commitId);
+            if (cached == loaded.end()) {
+                std::string data = FileSystem::readFile(repository.vcsPath("bitmaps/" + commitId + ".ewah"));
+                EwahBitmap bitmap;
+                if (data.compare(0, bitmapMagic.size(), bitmapMagic) == 0 &&
+                    EwahBitmap::deserialize(data.substr(bitmapMagic.size()), bitmap) && bitmap.count() > 0) {
+                    cached = loaded.emplace(commitId, std::move(bitmap)).first;
+                }
+            }
+            if (cached != loaded.end()) {
+                cached->second.orInto(plain);
+                continue;
+            }
+            // Unreadable: fall through and walk it
+        }
+
+        auto commit = repository.commit(commitId);
+        if (!commit) continue;
+        set(positionOf(commitId));
+        for (const auto& entry : commit->tree) {
+            set(positionOf(entry.digest));
+        }
+        for (const auto& parent : commit->parents) {
+            if (visited.insert(parent).second) queue.push_back(parent);
+        }
+    }
+    return EwahBitmap::fromWords(plain);
+}
+
+std::vector<std::string> ReachabilityIndex::selectCommits(size_t spacing) {
+    VCS_TRACE_SCOPE("ReachabilityIndex::selectCommits");
+    std::vector<std::string> heads;
+    for (const auto& branch : repository.branches()) {
+        std::string head = repository.branchHead(branch);
+        if (!head.empty()) heads.push_back(head);
+    }
+
+    // Depth-first post-order: every commit comes after its parents
+    std::vector<std::string> order;
+    std::unordered_set<std::string> seen;
+    std::vector<std::pair<std::string, size_t>> stack; // (commit, next parent to visit)
+    for (const auto& head : heads) {
+        if (!seen.insert(head).second) continue;
+        stack.emplace_back(head, 0);
+        while (!stack.empty()) {
+            auto& [commitId, nextParent] = stack.back();
+            auto commit = repository.commit(commitId);
+            if (commit && nextParent < commit->parents.size()) {
+                const std::string& parent = commit->parents[nextParent++];
+                if (seen.insert(parent).second) stack.emplace_back(parent, 0);
+                continue;
+            }
+            if (commit) order.push_back(commitId);
+            stack.pop_back();
+        }
+    }
+
+    std::unordered_set<std::string> headSet(heads.begin(), heads.end());
+    std::vector<std::string> selected;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if ((spacing > 0 && (i + 1) % spacing == 0) || headSet.count(order[i])) selected.push_back(order[i]);
+    }
+    return selected;
+}
+
+size_t ReachabilityIndex::build(const std::vector<std::string>& commits) {
+    VCS_TRACE_SCOPE("ReachabilityIndex::build");
+    size_t written = 0;
+    for (const auto& commitId : commits) {
+        if (bitmapCommits.count(commitId) || !repository.commit(commitId)) continue;
+        EwahBitmap bitmap = reachable({commitId});
+        // Positions first: a bitmap must never refer to a position that is not on disk
+        if (!savePositions()) return written;
+        if (!FileSystem::replaceFile(repository.vcsPath("bitmaps/" + commitId + ".ewah"), bitmapMagic + bitmap.serialize())) {
+            return written;
+        }
+        bitmapCommits.insert(commitId);
+        loaded.emplace(commitId, std::move(bitmap));
+        ++written;
+    }
+    return written;
+}
@@ -0,0 +1,208 @@
+#include "../include/Refs.h"
+#include "../include/FileSystem.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#if __has_include(<sys/file.h>)
+#define VCS_HAVE_FLOCK 1
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+RepositoryLock::RepositoryLock(const std::string& vcsDirectory, Mode mode) {
+#ifdef VCS_HAVE_FLOCK
+    VCS_TRACE_SCOPE("RepositoryLock::acquire");
+    fd = open((vcsDirectory + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return; // Read-only media and the like: run unlocked rather than not at all
+    while (flock(fd, mode == Mode::Shared ? LOCK_SH : LOCK_EX) != 0 && errno == EINTR) {
+    }
+#else
+    (void)vcsDirectory;
+    (void)mode;
+#endif
+}
+
+RepositoryLock::RepositoryLock(const std::string& vcsDirectory, Mode mode, int timeoutMs) {
+#ifdef VCS_HAVE_FLOCK
+    VCS_TRACE_SCOPE("RepositoryLock::acquire");
+    fd = open((vcsDirectory + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (flock(fd, (mode == Mode::Shared ? LOCK_SH : LOCK_EX) | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK && errno != EINTR) return; // No flock support there: run unlocked, as above
+        if (std::chrono::steady_clock::now() >= deadline) {
+            held = false;
+            close(fd);
+            fd = -1;
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+#else
+    (void)vcsDirectory;
+    (void)mode;
+    (void)timeoutMs;
+#endif
+}
+
+RepositoryLock::~RepositoryLock() {
+#ifdef VCS_HAVE_FLOCK
+    if (fd >= 0) close(fd); // Closing drops the flock
+#endif
+}
+
+// Holds `<ref>.lock`, created exclusively; removed again unless it was renamed over the ref
+class RefLockFile {
+private:
+    std::string lockPath;
+    std::FILE* file = nullptr;
+
+public:
+    explicit RefLockFile(const std::string& refPath) : lockPath(refPath + ".lock") {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(Refs::lockTimeoutMs);
+        // "x": fail if the file exists (O_EXCL), so only one process can hold the lock
+        while (!(file = std::fopen(lockPath.c_str(), "wbx")) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    ~RefLockFile() {
+        if (file) {
+            std::fclose(file);
+            std::error_code ec;
+            fs::remove(lockPath, ec);
+        }
+    }
+
+    bool acquired() const { return file != nullptr; }
+
+    // Writes the new content and atomically replaces the ref with it
+    bool commit(const std::string& refPath, const nlohmann::json& value) {
+        std::string content = value.dump(4);
+        bool ok = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        Stats::add(Counter::JsonBytesSerialized, content.size());
+        Stats::add(Counter::BytesWritten, content.size());
+        std::error_code ec;
+        if (ok) fs::rename(lockPath, refPath, ec);
+        if (!ok || ec) {
+            fs::remove(lockPath, ec);
+            return false;
+        }
+        return true;
+    }
+};
+
+
+// Read the ref's head; "" when missing or headless
+static std::string currentHead(const nlohmann::json& value) {
+    return value.is_object() && value.contains("head") && value["head"].is_string() ? value["head"].get<std::string>() : "";
+}
+
+bool Refs::update(const std::string& refPath, const std::string& expectedHead,
+                  const std::function<void(nlohmann::json&)>& change, std::string& error) {
+    VCS_TRACE_SCOPE("Refs::update");
+    if (FileSystem::deferringWrites()) {
+        // Batch mode holds the repository lock throughout and writes refs at checkpoints,
+        // so the head check is all that is needed
+        nlohmann::json value = FileSystem::fileExists(refPath) ? FileSystem::readJson(refPath) : nlohmann::json::object();
+        if (currentHead(value) != expectedHead) {
+            error = refPath + " moved from '" + expectedHead + "' to '" + currentHead(value) + "' while this command was running";
+            return false;
+        }
+        change(value);
+        return FileSystem::writeJson(refPath, value);
+    }
+
+    RefLockFile lock(refPath);
+    if (!lock.acquired()) {
+        error = refPath + " is locked by another process (remove " + refPath + ".lock if none is running)";
+        return false;
+    }
+
+    nlohmann::json value = FileSystem::fileExists(refPath) ? FileSystem::readJson(refPath) : nlohmann::json::object();
+    std::string current = currentHead(value);
+    if (current != expectedHead) {
+        error = refPath + " moved from '" + expectedHead + "' to '" + current + "' while this command was running";
+        return false;
+    }
+
+    change(value);
+    if (!lock.commit(refPath, value)) {
+        error = "could not write " + refPath;
+        return false;
+    }
+    return true;
+}
+
+bool Refs::update(const std::vector<Change>& changes, std::string& error) {
+    VCS_TRACE_SCOPE("Refs::update");
+    std::vector<std::unique_ptr<RefLockFile>> locks;
+    std::vector<nlohmann::json> values;
+    for (const auto& change : changes) {
+        if (!FileSystem::deferringWrites()) {
+            locks.push_back(std::make_unique<RefLockFile>(change.refPath));
+            if (!locks.back()->acquired()) {
+                error = change.refPath + " is locked by another process (remove " + change.refPath + ".lock if none is running)";
+                return false;
+            }
+        }
+        nlohmann::json value = FileSystem::fileExists(change.refPath) ? FileSystem::readJson(change.refPath) : nlohmann::json::object();
+        std::string current = currentHead(value);
+        if (current != change.expectedHead) {
+            error = change.refPath + " moved from '" + change.expectedHead + "' to '" + current + "' while this command was running";
+            return false;
+        }
+        values.push_back(std::move(value));
+    }
+
+    for (size_t i = 0; i < changes.size(); ++i) {
+        changes[i].change(values[i]);
+        bool written = FileSystem::deferringWrites() ? FileSystem::writeJson(changes[i].refPath, values[i])
+                                                     : locks[i]->commit(changes[i].refPath, values[i]);
+        if (!written) {
+            // Only a write failure gets here, after every check passed; the refs before it are updated
+            error = "could not write " + changes[i].refPath;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string Refs::head(const std::string& refPath) {
+    return FileSystem::fileExists(refPath) ? currentHead(FileSystem::readJson(refPath)) : "";
+}
+
+bool Refs::create(const std::string& refPath, const nlohmann::json& value, std::string& error) {
+    VCS_TRACE_SCOPE("Refs::create");
+    if (FileSystem::deferringWrites()) {
+        if (FileSystem::fileExists(refPath)) {
+            error = refPath + " already exists";
+            return false;
+        }
+        return FileSystem::writeJson(refPath, value);
+    }
+    RefLockFile lock(refPath);
+    if (!lock.acquired()) {
+        error = refPath + " is locked by another process (remove " + refPath + ".lock if none is running)";
+        return false;
+    }
+    if (FileSystem::fileExists(refPath)) {
+        error = refPath + " already exists";
+        return false;
+    }
+    if (!lock.commit(refPath, value)) {
+        error = "could not write " + refPath;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,296 @@
+#include "../include/Remote.h"
+#include "../include/BlobStore.h"
+#include "../include/FileSystem.h"
+#include "../include/ReachabilityIndex.h"
+#include "../include/Refs.h"
+#include "../include/Repository.h"
+#include "../include/Trace.h"
+#include <deque>
+#include <filesystem>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <semaphore>
+#include <streambuf>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A bounded in-memory pipe between one writing and one reading thread, so a pack goes from
+// Pack::write straight into Pack::read without touching the disk in between
+class PackPipe {
+private:
+    static constexpr size_t blockSize = 1 << 20;
+    static constexpr ptrdiff_t maxBlocks = 8; // At most this much is in flight
+
+    std::mutex mutex;
+    std::deque<std::string> blocks;
+    bool readerDone = false;
+    std::counting_semaphore<maxBlocks + 1> freeSlots{maxBlocks}; // Plus one to wake the writer when the reader quits
+    std::counting_semaphore<maxBlocks + 1> filledSlots{0}; // Plus one for the end of the stream
+
+public:
+    // Blocks while the pipe is full; false once the reader has gone away
+    bool push(std::string block) {
+        freeSlots.acquire();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readerDone) {
+            freeSlots.release(); // Let the next push through as well
+            return false;
+        }
+        blocks.push_back(std::move(block));
+        filledSlots.release();
+        return true;
+    }
+    // Blocks until there is data; false at the end of the stream
+    bool pop(std::string& block) {
+        filledSlots.acquire();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (blocks.empty()) {
+            filledSlots.release(); // Only the end of the stream gets here; it stays signalled
+            return false;
+        }
+        block = std::move(blocks.front());
+        blocks.pop_front();
+        freeSlots.release();
+        return true;
+    }
+    // True if the reader had already gone away
+    bool closeWriter() {
+        std::lock_guard<std::mutex> lock(mutex);
+        filledSlots.release();
+        return readerDone;
+    }
+    void closeReader() {
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+        blocks.clear();
+        freeSlots.release();
+    }
+
+    class WriteBuffer : public std::streambuf {
+    private:
+        PackPipe& pipe;
+        std::string block;
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (sync() != 0) return traits_type::eof();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+        int sync() override {
+            size_t used = static_cast<size_t>(pptr() - pbase());
+            if (used == 0) return 0;
+            block.resize(used);
+            bool sent = pipe.push(std::move(block));
+            block.assign(blockSize, '\0');
+            setp(block.data(), block.data() + block.size());
+            return sent ? 0 : -1;
+        }
+
+    public:
+        explicit WriteBuffer(PackPipe& pipe) : pipe(pipe), block(blockSize, '\0') {
+            setp(block.data(), block.data() + block.size());
+        }
+    };
+
+    class ReadBuffer : public std::streambuf {
+    private:
+        PackPipe& pipe;
+        std::string block;
+
+    protected:
+        int_type underflow() override {
+            do {
+                if (!pipe.pop(block)) return traits_type::eof();
+            } while (block.empty());
+            setg(block.data(), block.data(), block.data() + block.size());
+            return traits_type::to_int_type(block[0]);
+        }
+
+    public:
+        explicit ReadBuffer(PackPipe& pipe) : pipe(pipe) {}
+    };
+};
+
+std::string under(const std::string& root, const std::string& relativePath) {
+    return (fs::path(root) / relativePath).string();
+}
+
+// Commits reachable from `tips` that the receiver does not have, walking no further than the
+// first commit it does have on each path (a repository always has the ancestors of its commits).
+// Those first commits it has are the `common` ones.
+std::vector<std::string> missingCommits(Repository& sender, const std::vector<std::string>& tips,
+                                        const std::string& receiverRoot, std::vector<std::string>& common) {
+    VCS_TRACE_SCOPE("Remote: negotiate commits");
+    std::vector<std::string> missing;
+    std::unordered_set<std::string> visited;
+    std::deque<std::string> queue;
+    for (const auto& tip : tips) {
+        if (visited.insert(tip).second) queue.push_back(tip);
+    }
+    while (!queue.empty()) {
+        std::string commitId = std::move(queue.front());
+        queue.pop_front();
+        if (FileSystem::fileExists(under(receiverRoot, ".vcs/commits/" + commitId + ".json"))) {
+            common.push_back(commitId);
+            continue;
+        }
+        auto commit = sender.commit(commitId);
+        if (!commit) continue;
+        missing.push_back(commitId);
+        for (const auto& parent : commit->parents) {
+            if (visited.insert(parent).second) queue.push_back(parent);
+        }
+    }
+    return missing;
+}
+
+// Objects of `commits` the receiver lacks, each once. With reachability bitmaps that is what the
+// tips reach minus what the common commits reach, without reading the trees in between.
+std::vector<Digest> missingObjects(Repository& sender, const std::vector<std::string>& tips,
+                                   const std::vector<std::string>& commits, const std::vector<std::string>& common,
+                                   const std::string& receiverRoot) {
+    VCS_TRACE_SCOPE("Remote: negotiate objects");
+    std::vector<Digest> missing;
+    ReachabilityIndex index(sender);
+    if (index.bitmapCount() > 0) {
+        EwahBitmap wanted = index.reachable(tips).andNot(index.reachable(common));
+        wanted.forEach([&](uint64_t position) {
+            if (index.isCommit(position)) return;
+            const Digest& digest = index.object(position);
+            if (!FileSystem::fileExists(under(receiverRoot, BlobStore::objectPath(digest) + "/hash.json"))) {
+                missing.push_back(digest);
+            }
+        });
+        return missing;
+    }
+    std::unordered_set<Digest> seen;
+    for (const auto& commitId : commits) {
+        auto commit = sender.commit(commitId);
+        if (!commit) continue;
+        for (const auto& entry : commit->tree) {
+            if (!seen.insert(entry.digest).second) continue;
+            if (!FileSystem::fileExists(under(receiverRoot, BlobStore::objectPath(entry.digest) + "/hash.json"))) {
+                missing.push_back(entry.digest);
+            }
+        }
+    }
+    return missing;
+}
+
+} // namespace
+
+std::string Remote::locate(const std::string& path) {
+    std::error_code ec;
+    fs::path root = fs::absolute(path, ec).lexically_normal();
+    if (ec) return "";
+    if (!root.has_filename()) root = root.parent_path();
+    if (root.filename() == ".vcs") root = root.parent_path();
+    return fs::is_directory(root / ".vcs") ? root.string() : "";
+}
+
+bool Remote::isAncestor(Repository& repository, const std::string& ancestor, const std::string& tip) {
+    std::unordered_set<std::string> visited = {tip};
+    std::deque<std::string> queue = {tip};
+    while (!queue.empty()) {
+        std::string commitId = std::move(queue.front());
+        queue.pop_front();
+        if (commitId == ancestor) return true;
+        if (auto commit = repository.commit(commitId)) {
+            for (const auto& parent : commit->parents) {
+                if (visited.insert(parent).second) queue.push_back(parent);
+            }
+        }
+    }
+    return false;
+}
+
+bool Remote::fetch(const std::string& fromRoot, const std::string& toRoot, const std::vector<std::string>& branches,
+                   std::vector<RefUpdate>& updates, PackSummary& summary, std::string& error) {
+    VCS_TRACE_SCOPE("Remote::fetch");
+    Repository sender(fromRoot);
+    Repository receiver(toRoot);
+    updates.clear();
+    summary = PackSummary{};
+
+    std::vector<std::string> names = branches.empty() ? sender.branches() : branches;
+    std::vector<std::string> tips;
+    nlohmann::json refs = nlohmann::json::object();
+    for (const auto& name : names) {
+        std::string refPath = sender.vcsPath("branches/" + name + ".json");
+        if (!FileSystem::fileExists(refPath)) {
+            error = "branch '" + name + "' does not exist in " + fromRoot;
+            return false;
+        }
+        RefUpdate update;
+        update.branch = name;
+        update.ref = FileSystem::readJson(refPath);
+        update.newHead = sender.branchHead(name);
+        update.oldHead = receiver.branchHead(name);
+        if (update.newHead.empty() || update.newHead == update.oldHead) {
+            update.kind = RefUpdate::Kind::UpToDate;
+        } else if (update.oldHead.empty()) {
+            update.kind = RefUpdate::Kind::Create;
+        } else if (isAncestor(sender, update.oldHead, update.newHead)) {
+            update.kind = RefUpdate::Kind::FastForward;
+        } else {
+            update.kind = RefUpdate::Kind::NonFastForward;
+        }
+        if (update.kind == RefUpdate::Kind::Create || update.kind == RefUpdate::Kind::FastForward) {
+            tips.push_back(update.newHead);
+            refs[name] = update.newHead;
+        }
+        updates.push_back(std::move(update));
+    }
+    if (tips.empty()) return true;
+
+    std::vector<std::string> common;
+    std::vector<std::string> commits = missingCommits(sender, tips, toRoot, common);
+    std::vector<Digest> objects = missingObjects(sender, tips, commits, common, toRoot);
+    if (commits.empty()) return true;
+
+    // The pack is written on a second thread and unpacked as it arrives; nothing is referenced
+    // until the refs are updated afterwards
+    PackPipe pipe;
+    bool writerFailed = false;
+    std::string writeError;
+    std::thread writer([&] {
+        PackPipe::WriteBuffer buffer(pipe);
+        std::ostream out(&buffer);
+        bool written = Pack::write(out, fromRoot, refs, commits, objects, [&](const Digest& chunk) {
+            return FileSystem::fileExists(under(toRoot, BlobStore::chunkPath(chunk)));
+        }, summary, writeError);
+        // Once the reader has given up, writes fail too; its error is the one that counts
+        writerFailed = !pipe.closeWriter() && !written;
+    });
+    PackPipe::ReadBuffer buffer(pipe);
+    std::istream in(&buffer);
+    nlohmann::json receivedRefs;
+    PackSummary received;
+    bool ok = Pack::read(in, toRoot, receivedRefs, received, error);
+    pipe.closeReader(); // Stops a writer that is still going after a failed read
+    writer.join();
+    if (writerFailed) {
+        error = writeError; // The reader only saw the pack end early
+        return false;
+    }
+    return ok;
+}
+
+bool Remote::updateRef(const std::string& root, const RefUpdate& update, std::string& error) {
+    std::string refPath = under(root, ".vcs/branches/" + update.branch + ".json");
+    if (update.kind == RefUpdate::Kind::Create) {
+        return Refs::create(refPath, update.ref, error);
+    }
+    return Refs::update(refPath, update.oldHead, [&](nlohmann::json& branch) {
+        branch = update.ref;
+    }, error);
+}
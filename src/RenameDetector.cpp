@@ -0,0 +1,234 @@
+#include "../include/RenameDetector.h"
+#include "../include/BlobStore.h"
+#include "../include/Trace.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+constexpr size_t sketchSize = 64;
+constexpr size_t bandRows = 2; // 32 bands of 2: pairs down to ~20% Jaccard usually share a band
+constexpr size_t bandCount = sketchSize / bandRows;
+constexpr size_t binaryBlock = 64;
+
+uint64_t mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL; // splitmix64 finalizer
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t hashBytes(const char* data, size_t length) {
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct Sketch {
+    std::vector<uint64_t> tokens; // Sorted token hashes (a multiset), for exact scoring
+    std::array<uint64_t, sketchSize> minHashes;
+};
+
+// Lines for text, fixed blocks for binary content (a NUL in the first 8000 bytes)
+bool buildSketch(const std::string& content, Sketch& sketch) {
+    bool binary = std::memchr(content.data(), '\0', std::min<size_t>(content.size(), 8000)) != nullptr;
+    if (binary) {
+        for (size_t offset = 0; offset < content.size(); offset += binaryBlock) {
+            sketch.tokens.push_back(hashBytes(content.data() + offset, std::min(binaryBlock, content.size() - offset)));
+        }
+    } else {
+        size_t start = 0;
+        while (start < content.size()) {
+            size_t end = content.find('\n', start);
+            if (end == std::string::npos) end = content.size();
+            sketch.tokens.push_back(hashBytes(content.data() + start, end - start));
+            start = end + 1;
+        }
+    }
+    if (sketch.tokens.empty()) return false;
+    std::sort(sketch.tokens.begin(), sketch.tokens.end());
+
+    // One min-hash per seed over the distinct tokens
+    sketch.minHashes.fill(UINT64_MAX);
+    for (size_t i = 0; i < sketch.tokens.size(); ++i) {
+        if (i > 0 && sketch.tokens[i] == sketch.tokens[i - 1]) continue;
+        for (size_t seed = 0; seed < sketchSize; ++seed) {
+            sketch.minHashes[seed] = std::min(sketch.minHashes[seed], mix(sketch.tokens[i] ^ (seed * 0x9e3779b97f4a7c15ULL)));
+        }
+    }
+    return true;
+}
+
+uint64_t bandKey(const Sketch& sketch, size_t band) {
+    uint64_t key = mix(band);
+    for (size_t row = 0; row < bandRows; ++row) {
+        key = mix(key ^ sketch.minHashes[band * bandRows + row]);
+    }
+    return key;
+}
+
+// Shared lines over all lines (Dice over the multisets), in percent
+uint32_t similarity(const Sketch& a, const Sketch& b) {
+    size_t common = 0;
+    auto i = a.tokens.begin(), j = b.tokens.begin();
+    while (i != a.tokens.end() && j != b.tokens.end()) {
+        if (*i < *j) {
+            ++i;
+        } else if (*j < *i) {
+            ++j;
+        } else {
+            ++common;
+            ++i;
+            ++j;
+        }
+    }
+    return static_cast<uint32_t>(200 * common / (a.tokens.size() + b.tokens.size()));
+}
+
+std::string_view baseName(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+std::vector<Rename> RenameDetector::detect(const Tree& oldTree, const Tree& newTree, uint32_t minSimilarity, bool copies) {
+    VCS_TRACE_SCOPE("RenameDetector::detect");
+    std::vector<std::pair<std::string, Digest>> deleted, added;
+    auto a = oldTree.begin();
+    auto b = newTree.begin();
+    while (a != oldTree.end() || b != newTree.end()) {
+        if (b == newTree.end() || (a != oldTree.end() && (*a).path < (*b).path)) {
+            deleted.emplace_back(std::string((*a).path), (*a).digest);
+            ++a;
+        } else if (a == oldTree.end() || (*b).path < (*a).path) {
+            added.emplace_back(std::string((*b).path), (*b).digest);
+            ++b;
+        } else {
+            ++a;
+            ++b;
+        }
+    }
+
+    std::vector<Rename> renames;
+    std::vector<bool> deletedUsed(deleted.size(), false), addedUsed(added.size(), false);
+
+    // Identical content: a hash lookup per added file, preferring a source with the same file name
+    std::unordered_map<Digest, std::vector<size_t>, DigestHash> deletedByDigest;
+    for (size_t i = 0; i < deleted.size(); ++i) {
+        deletedByDigest[deleted[i].second].push_back(i);
+    }
+    for (size_t j = 0; j < added.size(); ++j) {
+        auto it = deletedByDigest.find(added[j].second);
+        if (it == deletedByDigest.end()) continue;
+        size_t best = SIZE_MAX;
+        for (size_t i : it->second) {
+            if (deletedUsed[i]) continue;
+            if (best == SIZE_MAX || baseName(deleted[i].first) == baseName(added[j].first)) best = i;
+            if (baseName(deleted[i].first) == baseName(added[j].first)) break;
+        }
+        if (best == SIZE_MAX) continue;
+        deletedUsed[best] = addedUsed[j] = true;
+        renames.push_back({deleted[best].first, added[j].first, 100, false});
+    }
+
+    if (copies) {
+        std::unordered_map<Digest, std::string_view, DigestHash> oldByDigest;
+        for (const auto& [path, digest] : oldTree) {
+            if (newTree.contains(path)) oldByDigest.emplace(digest, path);
+        }
+        for (size_t j = 0; j < added.size(); ++j) {
+            auto it = addedUsed[j] ? oldByDigest.end() : oldByDigest.find(added[j].second);
+            if (it == oldByDigest.end()) continue;
+            addedUsed[j] = true;
+            renames.push_back({std::string(it->second), added[j].first, 100, true});
+        }
+    }
+
+    // Similar content among what is left
+    std::vector<size_t> deletedLeft, addedLeft;
+    for (size_t i = 0; i < deleted.size(); ++i) {
+        if (!deletedUsed[i]) deletedLeft.push_back(i);
+    }
+    for (size_t j = 0; j < added.size(); ++j) {
+        if (!addedUsed[j]) addedLeft.push_back(j);
+    }
+    if (!deletedLeft.empty() && !addedLeft.empty() && minSimilarity < 100) {
+        auto sketchAll = [](const std::vector<std::pair<std::string, Digest>>& files, const std::vector<size_t>& left) {
+            std::vector<Sketch> sketches(left.size());
+            std::vector<bool> valid(left.size(), false);
+            for (size_t k = 0; k < left.size(); ++k) {
+                // Sized first, so an oversized blob is never loaded just to be skipped
+                std::string folder = BlobStore::objectPath(files[left[k]].second);
+                uint64_t size = 0;
+                if (!BlobStore::size(folder, size) || size > maxSketchBytes) continue;
+                std::string content;
+                if (BlobStore::read(folder, content) && content.size() <= maxSketchBytes) {
+                    valid[k] = buildSketch(content, sketches[k]);
+                }
+            }
+            return std::make_pair(std::move(sketches), std::move(valid));
+        };
+        auto [deletedSketches, deletedValid] = sketchAll(deleted, deletedLeft);
+        auto [addedSketches, addedValid] = sketchAll(added, addedLeft);
+
+        // LSH: deleted files bucketed by each band; an added file is only scored against files
+        // it shares a bucket with
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        for (size_t k = 0; k < deletedLeft.size(); ++k) {
+            if (!deletedValid[k]) continue;
+            for (size_t band = 0; band < bandCount; ++band) {
+                buckets[bandKey(deletedSketches[k], band)].push_back(static_cast<uint32_t>(k));
+            }
+        }
+
+        // Dice threshold as the Jaccard estimate the sketches give, with slack for estimation error
+        double minJaccard = minSimilarity / (200.0 - minSimilarity) - 0.15;
+        struct Candidate {
+            uint32_t score;
+            size_t deletedIndex;
+            size_t addedIndex;
+        };
+        std::vector<Candidate> candidates;
+        std::unordered_set<uint32_t> seen;
+        for (size_t k = 0; k < addedLeft.size(); ++k) {
+            if (!addedValid[k]) continue;
+            seen.clear();
+            for (size_t band = 0; band < bandCount; ++band) {
+                auto it = buckets.find(bandKey(addedSketches[k], band));
+                if (it == buckets.end()) continue;
+                for (uint32_t d : it->second) {
+                    if (!seen.insert(d).second) continue;
+                    size_t equal = 0;
+                    for (size_t s = 0; s < sketchSize; ++s) {
+                        equal += deletedSketches[d].minHashes[s] == addedSketches[k].minHashes[s];
+                    }
+                    if (static_cast<double>(equal) / sketchSize < minJaccard) continue;
+                    uint32_t score = similarity(deletedSketches[d], addedSketches[k]);
+                    if (score >= minSimilarity) candidates.push_back({score, deletedLeft[d], addedLeft[k]});
+                }
+            }
+        }
+
+        // Best pairs first; each file takes part in at most one rename
+        std::sort(candidates.begin(), candidates.end(), [&](const Candidate& x, const Candidate& y) {
+            if (x.score != y.score) return x.score > y.score;
+            if (x.addedIndex != y.addedIndex) return added[x.addedIndex].first < added[y.addedIndex].first;
+            return deleted[x.deletedIndex].first < deleted[y.deletedIndex].first;
+        });
+        for (const auto& candidate : candidates) {
+            if (deletedUsed[candidate.deletedIndex] || addedUsed[candidate.addedIndex]) continue;
+            deletedUsed[candidate.deletedIndex] = addedUsed[candidate.addedIndex] = true;
+            renames.push_back({deleted[candidate.deletedIndex].first, added[candidate.addedIndex].first, candidate.score, false});
+        }
+    }
+
+    std::sort(renames.begin(), renames.end(), [](const Rename& x, const Rename& y) { return x.to < y.to; });
+    return renames;
+}
@@ -0,0 +1,184 @@
+#include "../include/Repository.h"
+#include "../include/FileSystem.h"
+#include "../include/IgnoreMatcher.h"
+#include "../include/SparseCheckout.h"
+#include "../include/Stats.h"
+#include "../include/Trace.h"
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+static Repository* activeRepository = nullptr;
+
+Repository::Repository(const fs::path& root, size_t commitCacheSize)
+    : rootPath(fs::absolute(root).lexically_normal()), commitCapacity(std::max<size_t>(1, commitCacheSize)) {
+    if (!rootPath.has_filename()) rootPath = rootPath.parent_path(); // "dir/." normalizes to "dir/"
+}
+
+Repository& Repository::active() {
+    if (activeRepository) return *activeRepository;
+    // Outside run(): the repository in the working directory, reopened if that changes
+    static std::unique_ptr<Repository> workingDirectory;
+    std::error_code ec;
+    fs::path current = fs::current_path(ec);
+    if (!workingDirectory || (!ec && workingDirectory->root() != current)) {
+        workingDirectory = std::make_unique<Repository>(ec ? fs::path(".") : current);
+    }
+    return *workingDirectory;
+}
+
+bool Repository::exists() const {
+    return fs::is_directory(rootPath / ".vcs");
+}
+
+std::string Repository::vcsPath(const std::string& relativePath) const {
+    return (rootPath / ".vcs" / relativePath).string();
+}
+
+const nlohmann::json& Repository::readRef(const std::string& relativePath) {
+    static const nlohmann::json missing;
+    std::string path = vcsPath(relativePath);
+    if (FileSystem::deferringWrites()) {
+        // Pending ref writes are not on disk, so stamps would be stale; deferred reads are in memory anyway
+        refs.erase(relativePath);
+        if (!FileSystem::fileExists(path)) return missing;
+        CachedRef& ref = refs[relativePath];
+        ref.value = FileSystem::readJson(path);
+        return ref.value;
+    }
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    uintmax_t size = ec ? 0 : fs::file_size(path, ec);
+    if (ec) {
+        refs.erase(relativePath);
+        return missing;
+    }
+
+    auto it = refs.find(relativePath);
+    if (it != refs.end() && it->second.mtime == mtime && it->second.size == size) {
+        Stats::add(Counter::CacheHits);
+        return it->second.value;
+    }
+    Stats::add(Counter::CacheMisses);
+    nlohmann::json value;
+    try {
+        value = FileSystem::readJson(path);
+    } catch (const nlohmann::json::exception&) {
+        refs.erase(relativePath);
+        return missing;
+    }
+    CachedRef& ref = refs[relativePath];
+    ref = CachedRef{mtime, size, std::move(value)};
+    return ref.value;
+}
+
+std::string Repository::currentBranch() {
+    const nlohmann::json& ref = readRef("current_branch/current_branch.json");
+    return ref.is_object() && ref.contains("name") && ref["name"].is_string() ? ref["name"].get<std::string>() : "";
+}
+
+std::string Repository::head() {
+    const nlohmann::json& ref = readRef("current_branch/current_branch.json");
+    return ref.is_object() && ref.contains("head") && ref["head"].is_string() ? ref["head"].get<std::string>() : "";
+}
+
+std::string Repository::branchHead(const std::string& branch) {
+    const nlohmann::json& ref = readRef("branches/" + branch + ".json");
+    return ref.is_object() && ref.contains("head") && ref["head"].is_string() ? ref["head"].get<std::string>() : "";
+}
+
+std::vector<std::string> Repository::branches() {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(vcsPath("branches"), ec)) {
+        if (entry.path().extension() == ".json") names.push_back(entry.path().stem().string());
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::string Repository::resolve(const std::string& revision) {
+    if (revision.empty()) return head();
+    if (FileSystem::fileExists(vcsPath("branches/" + revision + ".json"))) return branchHead(revision);
+    return commit(revision) ? revision : "";
+}
+
+std::shared_ptr<const CommitInfo> Repository::commit(const std::string& commitId) {
+    if (commitId.empty() || commitId == "null") return nullptr;
+
+    auto cached = commitsById.find(commitId);
+    if (cached != commitsById.end()) {
+        Stats::add(Counter::CacheHits);
+        commits.splice(commits.begin(), commits, cached->second);
+        return cached->second->second;
+    }
+    Stats::add(Counter::CacheMisses);
+
+    std::string path = vcsPath("commits/" + commitId + ".json");
+    if (!FileSystem::fileExists(path)) return nullptr;
+    VCS_TRACE_SCOPE("Repository::commit parse");
+    auto info = std::make_shared<CommitInfo>();
+    try {
+        nlohmann::json data = FileSystem::readJson(path);
+        info->id = commitId;
+        info->branch = data.value("branch_name", "");
+        info->message = data.value("message", "");
+        info->timestamp = data.value("timestamp", "");
+        if (data.contains("parents") && data["parents"].is_array()) {
+            info->parents = data["parents"].get<std::vector<std::string>>();
+        } else if (data.value("parent", "null") != "null" && !data.value("parent", "").empty()) {
+            info->parents.push_back(data["parent"].get<std::string>()); // Written before merge parents existed
+        }
+        if (data.contains("directory_tree")) info->tree = Tree::fromJson(data["directory_tree"]);
+    } catch (const nlohmann::json::exception&) {
+        return nullptr;
+    }
+
+    // Commits never change once written, so entries are only ever evicted, not invalidated
+    commits.emplace_front(commitId, std::move(info));
+    commitsById[commitId] = commits.begin();
+    if (commits.size() > commitCapacity) {
+        commitsById.erase(commits.back().first);
+        commits.pop_back();
+    }
+    return commits.front().second;
+}
+
+Tree Repository::commitTree(const std::string& commitId) {
+    auto info = commit(commitId);
+    return info ? info->tree : Tree();
+}
+
+Tree Repository::workingTree() {
+    VCS_TRACE_SCOPE("Repository::workingTree");
+    if (!indexLoaded) {
+        index.load(vcsPath("index.json"));
+        indexLoaded = true;
+    }
+    std::string root = rootPath.string();
+    IgnoreMatcher ignore = IgnoreMatcher::load(root);
+    SparseCheckout sparse = SparseCheckout::load(root);
+    Tree tree = FileSystem::getDirectoryTree(root, &ignore, &sparse, &index);
+    if (exists() && !FileSystem::deferringWrites()) index.save(vcsPath("index.json"));
+    return tree;
+}
+
+bool Repository::checkpoint() {
+    VCS_TRACE_SCOPE("Repository::checkpoint");
+    bool ok = FileSystem::flushWrites();
+    if (indexLoaded && exists()) ok = index.save(vcsPath("index.json")) && ok;
+    refs.clear(); // Flushed refs have new stamps
+    return ok;
+}
+
+Repository::Session::Session(Repository& repository)
+    : previousActive(activeRepository), previousDirectory(fs::current_path()) {
+    fs::current_path(repository.root());
+    activeRepository = &repository;
+}
+
+Repository::Session::~Session() {
+    activeRepository = previousActive;
+    std::error_code ec;
+    fs::current_path(previousDirectory, ec);
+}
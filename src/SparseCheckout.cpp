@@ -0,0 +1,53 @@
+#include "../include/SparseCheckout.h"
+#include "../include/FileSystem.h"
+#include <algorithm>
+
+SparseCheckout::SparseCheckout(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) {
+        std::string prefix = normalize(path);
+        if (prefix.empty()) {
+            prefixes.clear(); // The root selects everything
+            return;
+        }
+        prefixes.push_back(prefix);
+    }
+    std::sort(prefixes.begin(), prefixes.end());
+    prefixes.erase(std::unique(prefixes.begin(), prefixes.end()), prefixes.end());
+}
+
+SparseCheckout SparseCheckout::load(const std::string& root) {
+    std::string configPath = root + "/.vcs/config.json";
+    if (!FileSystem::fileExists(configPath)) return SparseCheckout();
+    nlohmann::json config = FileSystem::readJson(configPath);
+    if (!config.contains("sparse_paths") || !config["sparse_paths"].is_array()) return SparseCheckout();
+    return SparseCheckout(config["sparse_paths"].get<std::vector<std::string>>());
+}
+
+std::string SparseCheckout::normalize(std::string_view path) {
+    std::string result(path);
+    std::replace(result.begin(), result.end(), '\\', '/');
+    while (result.starts_with("./")) result.erase(0, 2);
+    while (result.starts_with("/")) result.erase(0, 1);
+    while (result.ends_with("/")) result.pop_back();
+    if (result == ".") result.clear();
+    return result;
+}
+
+bool SparseCheckout::includes(std::string_view relativePath) const {
+    if (prefixes.empty()) return true;
+    // Look the path and each of its ancestor directories up among the prefixes
+    for (std::string_view candidate = relativePath;;) {
+        if (std::binary_search(prefixes.begin(), prefixes.end(), candidate)) return true;
+        size_t slash = candidate.rfind('/');
+        if (slash == std::string_view::npos) return false;
+        candidate = candidate.substr(0, slash);
+    }
+}
+
+bool SparseCheckout::shouldDescend(std::string_view relativeDirectory) const {
+    if (includes(relativeDirectory)) return true;
+    // Some prefix lies below the directory; those sort right after "<dir>/"
+    std::string below = std::string(relativeDirectory) + "/";
+    auto it = std::lower_bound(prefixes.begin(), prefixes.end(), below);
+    return it != prefixes.end() && it->starts_with(below);
+}
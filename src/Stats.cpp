@@ -0,0 +1,97 @@
+#include "../include/Stats.h"
+#include "../include/FileSystem.h"
+#include <iomanip>
+#include <iostream>
+
+std::atomic<uint64_t> Stats::counters[static_cast<size_t>(Counter::Count)];
+
+static const std::string statsPath = ".vcs/stats.json";
+
+// A damaged stats.json is treated as empty rather than failing the command it is attached to
+static nlohmann::json loadTotals() {
+    nlohmann::json totals = nlohmann::json::parse(FileSystem::readFile(statsPath), nullptr, false);
+    if (!totals.is_object()) return nlohmann::json::object();
+    return totals;
+}
+
+static uint64_t counterValue(const nlohmann::json& values, const std::string& key) {
+    auto it = values.find(key);
+    return it != values.end() && it->is_number_unsigned() ? it->get<uint64_t>() : 0;
+}
+
+const char* Stats::name(Counter counter) {
+    switch (counter) {
+        case Counter::FilesStatted: return "files_statted";
+        case Counter::FilesHashed: return "files_hashed";
+        case Counter::BytesHashed: return "bytes_hashed";
+        case Counter::BytesWritten: return "bytes_written";
+        case Counter::ObjectsCreated: return "objects_created";
+        case Counter::ObjectsDeduplicated: return "objects_deduplicated";
+        case Counter::JsonBytesParsed: return "json_bytes_parsed";
+        case Counter::JsonBytesSerialized: return "json_bytes_serialized";
+        case Counter::CacheHits: return "cache_hits";
+        case Counter::CacheMisses: return "cache_misses";
+        case Counter::ChunksCreated: return "chunks_created";
+        case Counter::ChunksDeduplicated: return "chunks_deduplicated";
+        case Counter::ChunkBytesLogical: return "chunk_bytes_logical";
+        case Counter::ChunkBytesStored: return "chunk_bytes_stored";
+        case Counter::BloomChecks: return "bloom_checks";
+        case Counter::BloomNegatives: return "bloom_negatives";
+        case Counter::BloomFalsePositives: return "bloom_false_positives";
+        case Counter::IndexHits: return "index_hits";
+        default: return "unknown";
+    }
+}
+
+nlohmann::json Stats::snapshot() {
+    nlohmann::json values = nlohmann::json::object();
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i) {
+        values[name(static_cast<Counter>(i))] = get(static_cast<Counter>(i));
+    }
+    return values;
+}
+
+void Stats::print(std::ostream& out, const nlohmann::json& values) {
+    for (const auto& [key, value] : values.items()) {
+        if (!value.is_number_unsigned()) continue;
+        out << "  " << std::left << std::setw(24) << key << value.get<uint64_t>() << "\n";
+    }
+    uint64_t hits = values.value("cache_hits", uint64_t(0));
+    uint64_t lookups = hits + values.value("cache_misses", uint64_t(0));
+    if (lookups > 0) {
+        out << "  " << std::left << std::setw(24) << "cache_hit_rate" << std::fixed << std::setprecision(1)
+            << (100.0 * hits / lookups) << "%\n";
+    }
+}
+
+void Stats::persist(const std::string& command) {
+    if (!FileSystem::fileExists(".vcs")) return;
+
+    // Snapshot before touching stats.json so the bookkeeping does not count itself
+    nlohmann::json current = snapshot();
+    nlohmann::json totals = FileSystem::fileExists(statsPath) ? loadTotals() : nlohmann::json::object();
+
+    nlohmann::json& entry = totals[command];
+    if (!entry.is_object()) entry = nlohmann::json::object();
+    entry["runs"] = counterValue(entry, "runs") + 1;
+    for (const auto& [key, value] : current.items()) {
+        entry[key] = counterValue(entry, key) + value.get<uint64_t>();
+    }
+    FileSystem::replaceFile(statsPath, totals.dump(4));
+}
+
+void Stats::report() {
+    if (!FileSystem::fileExists(statsPath)) {
+        std::cout << "No statistics recorded yet." << std::endl;
+        return;
+    }
+
+    nlohmann::json totals = loadTotals();
+    for (const auto& [command, values] : totals.items()) {
+        if (!values.is_object()) continue;
+        std::cout << command << " (" << counterValue(values, "runs") << " runs)\n";
+        nlohmann::json counters = values;
+        counters.erase("runs");
+        print(std::cout, counters);
+    }
+}
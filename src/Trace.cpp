@@ -0,0 +1,74 @@
+#include "../include/Trace.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+std::atomic<bool> Trace::active{false};
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+struct ThreadBuffer {
+    uint32_t threadId;
+    std::vector<TraceEvent> events;
+};
+
+// Every thread's buffer stays registered so events survive thread exit until the trace is written
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+static ThreadBuffer& localBuffer() {
+    thread_local ThreadBuffer* buffer = [] {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        registry.back()->threadId = static_cast<uint32_t>(registry.size());
+        registry.back()->events.reserve(4096);
+        return registry.back().get();
+    }();
+    return *buffer;
+}
+
+static const auto processStart = std::chrono::steady_clock::now();
+
+void Trace::enable() {
+    active.store(true, std::memory_order_relaxed);
+}
+
+uint64_t Trace::nowMicros() {
+    // +1 keeps a valid start time non-zero, which TraceScope uses as its "recording" flag
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - processStart).count() + 1;
+}
+
+void Trace::record(const char* name, uint64_t startMicros, uint64_t durationMicros) {
+    localBuffer().events.push_back({name, startMicros, durationMicros});
+}
+
+bool Trace::writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& buffer : registry) {
+        for (const auto& event : buffer->events) {
+            nlohmann::json record;
+            record["name"] = event.name;
+            record["ph"] = "X";
+            record["ts"] = event.start;
+            record["dur"] = event.duration;
+            record["pid"] = 1;
+            record["tid"] = buffer->threadId;
+            out << (first ? "" : ",\n") << record.dump();
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
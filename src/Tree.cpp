@@ -0,0 +1,94 @@
+#include "../include/Tree.h"
+#include <algorithm>
+
+void Tree::insert(std::string_view path, const Digest& digest) {
+    if (!entries.empty() && !(pathOf(entries.back()) < path)) {
+        inOrder = false;
+    }
+    entries.push_back({static_cast<uint32_t>(arena.size()), static_cast<uint32_t>(path.size()), digest});
+    arena.append(path);
+}
+
+void Tree::finalize() {
+    if (inOrder) return;
+    // Stable, so among equal paths the last insert ends up last and wins below
+    std::stable_sort(entries.begin(), entries.end(), [this](const Entry& a, const Entry& b) {
+        return pathOf(a) < pathOf(b);
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i + 1 < entries.size() && pathOf(entries[i]) == pathOf(entries[i + 1])) continue;
+        entries[kept++] = entries[i];
+    }
+    entries.resize(kept);
+    inOrder = true;
+}
+
+void Tree::reserve(size_t count, size_t pathBytes) {
+    entries.reserve(count);
+    arena.reserve(pathBytes);
+}
+
+std::vector<Tree::Entry>::const_iterator Tree::lowerBound(std::string_view path) const {
+    return std::lower_bound(entries.begin(), entries.end(), path, [this](const Entry& entry, std::string_view key) {
+        return pathOf(entry) < key;
+    });
+}
+
+const Digest* Tree::find(std::string_view path) const {
+    if (!inOrder) {
+        // Not finalized yet: the last insert of a path is the one that counts
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+            if (pathOf(*it) == path) return &it->digest;
+        }
+        return nullptr;
+    }
+    auto it = lowerBound(path);
+    if (it == entries.end() || pathOf(*it) != path) return nullptr;
+    return &it->digest;
+}
+
+bool Tree::erase(std::string_view path) {
+    finalize();
+    auto it = lowerBound(path);
+    if (it == entries.end() || pathOf(*it) != path) return false;
+    entries.erase(it); // The path bytes stay in the arena until the tree is dropped
+    return true;
+}
+
+Tree Tree::fromJson(const nlohmann::json& tree) {
+    Tree result;
+    if (!tree.is_object()) return result;
+
+    size_t pathBytes = 0;
+    for (const auto& [path, value] : tree.items()) {
+        pathBytes += path.size();
+    }
+    result.reserve(tree.size(), pathBytes);
+
+    // JSON objects iterate in key order, so this is already sorted
+    Digest digest;
+    for (const auto& [path, value] : tree.items()) {
+        if (value.is_string() && Digest::fromHex(value.get_ref<const std::string&>(), digest)) {
+            result.insert(path, digest);
+        }
+    }
+    result.finalize();
+    return result;
+}
+
+nlohmann::json Tree::toJson() const {
+    nlohmann::json tree = nlohmann::json::object();
+    for (const auto& entry : *this) {
+        tree[std::string(entry.path)] = entry.digest.hex();
+    }
+    return tree;
+}
+
+bool Tree::operator==(const Tree& other) const {
+    if (entries.size() != other.entries.size()) return false;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].digest != other.entries[i].digest || pathOf(entries[i]) != other.pathOf(other.entries[i])) return false;
+    }
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "../include/Utilities.h"
+#include "../picosha2.h"
 #include <sstream>
 #include <iomanip>
 #include <random>
@@ -6,24 +7,24 @@
 
 std::string Utilities::generateUUID() 
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 15);
-    std::uniform_int_distribution<> dist3(8, 11);
+    // One engine per thread, seeded once; a fresh random_device per ID is needlessly slow
+    thread_local std::mt19937_64 gen(std::random_device{}());
+    static const char hex[] = "0123456789abcdef";
 
-    std::stringstream ss;
-    for (int i = 0; i < 8; ++i) ss << std::hex << dist(gen);
-    ss << "-";
-    for (int i = 0; i < 4; ++i) ss << std::hex << dist(gen);
-    ss << "-4";
-    for (int i = 0; i < 3; ++i) ss << std::hex << dist(gen);
-    ss << "-";
-    ss << std::hex << dist3(gen);
-    for (int i = 0; i < 3; ++i) ss << std::hex << dist(gen);
-    ss << "-";
-    for (int i = 0; i < 12; ++i) ss << std::hex << dist(gen);
+    uint64_t hi = gen();
+    uint64_t lo = gen();
+    hi = (hi & 0xffffffffffff0fffULL) | 0x0000000000004000ULL; // Version 4
+    lo = (lo & 0x3fffffffffffffffULL) | 0x8000000000000000ULL; // Variant 10xx
 
-    return ss.str();
+    std::string uuid(36, '-');
+    int pos = 0;
+    for (int i = 0; i < 32; ++i)
+    {
+        if (i == 8 || i == 12 || i == 16 || i == 20) ++pos; // Skip the dashes
+        uint64_t word = i < 16 ? hi : lo;
+        uuid[pos++] = hex[(word >> (60 - 4 * (i % 16))) & 0xf];
+    }
+    return uuid;
 }
 
 std::string Utilities::getCurrentTimestamp() {
@@ -33,3 +34,14 @@ std::string Utilities::getCurrentTimestamp() {
     ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
     return ss.str();
 }
+
+std::string Utilities::generateContentId(const nlohmann::json& directoryTree, const std::vector<std::string>& parents,
+                                         const std::string& message, const std::string& timestamp) {
+    // nlohmann::json objects keep keys sorted, so dump() is a canonical encoding
+    nlohmann::json canonical;
+    canonical["directory_tree"] = directoryTree;
+    canonical["parents"] = parents;
+    canonical["message"] = message;
+    canonical["timestamp"] = timestamp;
+    return picosha2::hash256_hex_string(canonical.dump());
+}
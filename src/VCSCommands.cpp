@@ -3,6 +3,20 @@
 #include "../include/Utilities.h"
 #include "../include/CommitGraph.h"
 #include "../include/MergeHandler.h"
+#include "../include/Pack.h"
+#include "../include/Trace.h"
+#include "../include/Stats.h"
+#include "../include/IgnoreMatcher.h"
+#include "../include/BlobStore.h"
+#include "../include/SparseCheckout.h"
+#include "../include/Archive.h"
+#include "../include/Blame.h"
+#include "../include/ChangedPathFilter.h"
+#include "../include/Fsck.h"
+#include "../include/ReachabilityIndex.h"
+#include "../include/Refs.h"
+#include "../include/Remote.h"
+#include "../include/Repository.h"
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <filesystem>
@@ -10,12 +24,74 @@
 #include <fstream>
 #include <unordered_set>
 #include <set>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
 
 namespace fs = std::filesystem;
 using namespace std;
 
-void VCSCommands::init()
+// Repository settings written by `init`; missing file means defaults
+static nlohmann::json readConfig()
 {
+    std::string configPath = ".vcs/config.json";
+    if (!FileSystem::fileExists(configPath))
+    {
+        return nlohmann::json::object();
+    }
+    return FileSystem::readJson(configPath);
+}
+
+// Directory tree of a commit; empty for "null" or missing commits
+static Tree readCommitTree(const std::string &commitId)
+{
+    return Repository::active().commitTree(commitId);
+}
+
+// Copies a file into the staging area under its digest
+static void stageFile(const std::string &filePath, const Digest &hash)
+{
+    VCS_TRACE_SCOPE("add: stage file");
+    std::string stagePath = ".vcs/staging/files/" + hash.hex();
+    std::string fileName = std::filesystem::path(filePath).filename().string();
+
+    // Create the staging directory for this file
+    FileSystem::createDirectory(stagePath);
+    FileSystem::copyFile(filePath, stagePath + "/" + fileName);
+
+    // Save metadata for the file
+    nlohmann::json metadata;
+    metadata["name"] = fileName;
+    metadata["hash"] = hash;
+    FileSystem::writeJson(stagePath + "/metadata.json", metadata);
+
+    std::cout << "Added " << filePath << " to the staging area." << std::endl;
+}
+
+// Records the working tree (excluding `.vcs/` and ignored paths) as the staging tree
+static void saveStagingTree(const Tree &directoryTree)
+{
+    VCS_TRACE_SCOPE("add: save directory tree");
+    FileSystem::writeJson(".vcs/staging/tree/staging_tree.json", directoryTree.toJson());
+    std::cout << "Saved the current directory tree." << std::endl;
+}
+
+// Paths outside a sparse checkout are not on disk; keep the parent commit's entries for them
+static void carryForwardSparse(Tree &tree, const Tree &parentTree, const SparseCheckout &sparse)
+{
+    for (const auto &[path, digest] : parentTree)
+    {
+        if (!sparse.includes(SparseCheckout::normalize(path)))
+        {
+            tree.insert(path, digest);
+        }
+    }
+    tree.finalize();
+}
+
+void VCSCommands::init(bool contentIds)
+{
+    VCS_TRACE_SCOPE("init");
     std::string vcsPath = ".vcs";
     FileSystem::createDirectory(vcsPath + "/current_branch");
     FileSystem::createDirectory(vcsPath + "/latest_commit");
@@ -25,80 +101,61 @@ void VCSCommands::init()
     FileSystem::createDirectory(vcsPath + "/commits");
     FileSystem::createDirectory(vcsPath + "/data/hash");
 
+    nlohmann::json config = readConfig();
+    config["commit_ids"] = contentIds ? "content" : "uuid";
+    FileSystem::writeJson(vcsPath + "/config.json", config);
+
     std::cout << "Initialized empty VCS repository in " << vcsPath << std::endl;
 }
 
 void VCSCommands::add(const std::string &filePath)
 {
+    VCS_TRACE_SCOPE("add");
+    Repository &repository = Repository::active();
     if (filePath == "all")
     {
-        // Add all files in the working directory, excluding `.vcs/` and `vcs.exe`
-        for (const auto &entry : std::filesystem::recursive_directory_iterator("."))
+        // Add all files in the working directory, pruning `.vcs/` and anything in `.vcsignore`.
+        // One scan hashes (or, through the index, looks up) every file and also becomes the staging tree.
+        Tree directoryTree = repository.workingTree();
+        for (const auto &[path, hash] : directoryTree)
         {
-            std::string entryPath = std::filesystem::relative(entry.path()).string();
-
-            // Skip `.vcs/` directory, `vcs.exe`, and ensure it's a regular file
-            if (entryPath.starts_with(".vcs") || entryPath == "vcs.exe" || !entry.is_regular_file())
-            {
-                continue;
-            }
-
-            // Add valid files recursively
-            add(entryPath);
+            stageFile(std::string(path.starts_with("./") ? path.substr(2) : path), hash);
         }
+        saveStagingTree(directoryTree);
+        return;
     }
-    else
-    {
-        // Add a specific file
-        // Skip `.vcs/` directory and `vcs.exe`
-        if (filePath.starts_with(".vcs") || filePath == "vcs.exe")
-        {
-            std::cout << "Skipping file: " << filePath << std::endl;
-            return;
-        }
-
-        // Calculate the hash and stage the file
-        std::string hash = FileSystem::calculateHash(filePath);
-        std::string stagePath = ".vcs/staging/files/" + hash;
-
-        // Create the staging directory for this file
-        FileSystem::createDirectory(stagePath);
-        FileSystem::copyFile(filePath, stagePath + "/" + std::filesystem::path(filePath).filename().string());
-
-        // Save metadata for the file
-        nlohmann::json metadata;
-        metadata["name"] = std::filesystem::path(filePath).filename().string();
-        metadata["hash"] = hash;
-        FileSystem::writeFile(stagePath + "/metadata.json", metadata.dump(4));
 
-        std::cout << "Added " << filePath << " to the staging area." << std::endl;
+    // Add a specific file
+    // Skip `.vcs/` and ignored paths
+    if (IgnoreMatcher::load(".").isPathIgnored(FileSystem::relativePath(filePath, ".")))
+    {
+        std::cout << "Skipping file: " << filePath << std::endl;
+        return;
     }
-
-    // Save the directory tree (excluding `.vcs/` and `vcs.exe`)
-    nlohmann::json directoryTree = FileSystem::getDirectoryTree(".");
-    for (auto it = directoryTree.begin(); it != directoryTree.end();)
+    if (!SparseCheckout::load(".").includes(FileSystem::relativePath(filePath, ".")))
     {
-        if (it.key().starts_with(".vcs") || it.key() == "vcs.exe")
-        {
-            it = directoryTree.erase(it); // Remove `.vcs/` and `vcs.exe` entries from the tree
-        }
-        else
-        {
-            ++it;
-        }
+        std::cout << "Skipping file outside the sparse checkout: " << filePath << std::endl;
+        return;
     }
 
-    std::string stageTreePath = ".vcs/staging/tree/staging_tree.json";
-    FileSystem::writeFile(stageTreePath, directoryTree.dump(4));
-
-    std::cout << "Saved the current directory tree." << std::endl;
+    // Calculate the hash and stage the file
+    Digest hash = FileSystem::calculateHash(filePath);
+    if (hash.isNull())
+    {
+        std::cerr << "Error: Could not read " << filePath << std::endl;
+        return;
+    }
+    stageFile(filePath, hash);
+    saveStagingTree(repository.workingTree());
 }
 
-void VCSCommands::commit(const std::string &message)
+// Commits the working tree. With a sparse checkout, paths outside it are taken from `outsideSparse`
+// (a merge result) or else from the parent commit. False if nothing was committed or a ref could
+// not be moved.
+static bool commitWorkingTree(const std::string &message, const std::vector<std::string> &mergeParents,
+                              const Tree *outsideSparse)
 {
-    // Generate a unique commit ID
-    std::string commitId = Utilities::generateUUID();
-
+    VCS_TRACE_SCOPE("commit");
     // Determine the current branch or initialize the repository with "master" if no branch exists
     std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
     std::string branchName;
@@ -109,75 +166,143 @@ void VCSCommands::commit(const std::string &message)
         // No active branch, create the master branch
         branchName = "master";
 
-        // Initialize the master branch in `.vcs/branches/`
-        nlohmann::json masterBranch;
-        masterBranch["branch_name"] = branchName;
-        masterBranch["head"] = "";    // No head commit yet
-        masterBranch["commits"] = {}; // Empty commit list
-        FileSystem::writeFile(".vcs/branches/" + branchName + ".json", masterBranch.dump(4));
+        // Initialize the master branch in `.vcs/branches/`, unless a push already created it;
+        // this commit then goes on top of it
+        std::string error;
+        std::string masterPath = ".vcs/branches/" + branchName + ".json";
+        bool adopted = FileSystem::fileExists(masterPath);
+        std::string masterHead = Refs::head(masterPath);
+        bool created = adopted || Refs::update(masterPath, "", [&](nlohmann::json &masterBranch) {
+            masterBranch["branch_name"] = branchName;
+            masterBranch["head"] = "";    // No head commit yet
+            masterBranch["commits"] = {}; // Empty commit list
+        }, error);
 
         // Set master as the current branch
-        nlohmann::json currentBranch;
-        currentBranch["name"] = branchName;
-        currentBranch["head"] = ""; // No head commit yet
-        FileSystem::writeFile(currentBranchPath, currentBranch.dump(4));
+        created = created && Refs::update(currentBranchPath, "", [&](nlohmann::json &currentBranch) {
+            currentBranch["name"] = branchName;
+            currentBranch["head"] = masterHead; // "" if no head commit yet
+        }, error);
+        if (!created)
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return false;
+        }
 
-        std::cout << "Initialized repository with master branch." << std::endl;
+        if (!masterHead.empty())
+        {
+            parentCommitId = masterHead;
+        }
+        std::cout << (adopted ? "Using the existing master branch as the current branch."
+                              : "Initialized repository with master branch.")
+                  << std::endl;
     }
     else
     {
         // Read the current active branch
-        nlohmann::json currentBranch = nlohmann::json::parse(FileSystem::readFile(currentBranchPath));
+        nlohmann::json currentBranch = FileSystem::readJson(currentBranchPath);
         branchName = currentBranch["name"];
         parentCommitId = currentBranch["head"];
     }
 
+    // The heads this commit is based on; the refs are only moved if they still hold them
+    std::string branchPath = ".vcs/branches/" + branchName + ".json";
+    std::string expectedBranchHead = Refs::head(branchPath);
+    std::string expectedCurrentHead = parentCommitId == "null" ? "" : parentCommitId;
+
     // Gather metadata from the working directory (not staging)
-    nlohmann::json directoryTree = FileSystem::getDirectoryTree(".");
-    for (auto it = directoryTree.begin(); it != directoryTree.end();)
+    Tree tree;
+    Tree parentTree = readCommitTree(parentCommitId);
+    nlohmann::json directoryTree;
     {
-        if (it.key().find(".vcs") != std::string::npos)
+        VCS_TRACE_SCOPE("commit: scan working tree");
+        SparseCheckout sparse = SparseCheckout::load(".");
+        tree = Repository::active().workingTree(); // `.vcs/`, ignored and non-sparse directories are pruned
+        if (sparse.enabled())
         {
-            it = directoryTree.erase(it); // Remove `.vcs/` entries
-        }
-        else
-        {
-            ++it;
+            carryForwardSparse(tree, outsideSparse ? *outsideSparse : parentTree, sparse);
         }
+        directoryTree = tree.toJson();
+    }
+
+    std::vector<std::string> parents;
+    if (!parentCommitId.empty() && parentCommitId != "null")
+    {
+        parents.push_back(parentCommitId);
+    }
+    parents.insert(parents.end(), mergeParents.begin(), mergeParents.end());
+    std::string timestamp = Utilities::getCurrentTimestamp();
+
+    // Generate the commit ID: random, or the hash of the commit's content when configured
+    std::string commitId;
+    bool commitExists = false;
+    if (readConfig().value("commit_ids", "uuid") == "content")
+    {
+        // An identical commit made elsewhere (e.g. on another branch) is reused; the refs still move to it
+        commitId = Utilities::generateContentId(directoryTree, parents, message, timestamp);
+        commitExists = FileSystem::fileExists(".vcs/commits/" + commitId + ".json");
+    }
+    else
+    {
+        commitId = Utilities::generateUUID();
     }
 
     // Prepare file names and hashes
     std::vector<std::string> fileNames;
-    std::vector<std::string> fileHashes;
+    std::vector<Digest> fileHashes;
 
     for (const auto &entry : std::filesystem::directory_iterator(".vcs/staging/files"))
     {
         if (!entry.is_directory())
             continue; // Only consider directories (file hashes)
 
-        std::string hash = entry.path().filename().string();
+        Digest hash;
+        if (!Digest::fromHex(entry.path().filename().string(), hash))
+            continue; // Staging folders are named by the file's hash; ignore anything else
+
+        VCS_TRACE_SCOPE("commit: store staged object");
         std::string metadataPath = entry.path().string() + "/metadata.json";
-        nlohmann::json metadata = nlohmann::json::parse(FileSystem::readFile(metadataPath));
+        nlohmann::json metadata = FileSystem::readJson(metadataPath);
         std::string filePath = entry.path().string() + "/" + metadata["name"].get<std::string>();
 
         fileNames.push_back(metadata["name"].get<std::string>());
         fileHashes.push_back(hash);
 
         // Create a folder for the hash in `.vcs/data/hash/`
-        std::string hashFolderPath = ".vcs/data/hash/" + hash;
-        FileSystem::createDirectory(hashFolderPath);
+        std::string hashFolderPath = BlobStore::objectPath(hash);
+        bool objectExists = FileSystem::fileExists(hashFolderPath + "/hash.json");
+        if (objectExists)
+        {
+            // Same content is already stored; only its metadata needs updating
+            Stats::add(Counter::ObjectsDeduplicated);
+        }
+        else
+        {
+            FileSystem::createDirectory(hashFolderPath);
+
+            // Copy the file itself into the hash folder (large files are stored as deduplicated chunks)
+            if (!BlobStore::store(filePath, hashFolderPath))
+            {
+                std::error_code ec;
+                std::filesystem::remove_all(hashFolderPath, ec);
+                std::cerr << "Error: Could not store " << metadata["name"].get<std::string>() << "; nothing was committed." << std::endl;
+                return false;
+            }
+            Stats::add(Counter::ObjectsCreated);
+        }
 
         // Save the JSON metadata
+        VCS_TRACE_SCOPE("commit: update hash.json");
         nlohmann::json dataEntry;
         dataEntry["file_name"] = metadata["name"];
         dataEntry["file_hash"] = hash;
         dataEntry["branches"] = {};   // Initialize an empty list of branches
         dataEntry["commit_ids"] = {}; // Initialize an empty list of commit IDs
 
-        if (FileSystem::fileExists(hashFolderPath + "/hash.json"))
+        if (objectExists)
         {
             // Update existing data entry
-            dataEntry = nlohmann::json::parse(FileSystem::readFile(hashFolderPath + "/hash.json"));
+            dataEntry = FileSystem::readJson(hashFolderPath + "/hash.json");
         }
         if (std::find(dataEntry["branches"].begin(), dataEntry["branches"].end(), branchName) == dataEntry["branches"].end())
         {
@@ -185,10 +310,7 @@ void VCSCommands::commit(const std::string &message)
         }
         dataEntry["commit_ids"].push_back(commitId);
 
-        FileSystem::writeFile(hashFolderPath + "/hash.json", dataEntry.dump(4));
-
-        // Copy the file itself into the hash folder
-        FileSystem::copyFile(filePath, hashFolderPath + "/" + metadata["name"].get<std::string>());
+        FileSystem::writeJson(hashFolderPath + "/hash.json", dataEntry);
     }
 
     // Create commit object
@@ -196,56 +318,83 @@ void VCSCommands::commit(const std::string &message)
     commit["commit_id"] = commitId;
     commit["branch_name"] = branchName; // Use the current branch
     commit["parent"] = parentCommitId;
+    commit["parents"] = parents; // All parents, first parent first
     commit["directory_tree"] = directoryTree;
     commit["file_names"] = fileNames;
     commit["file_hashes"] = fileHashes;
     commit["message"] = message;                            // Add commit message
-    commit["timestamp"] = Utilities::getCurrentTimestamp(); // Add timestamp
+    commit["timestamp"] = timestamp;                        // Add timestamp
 
     // Save the commit object
-    std::string commitPath = ".vcs/commits/" + commitId + ".json";
-    FileSystem::writeFile(commitPath, commit.dump(4));
-
-    // Update the branch
-    std::string branchPath = ".vcs/branches/" + branchName + ".json";
-    nlohmann::json branchData;
-    if (FileSystem::fileExists(branchPath))
+    if (!commitExists)
     {
-        branchData = nlohmann::json::parse(FileSystem::readFile(branchPath));
-        branchData["head"] = commitId;
-        branchData["commits"].push_back(commitId);
+        std::string commitPath = ".vcs/commits/" + commitId + ".json";
+        FileSystem::writeJson(commitPath, commit);
+
+        // Record which paths changed relative to the first parent, for `log -- <path>`
+        ChangedPathFilter::build(ChangedPathFilter::changedPaths(parentTree, tree)).save(commitId);
     }
-    else
+
+    // Update the branch and the current branch file together, unless another process moved
+    // either meanwhile (the commit object is then left unreferenced and nothing else changes)
+    std::string error;
+    bool updated = Refs::update({
+        {branchPath, expectedBranchHead, [&](nlohmann::json &branchData) {
+             if (!branchData.contains("commits"))
+             {
+                 branchData["branch_name"] = branchName;
+                 branchData["commits"] = nlohmann::json::array();
+             }
+             branchData["head"] = commitId;
+             branchData["commits"].push_back(commitId);
+         }},
+        {currentBranchPath, expectedCurrentHead, [&](nlohmann::json &currentBranch) {
+             currentBranch["name"] = branchName;
+             currentBranch["head"] = commitId;
+         }},
+    }, error);
+    if (!updated)
     {
-        branchData["branch_name"] = branchName;
-        branchData["head"] = commitId;
-        branchData["commits"] = {commitId};
+        if (Refs::head(branchPath) == commitId && expectedBranchHead != commitId)
+        {
+            // Both heads were checked first, so only a failed write of the second ref gets here
+            std::cerr << "Error: " << error << "; " << branchName << " now points to " << commitId
+                      << " but the current branch file still says " << expectedCurrentHead << "." << std::endl;
+            return false;
+        }
+        std::cerr << "Error: " << error << "; commit " << commitId << " was not recorded." << std::endl;
+        return false;
     }
-    FileSystem::writeFile(branchPath, branchData.dump(4));
-
-    // Update the current branch file
-    nlohmann::json currentBranch;
-    currentBranch["name"] = branchName;
-    currentBranch["head"] = commitId;
-    FileSystem::writeFile(currentBranchPath, currentBranch.dump(4));
 
     // Update the latest commit
     nlohmann::json latestCommit;
     latestCommit["commit_id"] = commitId;
-    latestCommit["timestamp"] = Utilities::getCurrentTimestamp();
-    FileSystem::writeFile(".vcs/latest_commit/latest_commit.json", latestCommit.dump(4));
+    latestCommit["timestamp"] = timestamp;
+    FileSystem::writeJson(".vcs/latest_commit/latest_commit.json", latestCommit);
 
     // Clear the staging area
-    std::filesystem::remove_all(".vcs/staging/files");              // Remove all staged files
+    VCS_TRACE_SCOPE("commit: clear staging");
+    FileSystem::removeAll(".vcs/staging/files");                    // Remove all staged files
     std::filesystem::create_directory(".vcs/staging/files");        // Recreate the directory
-    std::filesystem::remove(".vcs/staging/tree/staging_tree.json"); // Remove tree file
+    FileSystem::removeAll(".vcs/staging/tree/staging_tree.json");   // Remove tree file
 
+    if (commitExists)
+    {
+        std::cout << "Identical commit " << commitId << " already exists; " << branchName << " now points to it." << std::endl;
+    }
     std::cout << "Committed changes with ID: " << commitId << std::endl;
     std::cout << "Branch: " << branchName << " updated. Staging area cleared." << std::endl;
+    return true;
 }
 
-void VCSCommands::branch(const std::string &branchName)
+bool VCSCommands::commit(const std::string &message, const std::vector<std::string> &mergeParents)
 {
+    return commitWorkingTree(message, mergeParents, nullptr);
+}
+
+bool VCSCommands::branch(const std::string &branchName)
+{
+    VCS_TRACE_SCOPE("branch");
     // Path to the current branch metadata file
     std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
 
@@ -253,11 +402,11 @@ void VCSCommands::branch(const std::string &branchName)
     if (!FileSystem::fileExists(currentBranchPath))
     {
         std::cerr << "Error: No repository initialized or no active branch!" << std::endl;
-        return;
+        return false;
     }
 
     // Read the current branch metadata
-    nlohmann::json currentBranch = nlohmann::json::parse(FileSystem::readFile(currentBranchPath));
+    nlohmann::json currentBranch = FileSystem::readJson(currentBranchPath);
     std::string currentBranchName = currentBranch["name"];
     std::string currentBranchHead = currentBranch["head"];
 
@@ -268,11 +417,11 @@ void VCSCommands::branch(const std::string &branchName)
     if (!FileSystem::fileExists(currentBranchDataPath))
     {
         std::cerr << "Error: Current branch data not found in .vcs/branches/!" << std::endl;
-        return;
+        return false;
     }
 
     // Read the current branch data
-    nlohmann::json currentBranchData = nlohmann::json::parse(FileSystem::readFile(currentBranchDataPath));
+    nlohmann::json currentBranchData = FileSystem::readJson(currentBranchDataPath);
 
     // Create a new branch metadata object
     nlohmann::json newBranch;
@@ -285,25 +434,37 @@ void VCSCommands::branch(const std::string &branchName)
     if (FileSystem::fileExists(newBranchPath))
     {
         std::cerr << "Error: Branch \"" << branchName << "\" already exists!" << std::endl;
-        return;
+        return false;
+    }
+    std::string error;
+    if (!Refs::create(newBranchPath, newBranch, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
     }
-    FileSystem::writeFile(newBranchPath, newBranch.dump(4));
 
     // Update `.vcs/current_branch/` to reflect the new active branch
-    nlohmann::json updatedCurrentBranch;
-    updatedCurrentBranch["name"] = branchName;
-    updatedCurrentBranch["head"] = currentBranchHead;
-    FileSystem::writeFile(currentBranchPath, updatedCurrentBranch.dump(4));
+    if (!Refs::update(currentBranchPath, currentBranchHead, [&](nlohmann::json &updatedCurrentBranch) {
+            updatedCurrentBranch["name"] = branchName;
+            updatedCurrentBranch["head"] = currentBranchHead;
+        }, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
 
     std::cout << "Created a new branch: " << branchName << " and set it as the current branch." << std::endl;
+    return true;
 }
 
-void VCSCommands::checkout(const std::string &branchName)
+bool VCSCommands::checkout(const std::string &branchName)
 {
+    VCS_TRACE_SCOPE("checkout");
     try
     {
         // Path to the target branch file
         std::string branchPath = ".vcs/branches/" + branchName + ".json";
+        std::string expectedCurrentHead = Refs::head(".vcs/current_branch/current_branch.json");
 
         // Check if the branch exists
         if (!FileSystem::fileExists(branchPath))
@@ -312,7 +473,7 @@ void VCSCommands::checkout(const std::string &branchName)
         }
 
         // Read the target branch metadata
-        nlohmann::json targetBranch = nlohmann::json::parse(FileSystem::readFile(branchPath));
+        nlohmann::json targetBranch = FileSystem::readJson(branchPath);
 
         if (!targetBranch.contains("head"))
         {
@@ -330,7 +491,7 @@ void VCSCommands::checkout(const std::string &branchName)
         }
 
         // Read the commit metadata
-        nlohmann::json commitData = nlohmann::json::parse(FileSystem::readFile(commitPath));
+        nlohmann::json commitData = FileSystem::readJson(commitPath);
 
         if (!commitData.contains("directory_tree"))
         {
@@ -338,7 +499,7 @@ void VCSCommands::checkout(const std::string &branchName)
         }
 
         // Extract the directory tree
-        auto directoryTree = commitData["directory_tree"];
+        Tree directoryTree = Tree::fromJson(commitData["directory_tree"]);
 
         // Clear the working directory (ignoring .vcs folder)
         for (const auto &entry : std::filesystem::directory_iterator("."))
@@ -346,6 +507,7 @@ void VCSCommands::checkout(const std::string &branchName)
             const auto &path = entry.path().filename().string();
             if (path != ".vcs")
             {
+                VCS_TRACE_SCOPE("checkout: clear worktree entry");
                 try
                 {
                     std::filesystem::remove_all(entry.path());
@@ -357,25 +519,27 @@ void VCSCommands::checkout(const std::string &branchName)
             }
         }
 
-        // Restore files from the commit's directory tree
-        for (const auto &[filePath, fileHash] : directoryTree.items())
+        // Restore files from the commit's directory tree (only the sparse paths, if configured)
+        bool complete = true;
+        SparseCheckout sparse = SparseCheckout::load(".");
+        std::vector<std::pair<std::string, std::string>> restoreJobs; // (hash folder, destination)
+        for (const auto &entry : directoryTree)
         {
-            // Skip .vcs directory entries
-            if (filePath.find(".vcs") != std::string::npos)
-            {
-                continue;
-            }
-
-            std::string fileHashStr = fileHash.get<std::string>();
 
             // Fix the path:
-            std::string normalizedPath = filePath;
+            std::string normalizedPath(entry.path);
             if (normalizedPath.substr(0, 2) == ".\\" || normalizedPath.substr(0, 2) == "./")
             {
                 normalizedPath = normalizedPath.substr(2);
             }
             std::replace(normalizedPath.begin(), normalizedPath.end(), '\\', '/');
 
+            // Skip .vcs directory entries and paths outside the sparse checkout
+            if (normalizedPath == ".vcs" || normalizedPath.starts_with(".vcs/") || !sparse.includes(normalizedPath))
+            {
+                continue;
+            }
+
             // First ensure parent directory exists
             auto parentPath = std::filesystem::path(normalizedPath).parent_path();
             if (!parentPath.empty())
@@ -383,34 +547,22 @@ void VCSCommands::checkout(const std::string &branchName)
                 std::filesystem::create_directories(parentPath);
             }
 
-            std::string hashDirPath = ".vcs/data/hash/" + fileHashStr;
-            try
+            restoreJobs.emplace_back(BlobStore::objectPath(entry.digest), normalizedPath);
+        }
+
+        // Blobs are read and written in batches rather than one blocking copy per file
+        {
+            VCS_TRACE_SCOPE("checkout: restore files");
+            std::vector<bool> restored = BlobStore::restoreMany(restoreJobs);
+            for (size_t i = 0; i < restoreJobs.size(); ++i)
             {
-                for (const auto &entry : std::filesystem::directory_iterator(hashDirPath))
+                if (!restored[i])
                 {
-                    if (entry.is_regular_file() && entry.path().filename() != "hash.json")
-                    {
-                        std::ifstream srcFile(entry.path(), std::ios::binary);
-                        if (!srcFile.is_open())
-                        {
-                            throw std::runtime_error("Could not open source file: " + entry.path().string());
-                        }
-
-                        std::ofstream dstFile(normalizedPath, std::ios::binary | std::ios::trunc);
-                        if (!dstFile.is_open())
-                        {
-                            throw std::runtime_error("Could not create destination file: " + normalizedPath);
-                        }
-
-                        dstFile << srcFile.rdbuf();
-                        std::cout << "Restored: " << normalizedPath << std::endl;
-                        break;
-                    }
+                    std::cerr << "Error: Failed to restore file " << restoreJobs[i].second << std::endl;
+                    complete = false;
+                    continue;
                 }
-            }
-            catch (const std::exception &e)
-            {
-                // std::cerr << "Warning: Failed to restore file " << normalizedPath << ": " << e.what() << std::endl;
+                std::cout << "Restored: " << restoreJobs[i].second << std::endl;
             }
         }
 
@@ -434,27 +586,39 @@ void VCSCommands::checkout(const std::string &branchName)
         }
 
         // Update current branch metadata
-        nlohmann::json currentBranch;
-        currentBranch["name"] = branchName;
-        currentBranch["head"] = commitId;
-
-        FileSystem::writeFile(".vcs/current_branch/current_branch.json", currentBranch.dump(4));
+        std::string error;
+        if (!Refs::update(".vcs/current_branch/current_branch.json", expectedCurrentHead, [&](nlohmann::json &currentBranch) {
+                currentBranch["name"] = branchName;
+                currentBranch["head"] = commitId;
+            }, error))
+        {
+            throw std::runtime_error(error);
+        }
 
+        if (!complete)
+        {
+            // The working tree is already replaced, so the branch still switches
+            std::cerr << "Error: Switched to branch '" << branchName << "', but some files could not be restored." << std::endl;
+            return false;
+        }
         std::cout << "Successfully switched to branch '" << branchName << "'" << std::endl;
+        return true;
     }
     catch (const std::exception &e)
     {
         std::cerr << "Error during checkout: " << e.what() << std::endl;
-        throw;
+        return false;
     }
 }
 
 void VCSCommands::revert(const std::string &commitId)
 {
+    VCS_TRACE_SCOPE("revert");
     try
     {
         // Path to the target commit file
         std::string commitPath = ".vcs/commits/" + commitId + ".json";
+        std::string expectedCurrentHead = Refs::head(".vcs/current_branch/current_branch.json");
 
         // Check if the commit exists
         if (!FileSystem::fileExists(commitPath))
@@ -463,7 +627,7 @@ void VCSCommands::revert(const std::string &commitId)
         }
 
         // Read the target commit metadata
-        nlohmann::json commitData = nlohmann::json::parse(FileSystem::readFile(commitPath));
+        nlohmann::json commitData = FileSystem::readJson(commitPath);
 
         if (!commitData.contains("directory_tree"))
         {
@@ -471,7 +635,7 @@ void VCSCommands::revert(const std::string &commitId)
         }
 
         // Extract the directory tree
-        auto directoryTree = commitData["directory_tree"];
+        Tree directoryTree = Tree::fromJson(commitData["directory_tree"]);
 
         // Clear the working directory (ignoring .vcs folder)
         for (const auto &entry : std::filesystem::directory_iterator("."))
@@ -479,6 +643,7 @@ void VCSCommands::revert(const std::string &commitId)
             const auto &path = entry.path().filename().string();
             if (path != ".vcs")
             {
+                VCS_TRACE_SCOPE("revert: clear worktree entry");
                 try
                 {
                     std::filesystem::remove_all(entry.path());
@@ -490,25 +655,26 @@ void VCSCommands::revert(const std::string &commitId)
             }
         }
 
-        // Restore files from the commit's directory tree
-        for (const auto &[filePath, fileHash] : directoryTree.items())
+        // Restore files from the commit's directory tree (only the sparse paths, if configured)
+        SparseCheckout sparse = SparseCheckout::load(".");
+        std::vector<std::pair<std::string, std::string>> restoreJobs; // (hash folder, destination)
+        for (const auto &entry : directoryTree)
         {
-            // Skip .vcs directory entries
-            if (filePath.find(".vcs") != std::string::npos)
-            {
-                continue;
-            }
-
-            std::string fileHashStr = fileHash.get<std::string>();
 
             // Fix the path:
-            std::string normalizedPath = filePath;
+            std::string normalizedPath(entry.path);
             if (normalizedPath.substr(0, 2) == ".\\" || normalizedPath.substr(0, 2) == "./")
             {
                 normalizedPath = normalizedPath.substr(2);
             }
             std::replace(normalizedPath.begin(), normalizedPath.end(), '\\', '/');
 
+            // Skip .vcs directory entries and paths outside the sparse checkout
+            if (normalizedPath == ".vcs" || normalizedPath.starts_with(".vcs/") || !sparse.includes(normalizedPath))
+            {
+                continue;
+            }
+
             // First ensure parent directory exists
             auto parentPath = std::filesystem::path(normalizedPath).parent_path();
             if (!parentPath.empty())
@@ -516,37 +682,24 @@ void VCSCommands::revert(const std::string &commitId)
                 std::filesystem::create_directories(parentPath);
             }
 
-            std::string hashDirPath = ".vcs/data/hash/" + fileHashStr;
-            try
+            restoreJobs.emplace_back(BlobStore::objectPath(entry.digest), normalizedPath);
+        }
+
+        // Blobs are read and written in batches rather than one blocking copy per file
+        {
+            VCS_TRACE_SCOPE("revert: restore files");
+            std::vector<bool> restored = BlobStore::restoreMany(restoreJobs);
+            for (size_t i = 0; i < restoreJobs.size(); ++i)
             {
-                for (const auto &entry : std::filesystem::directory_iterator(hashDirPath))
+                if (!restored[i])
                 {
-                    if (entry.is_regular_file() && entry.path().filename() != "hash.json")
-                    {
-                        std::ifstream srcFile(entry.path(), std::ios::binary);
-                        if (!srcFile.is_open())
-                        {
-                            // throw std::runtime_error("Could not open source file: " + entry.path().string());
-                        }
-
-                        std::ofstream dstFile(normalizedPath, std::ios::binary | std::ios::trunc);
-                        if (!dstFile.is_open())
-                        {
-                            // throw std::runtime_error("Could not create destination file: " + normalizedPath);
-                        }
-
-                        dstFile << srcFile.rdbuf();
-                        std::cout << "Restored: " << normalizedPath << std::endl;
-
-                        // Stage the restored file
-                        VCSCommands::add(normalizedPath);
-                        break;
-                    }
+                    // std::cerr << "Warning: Failed to restore file " << restoreJobs[i].second << std::endl;
+                    continue;
                 }
-            }
-            catch (const std::exception &e)
-            {
-                // std::cerr << "Warning: Failed to restore file " << normalizedPath << ": " << e.what() << std::endl;
+                std::cout << "Restored: " << restoreJobs[i].second << std::endl;
+
+                // Stage the restored file
+                VCSCommands::add(restoreJobs[i].second);
             }
         }
 
@@ -571,11 +724,13 @@ void VCSCommands::revert(const std::string &commitId)
         std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
         if (FileSystem::fileExists(currentBranchPath))
         {
-            nlohmann::json currentBranch = nlohmann::json::parse(FileSystem::readFile(currentBranchPath));
-            currentBranch["head"] = commitId;
-
-            // Save the updated branch data back to the file
-            FileSystem::writeFile(currentBranchPath, currentBranch.dump(4));
+            std::string error;
+            if (!Refs::update(currentBranchPath, expectedCurrentHead, [&](nlohmann::json &currentBranch) {
+                    currentBranch["head"] = commitId;
+                }, error))
+            {
+                throw std::runtime_error(error);
+            }
             std::cout << "Updated current branch head to commit '" << commitId << "'." << std::endl;
         }
 
@@ -588,170 +743,250 @@ void VCSCommands::revert(const std::string &commitId)
     }
 }
 
-void VCSCommands::merge(const std::string &sourceBranch)
+// Why a merge conflict is one, for the error message
+static std::string describeConflict(const MergeEntry &change)
 {
-    // Paths to branch metadata
-    std::string sourceBranchPath = ".vcs/branches/" + sourceBranch + ".json";
-    std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
-
-    // Validate source branch
-    if (!FileSystem::fileExists(sourceBranchPath))
-    {
-        std::cerr << "Error: Branch '" << sourceBranch << "' does not exist!" << std::endl;
-        return;
-    }
+    if (!change.renamedFrom.empty())
+        return "both sides renamed " + change.renamedFrom + ", to different names";
+    if (change.base.isNull())
+        return "added on both sides";
+    if (change.ours.isNull())
+        return "deleted here, modified in the source branch";
+    if (change.theirs.isNull())
+        return "modified here, deleted in the source branch";
+    return "modified on both sides";
+}
 
-    // Load branch metadata
-    nlohmann::json sourceBranchData, currentBranchData;
-    try
+// Moves the working tree from `fromTree` (what HEAD has) to `toTree`: only paths that differ are
+// written or removed, and nothing is touched if that would overwrite local edits. Paths outside a
+// sparse checkout are left alone.
+static bool updateWorkingTree(Repository &repository, const Tree &fromTree, const Tree &toTree, const std::string &operation,
+                              const std::string &restoredLabel)
+{
+    SparseCheckout sparse = SparseCheckout::load(".");
+    Tree workingTree = repository.workingTree();
+    std::vector<std::pair<std::string, std::string>> restoreJobs; // (hash folder, destination)
+    std::vector<std::string> removals;
+    auto current = fromTree.begin();
+    auto merged = toTree.begin();
+    while (current != fromTree.end() || merged != toTree.end())
     {
-        // Read source branch JSON file
-        std::ifstream sourceFile(sourceBranchPath);
-        if (!sourceFile)
+        const Digest *ourDigest = nullptr;
+        const Digest *mergedDigest = nullptr;
+        std::string_view key;
+        if (merged == toTree.end() || (current != fromTree.end() && (*current).path < (*merged).path))
         {
-            std::cerr << "Error: Could not open source branch file: " << sourceBranchPath << std::endl;
-            return;
+            key = (*current).path;
+            ourDigest = &(*current).digest;
+            ++current;
         }
-        sourceFile >> sourceBranchData; // Parse directly into JSON object
-        sourceFile.close();
-
-        // Read current branch JSON file
-        std::ifstream currentFile(currentBranchPath);
-        if (!currentFile)
+        else if (current == fromTree.end() || (*merged).path < (*current).path)
         {
-            std::cerr << "Error: Could not open current branch file: " << currentBranchPath << std::endl;
-            return;
+            key = (*merged).path;
+            mergedDigest = &(*merged).digest;
+            ++merged;
+        }
+        else
+        {
+            key = (*current).path;
+            ourDigest = &(*current).digest;
+            mergedDigest = &(*merged).digest;
+            ++current;
+            ++merged;
+            if (*ourDigest == *mergedDigest)
+            {
+                continue;
+            }
         }
-        currentFile >> currentBranchData; // Parse directly into JSON object
-        currentFile.close();
-    }
-    catch (const nlohmann::json::parse_error &e)
-    {
-        std::cerr << "JSON Parse Error: " << e.what() << std::endl;
-        return;
-    }
-    catch (const std::exception &e)
-    {
-        std::cerr << "File Handling Error: " << e.what() << std::endl;
-        return;
-    }
-
-    // Check if 'vcs.exe' is present in directory tree and skip its comparison
-
-    nlohmann::json sourceTree = sourceBranchData["directory_tree"];
-    nlohmann::json currentTree = currentBranchData["directory_tree"];
 
-    // Remove `vcs.exe` from comparison if it exists in either branch
-    for (auto it = sourceTree.begin(); it != sourceTree.end();)
-    {
-        if (it.key() == "./vcs.exe")
+        std::string path(key.starts_with("./") ? key.substr(2) : key);
+        if (!sparse.includes(path))
+        {
+            continue;
+        }
+        const Digest *local = workingTree.find(key);
+        if (ourDigest ? (!local || *local != *ourDigest) : local != nullptr)
         {
-            it = sourceTree.erase(it); // Remove `vcs.exe` from the source branch tree
+            std::cerr << "Error: Local changes to " << path << " would be overwritten by the " << operation << "; commit them first." << std::endl;
+            return false;
         }
-        else
+        if (!mergedDigest)
         {
-            ++it;
+            removals.push_back(path);
+            continue;
         }
+        std::string hashFolder = BlobStore::objectPath(*mergedDigest);
+        if (!FileSystem::fileExists(hashFolder + "/hash.json"))
+        {
+            std::cerr << "Error: The stored object for " << path << " is missing; " << operation << " aborted." << std::endl;
+            return false;
+        }
+        restoreJobs.emplace_back(hashFolder, path);
     }
 
-    for (auto it = currentTree.begin(); it != currentTree.end();)
+    VCS_TRACE_SCOPE("update working tree");
+    for (const auto &path : removals)
+    {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::cout << "Removing file: " << path << std::endl;
+    }
+    for (const auto &[hashFolder, path] : restoreJobs)
     {
-        if (it.key() == "./vcs.exe")
+        auto parentPath = std::filesystem::path(path).parent_path();
+        if (!parentPath.empty())
         {
-            it = currentTree.erase(it); // Remove `vcs.exe` from the current branch tree
+            std::filesystem::create_directories(parentPath);
         }
-        else
+    }
+    std::vector<bool> restored = BlobStore::restoreMany(restoreJobs);
+    for (size_t i = 0; i < restoreJobs.size(); ++i)
+    {
+        if (!restored[i])
         {
-            ++it;
+            std::cerr << "Error: Could not restore " << restoreJobs[i].second << "; " << operation << " aborted." << std::endl;
+            return false;
         }
+        std::cout << restoredLabel << restoreJobs[i].second << std::endl;
     }
+    return true;
+}
 
-    std::string sourceHead = sourceBranchData["head"];
-    std::string currentHead = currentBranchData["head"];
-    std::string currentBranchName = currentBranchData["name"];
+bool VCSCommands::merge(const std::string &sourceBranch)
+{
+    VCS_TRACE_SCOPE("merge");
+    Repository &repository = Repository::active();
 
-    // Check if branches are already merged
-    if (sourceHead == currentHead)
+    // Validate source branch
+    if (!FileSystem::fileExists(".vcs/branches/" + sourceBranch + ".json"))
     {
-        std::cout << "Branches are already merged." << std::endl;
-        return;
+        std::cerr << "Error: Branch '" << sourceBranch << "' does not exist!" << std::endl;
+        return false;
+    }
+    std::string currentBranchName = repository.currentBranch();
+    if (currentBranchName.empty())
+    {
+        std::cerr << "Error: No repository initialized or no active branch!" << std::endl;
+        return false;
     }
 
-    // Paths to commit metadata
-    std::string sourceCommitPath = ".vcs/commits/" + sourceHead + ".json";
-    std::string currentCommitPath = ".vcs/commits/" + currentHead + ".json";
-
-    // Validate commits
-    if (!FileSystem::fileExists(sourceCommitPath) || !FileSystem::fileExists(currentCommitPath))
+    std::string sourceHead = repository.branchHead(sourceBranch);
+    std::string currentHead = repository.head();
+    if (sourceHead.empty())
     {
-        std::cerr << "Error: Commit metadata for one of the branches is missing!" << std::endl;
-        return;
+        std::cout << "Branch '" << sourceBranch << "' has no commits; nothing to merge." << std::endl;
+        return true;
     }
 
-    // Load commit metadata
-    nlohmann::json sourceCommitData = nlohmann::json::parse(FileSystem::readFile(sourceCommitPath));
-    nlohmann::json currentCommitData = nlohmann::json::parse(FileSystem::readFile(currentCommitPath));
+    // Check if branches are already merged
+    std::string baseId = MergeHandler::mergeBase(currentHead, sourceHead);
+    if (sourceHead == currentHead || baseId == sourceHead)
+    {
+        std::cout << "Branches are already merged." << std::endl;
+        return true;
+    }
 
-    // Merge directory trees
-    nlohmann::json mergedTree = currentTree;
-    bool conflictDetected = false;
+    // Three-way merge of the heads against their merge base; `vcs.exe` is never merged
+    VCS_TRACE_SCOPE("merge: compare trees");
+    Tree baseTree = repository.commitTree(baseId);
+    Tree currentTree = repository.commitTree(currentHead);
+    Tree sourceTree = repository.commitTree(sourceHead);
+    for (Tree *tree : {&baseTree, &currentTree, &sourceTree})
+    {
+        tree->erase("./vcs.exe");
+    }
+    std::vector<Rename> renames;
+    TreeMergeResult result = MergeHandler::mergeTreesFollowingRenames(baseTree, currentTree, sourceTree, renames);
+    for (const auto &rename : renames)
+    {
+        std::cout << "Following rename: " << rename.from << " -> " << rename.to << " (" << rename.similarity << "% similar)" << std::endl;
+    }
 
-    // First pass: Check for conflicts and add files from source
-    for (const auto &[filePath, sourceHash] : sourceTree.items())
+    // Abort merge if conflicts detected
+    if (result.conflicts > 0)
     {
-        // If file exists in both branches
-        if (currentTree.find(filePath) != currentTree.end())
+        for (const auto &change : result.changes)
         {
-            // Compare hashes to detect changes
-            if (currentTree[filePath] != sourceHash)
+            if (change.action == MergeAction::Conflict)
             {
-                conflictDetected = true;
-                std::cerr << "Conflict detected in file: " << filePath << std::endl;
+                std::cerr << "Conflict detected in file: " << change.path << " (" << describeConflict(change) << ")" << std::endl;
             }
         }
-        else
-        {
-            // File only in source branch - add it
-            mergedTree[filePath] = sourceHash;
-            std::cout << "Adding file from source branch: " << filePath << std::endl;
-        }
+        std::cerr << "Merge aborted due to conflicts. Resolve them manually." << std::endl;
+        return false;
     }
 
-    // Second pass: Add files that are only in current branch (already in mergedTree)
-    for (const auto &[filePath, currentHash] : currentTree.items())
-    {
-        if (sourceTree.find(filePath) == sourceTree.end())
-        {
-            // File only in current branch - keep it (already in mergedTree)
-            std::cout << "Keeping file from current branch: " << filePath << std::endl;
-        }
-    }
-    // Abort merge if conflicts detected
-    if (conflictDetected)
+    // Whatever differs between our head and the merge result goes into the working tree, unless
+    // that would overwrite local edits; paths outside a sparse checkout are taken from the merge
+    // result at commit time
+    if (!updateWorkingTree(repository, currentTree, result.tree, "merge", "Merged file: "))
     {
-        std::cerr << "Merge aborted due to conflicts. Resolve them manually." << std::endl;
-        return;
+        return false;
     }
 
-    // Write merged directory tree to the staging area
-    for (const auto &[filePath, fileHash] : mergedTree.items())
+    // Stage whatever the object store does not have yet (local edits the merge commit will carry)
+    VCS_TRACE_SCOPE("merge: stage and commit");
+    Tree workingTree = repository.workingTree();
+    for (const auto &[filePath, fileHash] : workingTree)
     {
-        add(filePath); // Staging files for commit
+        if (!FileSystem::fileExists(BlobStore::objectPath(fileHash) + "/hash.json"))
+        {
+            stageFile(std::string(filePath.starts_with("./") ? filePath.substr(2) : filePath), fileHash);
+        }
     }
+    saveStagingTree(workingTree);
 
     // Commit the merge
     std::string mergeMessage = "Merged branch '" + sourceBranch + "' into '" + currentBranchName + "'";
-    commit(mergeMessage);
-
-    // Update current branch metadata
-    currentBranchData["head"] = sourceHead;
-    FileSystem::writeFile(currentBranchPath, currentBranchData.dump(4));
+    if (!commitWorkingTree(mergeMessage, {sourceHead}, &result.tree)) // Record the source head as the second parent
+    {
+        std::cerr << "Error: The merge result is in the working tree but was not committed." << std::endl;
+        return false;
+    }
 
     std::cout << "Successfully merged branch '" << sourceBranch << "' into the current branch." << std::endl;
+    return true;
+}
+
+// Whether a commit changed `path` (a file or a directory) relative to its first parent.
+// The commit's Bloom filter answers most "no"s without reading anything else; commits that
+// predate filters get one computed and saved here.
+static bool commitTouchesPath(const std::string &commitId, const std::string &path)
+{
+    ChangedPathFilter filter;
+    bool hasFilter = ChangedPathFilter::load(commitId, filter);
+    if (hasFilter)
+    {
+        Stats::add(Counter::BloomChecks);
+        if (!filter.mightContain(path))
+        {
+            Stats::add(Counter::BloomNegatives);
+            return false;
+        }
+    }
+
+    Repository &repository = Repository::active();
+    auto commit = repository.commit(commitId);
+    if (!commit)
+    {
+        return false;
+    }
+    std::vector<std::string> changed = ChangedPathFilter::changedPaths(readCommitTree(commit->firstParent()), commit->tree);
+    if (!hasFilter)
+    {
+        ChangedPathFilter::build(changed).save(commitId);
+    }
+    bool touched = std::binary_search(changed.begin(), changed.end(), path);
+    if (hasFilter && !touched)
+    {
+        Stats::add(Counter::BloomFalsePositives);
+    }
+    return touched;
 }
 
-void VCSCommands::log()
+void VCSCommands::log(const std::string &path)
 {
+    VCS_TRACE_SCOPE("log");
     // Path to the current branch metadata
     std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
 
@@ -762,7 +997,7 @@ void VCSCommands::log()
     }
 
     // Read the current branch information
-    nlohmann::json currentBranch = nlohmann::json::parse(FileSystem::readFile(currentBranchPath));
+    nlohmann::json currentBranch = FileSystem::readJson(currentBranchPath);
     std::string branchName = currentBranch["name"];
 
     // Path to the branch file
@@ -775,7 +1010,7 @@ void VCSCommands::log()
     }
 
     // Read the branch data
-    nlohmann::json branchData = nlohmann::json::parse(FileSystem::readFile(branchPath));
+    nlohmann::json branchData = FileSystem::readJson(branchPath);
 
     if (!branchData.contains("commits") || branchData["commits"].empty())
     {
@@ -789,6 +1024,7 @@ void VCSCommands::log()
 
     std::cout << "Commit history for branch: " << branchName << std::endl;
 
+    std::string pathspec = SparseCheckout::normalize(path);
     for (const std::string &commitId : commitIds)
     {
         // Path to the commit file
@@ -800,12 +1036,23 @@ void VCSCommands::log()
             continue;
         }
 
-        // Read the commit metadata
-        nlohmann::json commitData = nlohmann::json::parse(FileSystem::readFile(commitPath));
+        // With a pathspec, only commits that changed something at or below it
+        if (!pathspec.empty() && !commitTouchesPath(commitId, pathspec))
+        {
+            continue;
+        }
+
+        // Read the commit metadata (already parsed if the pathspec check needed it)
+        auto commit = Repository::active().commit(commitId);
+        if (!commit)
+        {
+            std::cout << "Warning: Commit metadata unreadable for commit ID: " << commitId << std::endl;
+            continue;
+        }
 
         // Extract details
-        std::string timestamp = commitData.value("timestamp", "Unknown");
-        std::string message = commitData.value("message", "No message");
+        std::string timestamp = commit->timestamp.empty() ? "Unknown" : commit->timestamp;
+        std::string message = commit->message.empty() ? "No message" : commit->message;
 
         // Print commit details
         std::cout << "Commit ID: " << commitId << std::endl;
@@ -815,14 +1062,614 @@ void VCSCommands::log()
     }
 }
 
-void VCSCommands::graph()
+void VCSCommands::graph(const std::string &tip, size_t limit)
 {
+    VCS_TRACE_SCOPE("graph");
     CommitGraph graph;
     graph.buildGraph(".vcs"); // Build the commit graph
-    graph.displayGraph();     // Display the graph
+
+    GraphRange range;
+    range.tip = tip;
+    range.limit = limit;
+    graph.writeAscii(std::cout, range); // Display the graph
 
     std::ofstream dotFile("commit_graph.dot");
-    dotFile << graph.exportToDOT();
+    graph.exportToDOT(dotFile, range);
     dotFile.close();
     std::cout << "Graph exported to 'commit_graph.dot'. Use Graphviz to visualize.\n";
-}
\ No newline at end of file
+}
+
+void VCSCommands::sparse(const std::string &action, const std::vector<std::string> &paths)
+{
+    VCS_TRACE_SCOPE("sparse");
+    SparseCheckout current = SparseCheckout::load(".");
+    if (action == "list")
+    {
+        if (!current.enabled())
+        {
+            std::cout << "Sparse checkout is disabled; the whole tree is checked out." << std::endl;
+        }
+        for (const auto &prefix : current.paths())
+        {
+            std::cout << prefix << std::endl;
+        }
+        return;
+    }
+
+    std::vector<std::string> prefixes;
+    if (action == "add")
+    {
+        prefixes = current.paths();
+        prefixes.insert(prefixes.end(), paths.begin(), paths.end());
+    }
+    else if (action == "set")
+    {
+        prefixes = paths;
+    }
+    else if (action != "disable")
+    {
+        std::cerr << "Error: Unknown sparse action '" << action << "' (expected set, add, list or disable)." << std::endl;
+        return;
+    }
+    SparseCheckout updated(prefixes);
+
+    nlohmann::json config = readConfig();
+    if (updated.enabled())
+    {
+        config["sparse_paths"] = updated.paths();
+    }
+    else
+    {
+        config.erase("sparse_paths");
+    }
+    FileSystem::writeJson(".vcs/config.json", config);
+
+    // Bring the working tree in line with the new selection, using the current head commit
+    std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
+    std::string head = FileSystem::fileExists(currentBranchPath) ? FileSystem::readJson(currentBranchPath).value("head", "") : "";
+    std::string commitPath = ".vcs/commits/" + head + ".json";
+    if (head.empty() || !FileSystem::fileExists(commitPath))
+    {
+        std::cout << "Sparse checkout updated." << std::endl;
+        return;
+    }
+    Tree headTree = Tree::fromJson(FileSystem::readJson(commitPath)["directory_tree"]);
+
+    std::vector<std::pair<std::string, std::string>> restoreJobs; // (hash folder, destination)
+    size_t removed = 0;
+    for (const auto &[path, digest] : headTree)
+    {
+        std::string relative = SparseCheckout::normalize(path);
+        bool onDisk = std::filesystem::exists(relative);
+        if (updated.includes(relative) && !onDisk)
+        {
+            auto parentPath = std::filesystem::path(relative).parent_path();
+            if (!parentPath.empty())
+            {
+                std::filesystem::create_directories(parentPath);
+            }
+            restoreJobs.emplace_back(BlobStore::objectPath(digest), relative);
+        }
+        else if (!updated.includes(relative) && onDisk)
+        {
+            // Only drop files that still match the commit; local edits are kept
+            if (FileSystem::calculateHash(relative) != digest)
+            {
+                std::cout << "Keeping modified file outside the sparse checkout: " << relative << std::endl;
+                continue;
+            }
+            std::filesystem::remove(relative);
+            removed++;
+
+            // Remove directories the removal left empty
+            std::error_code ec;
+            for (auto dir = std::filesystem::path(relative).parent_path(); !dir.empty(); dir = dir.parent_path())
+            {
+                if (!std::filesystem::is_empty(dir, ec) || !std::filesystem::remove(dir, ec))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<bool> restored = BlobStore::restoreMany(restoreJobs);
+    size_t restoredCount = std::count(restored.begin(), restored.end(), true);
+    std::cout << "Sparse checkout updated: " << restoredCount << " file(s) restored, " << removed << " removed." << std::endl;
+}
+
+bool VCSCommands::archive(const std::string &revision, const std::string &outputPath, const std::string &prefix, bool gzip)
+{
+    VCS_TRACE_SCOPE("archive");
+    // Accept a branch name or a commit ID
+    std::string commitId = revision;
+    std::string branchPath = ".vcs/branches/" + revision + ".json";
+    if (FileSystem::fileExists(branchPath))
+    {
+        commitId = FileSystem::readJson(branchPath).value("head", "");
+    }
+    std::string commitPath = ".vcs/commits/" + commitId + ".json";
+    if (commitId.empty() || !FileSystem::fileExists(commitPath))
+    {
+        std::cerr << "Error: '" << revision << "' is neither a branch nor a commit!" << std::endl;
+        return false;
+    }
+    if (gzip && !Archive::gzipAvailable())
+    {
+        std::cerr << "Error: This build has no gzip support (zlib was not found)." << std::endl;
+        return false;
+    }
+
+    nlohmann::json commitData = FileSystem::readJson(commitPath);
+    Tree tree = Tree::fromJson(commitData["directory_tree"]);
+
+    ArchiveOptions options;
+    options.prefix = prefix;
+    options.gzip = gzip;
+    if (!options.prefix.empty() && !options.prefix.ends_with("/"))
+    {
+        options.prefix += "/";
+    }
+    // Every member gets the commit's time, so archives of one commit are byte-identical
+    std::tm commitTime{};
+    std::istringstream timestamp(commitData.value("timestamp", ""));
+    timestamp >> std::get_time(&commitTime, "%Y-%m-%d %H:%M:%S");
+    if (!timestamp.fail())
+    {
+        commitTime.tm_isdst = -1;
+        options.mtime = static_cast<int64_t>(std::mktime(&commitTime));
+    }
+
+    bool toStdout = outputPath.empty() || outputPath == "-";
+    std::ofstream file;
+    if (!toStdout)
+    {
+        file.open(outputPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cerr << "Error: Could not open " << outputPath << " for writing!" << std::endl;
+            return false;
+        }
+    }
+    bool ok = Archive::write(tree, toStdout ? std::cout : file, options);
+    if (!ok)
+    {
+        std::cerr << "Error: Archive of " << commitId << " is incomplete (missing objects or write failure)." << std::endl;
+        return false;
+    }
+    if (!toStdout)
+    {
+        std::cout << "Archived " << tree.size() << " file(s) of commit " << commitId << " to " << outputPath << std::endl;
+    }
+    return true;
+}
+
+void VCSCommands::blame(const std::string &filePath, const std::string &revision)
+{
+    VCS_TRACE_SCOPE("blame");
+    // Default to the checked-out head; otherwise accept a branch name or a commit ID
+    std::string commitId = revision;
+    if (commitId.empty())
+    {
+        std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
+        if (FileSystem::fileExists(currentBranchPath))
+        {
+            commitId = FileSystem::readJson(currentBranchPath).value("head", "");
+        }
+    }
+    else if (FileSystem::fileExists(".vcs/branches/" + revision + ".json"))
+    {
+        commitId = FileSystem::readJson(".vcs/branches/" + revision + ".json").value("head", "");
+    }
+    if (commitId.empty())
+    {
+        std::cerr << "Error: No commits to blame." << std::endl;
+        return;
+    }
+
+    std::vector<BlameLine> lines;
+    std::string error;
+    if (!Blame::run(commitId, filePath, lines, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return;
+    }
+
+    size_t width = std::to_string(lines.size()).size();
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        const BlameLine &line = lines[i];
+        std::cout << line.commitId.substr(0, 8) << " (" << line.timestamp << " " << std::setw(static_cast<int>(width))
+                  << i + 1 << ") " << line.text << "\n";
+    }
+    std::cout.flush();
+}
+
+bool VCSCommands::fsck(bool quick)
+{
+    VCS_TRACE_SCOPE("fsck");
+    if (!FileSystem::fileExists(".vcs"))
+    {
+        std::cerr << "Error: Not a repository (no .vcs directory)." << std::endl;
+        return false;
+    }
+    FsckOptions options;
+    options.quick = quick;
+    FsckReport report = Fsck::run(options);
+    for (const auto &error : report.errors)
+    {
+        std::cout << "error: " << error << "\n";
+    }
+    std::cout << "Checked " << report.objects << " objects (" << report.chunks << " chunks), " << report.commits
+              << " commits, " << report.branches << " branches" << (quick ? " (quick: existence and sizes only)" : "")
+              << ": " << (report.ok() ? "no problems found" : std::to_string(report.errors.size()) + " problem(s)")
+              << std::endl;
+    return report.ok();
+}
+
+// One line per branch, like "  master: fast-forward 1a2b3c4d..5e6f7a8b"
+static void reportRefUpdate(const RefUpdate &update, const std::string &note = "")
+{
+    std::cout << "  " << update.branch << ": ";
+    switch (update.kind)
+    {
+    case RefUpdate::Kind::UpToDate:
+        std::cout << "up to date";
+        break;
+    case RefUpdate::Kind::Create:
+        std::cout << "new branch at " << update.newHead.substr(0, 8);
+        break;
+    case RefUpdate::Kind::FastForward:
+        std::cout << "fast-forward " << update.oldHead.substr(0, 8) << ".." << update.newHead.substr(0, 8);
+        break;
+    case RefUpdate::Kind::NonFastForward:
+        std::cout << "rejected (non-fast-forward; merge first)";
+        break;
+    }
+    std::cout << note << std::endl;
+}
+
+static void reportTransfer(const PackSummary &summary)
+{
+    std::cout << "Transferred " << summary.commits << " commits, " << summary.objects << " objects and "
+              << summary.chunks << " chunks (" << summary.bytes << " bytes)." << std::endl;
+}
+
+// Moves local branches as planned; the checked-out branch carries the working tree along, and
+// local edits in the way leave it where it is. False if any branch was rejected or not moved.
+static bool applyRefUpdates(Repository &repository, const std::vector<RefUpdate> &updates, const std::string &operation)
+{
+    std::string currentBranchPath = ".vcs/current_branch/current_branch.json";
+    std::string currentBranchName = repository.currentBranch();
+    if (currentBranchName.empty() && !FileSystem::fileExists(currentBranchPath))
+    {
+        // Nothing committed here yet, so nothing is checked out: the new master (else the first
+        // new branch) becomes the current branch, with its files
+        for (const auto &update : updates)
+        {
+            if (update.kind == RefUpdate::Kind::Create && (currentBranchName.empty() || update.branch == "master"))
+            {
+                currentBranchName = update.branch;
+            }
+        }
+    }
+    std::string error;
+    bool ok = true;
+    for (const auto &update : updates)
+    {
+        bool movable = update.kind == RefUpdate::Kind::Create || update.kind == RefUpdate::Kind::FastForward;
+        if (!movable)
+        {
+            ok = ok && update.kind != RefUpdate::Kind::NonFastForward;
+            reportRefUpdate(update);
+            continue;
+        }
+        bool checkedOut = update.branch == currentBranchName;
+        if (checkedOut && !updateWorkingTree(repository, repository.commitTree(update.oldHead),
+                                             repository.commitTree(update.newHead), operation, "Updated file: "))
+        {
+            std::cout << "  " << update.branch << ": not updated" << std::endl;
+            ok = false;
+            continue;
+        }
+        if (!Remote::updateRef(".", update, error) ||
+            (checkedOut && !Refs::update(currentBranchPath, update.oldHead, [&](nlohmann::json &currentBranch) {
+                 currentBranch["name"] = update.branch;
+                 currentBranch["head"] = update.newHead;
+             }, error)))
+        {
+            std::cout << "  " << update.branch << ": failed (" << error << ")" << std::endl;
+            ok = false;
+            continue;
+        }
+        reportRefUpdate(update, checkedOut ? " (working tree updated)" : "");
+    }
+    return ok;
+}
+
+bool VCSCommands::push(const std::string &path, const std::vector<std::string> &branches)
+{
+    VCS_TRACE_SCOPE("push");
+    std::string remoteRoot = Remote::locate(path);
+    if (remoteRoot.empty())
+    {
+        std::cerr << "Error: '" << path << "' is not a repository; run `vcs init` there first." << std::endl;
+        return false;
+    }
+    if (remoteRoot == Repository::active().root().string())
+    {
+        std::cerr << "Error: Cannot push a repository to itself." << std::endl;
+        return false;
+    }
+    RepositoryLock lock(remoteRoot + "/.vcs", RepositoryLock::Mode::Exclusive, Remote::lockTimeoutMs);
+    if (!lock.acquired())
+    {
+        std::cerr << "Error: " << remoteRoot << " is busy (another command holds its lock); nothing was updated." << std::endl;
+        return false;
+    }
+
+    std::vector<RefUpdate> updates;
+    PackSummary summary;
+    std::string error;
+    if (!Remote::fetch(".", remoteRoot, branches, updates, summary, error))
+    {
+        std::cerr << "Error: " << error << "; nothing was updated in " << remoteRoot << "." << std::endl;
+        return false;
+    }
+    reportTransfer(summary);
+
+    // The branch checked out over there only moves if it has no working tree to fall out of step with
+    Repository remote(remoteRoot);
+    std::string remoteCurrentBranch = remote.currentBranch();
+    bool remoteHasWorkingTree = false;
+    for (const auto &entry : std::filesystem::directory_iterator(remoteRoot))
+    {
+        remoteHasWorkingTree = remoteHasWorkingTree || entry.path().filename() != ".vcs";
+    }
+
+    std::cout << "To " << remoteRoot << ":" << std::endl;
+    bool ok = true;
+    for (const auto &update : updates)
+    {
+        bool movable = update.kind == RefUpdate::Kind::Create || update.kind == RefUpdate::Kind::FastForward;
+        bool checkedOut = update.branch == remoteCurrentBranch;
+        if (movable && checkedOut && remoteHasWorkingTree)
+        {
+            std::cout << "  " << update.branch << ": rejected (checked out in " << remoteRoot << ")" << std::endl;
+            ok = false;
+            continue;
+        }
+        if (movable && !Remote::updateRef(remoteRoot, update, error))
+        {
+            std::cout << "  " << update.branch << ": failed (" << error << ")" << std::endl;
+            ok = false;
+            continue;
+        }
+        if (movable && checkedOut)
+        {
+            Refs::update(remoteRoot + "/.vcs/current_branch/current_branch.json", update.oldHead, [&](nlohmann::json &currentBranch) {
+                currentBranch["head"] = update.newHead;
+            }, error);
+        }
+        ok = ok && update.kind != RefUpdate::Kind::NonFastForward;
+        reportRefUpdate(update);
+    }
+    return ok;
+}
+
+bool VCSCommands::pull(const std::string &path, const std::vector<std::string> &branches)
+{
+    VCS_TRACE_SCOPE("pull");
+    Repository &repository = Repository::active();
+    std::string remoteRoot = Remote::locate(path);
+    if (remoteRoot.empty())
+    {
+        std::cerr << "Error: '" << path << "' is not a repository." << std::endl;
+        return false;
+    }
+    if (remoteRoot == repository.root().string())
+    {
+        std::cerr << "Error: Cannot pull a repository from itself." << std::endl;
+        return false;
+    }
+    RepositoryLock lock(remoteRoot + "/.vcs", RepositoryLock::Mode::Shared, Remote::lockTimeoutMs);
+    if (!lock.acquired())
+    {
+        std::cerr << "Error: " << remoteRoot << " is busy (another command holds its lock); nothing was fetched." << std::endl;
+        return false;
+    }
+
+    std::vector<RefUpdate> updates;
+    PackSummary summary;
+    std::string error;
+    if (!Remote::fetch(remoteRoot, ".", branches, updates, summary, error))
+    {
+        std::cerr << "Error: " << error << "; no branches were updated." << std::endl;
+        return false;
+    }
+    reportTransfer(summary);
+
+    std::cout << "From " << remoteRoot << ":" << std::endl;
+    return applyRefUpdates(repository, updates, "pull");
+}
+
+void VCSCommands::bitmap(size_t spacing)
+{
+    VCS_TRACE_SCOPE("bitmap");
+    Repository &repository = Repository::active();
+    ReachabilityIndex index(repository);
+    std::vector<std::string> selected = index.selectCommits(spacing);
+    size_t written = index.build(selected);
+    std::cout << "Wrote " << written << " bitmaps (" << index.bitmapCount() << " in total for " << selected.size()
+              << " selected commits); " << index.size() << " commits and objects have positions." << std::endl;
+}
+
+void VCSCommands::reachable(const std::vector<std::string> &include, const std::vector<std::string> &exclude, bool countOnly)
+{
+    VCS_TRACE_SCOPE("reachable");
+    Repository &repository = Repository::active();
+    std::vector<std::string> tips[2];
+    for (int side = 0; side < 2; ++side)
+    {
+        for (const auto &revision : side == 0 ? include : exclude)
+        {
+            std::string commitId = repository.resolve(revision);
+            if (commitId.empty())
+            {
+                std::cerr << "Error: '" << revision << "' is neither a branch nor a commit!" << std::endl;
+                return;
+            }
+            tips[side].push_back(commitId);
+        }
+    }
+
+    ReachabilityIndex index(repository);
+    EwahBitmap result = index.reachable(tips[0]);
+    if (!tips[1].empty())
+    {
+        result = result.andNot(index.reachable(tips[1]));
+    }
+    size_t commits = 0;
+    size_t objects = 0;
+    result.forEach([&](uint64_t position) {
+        if (index.isCommit(position))
+        {
+            ++commits;
+            if (!countOnly)
+            {
+                std::cout << "commit " << index.commitId(position) << "\n";
+            }
+        }
+        else
+        {
+            ++objects;
+            if (!countOnly)
+            {
+                std::cout << "object " << index.object(position).hex() << "\n";
+            }
+        }
+    });
+    if (countOnly)
+    {
+        std::cout << commits << " commits, " << objects << " objects" << std::endl;
+    }
+    std::cout.flush();
+}
+
+bool VCSCommands::bundleCreate(const std::string &file, const std::vector<std::string> &branches)
+{
+    VCS_TRACE_SCOPE("bundle create");
+    Repository &repository = Repository::active();
+    std::vector<std::string> names = branches.empty() ? repository.branches() : branches;
+    nlohmann::json refs = nlohmann::json::object();
+    std::vector<std::string> heads;
+    for (const auto &name : names)
+    {
+        std::string branchPath = ".vcs/branches/" + name + ".json";
+        if (!FileSystem::fileExists(branchPath) || repository.branchHead(name).empty())
+        {
+            std::cerr << "Error: Branch '" << name << "' does not exist or has no commits!" << std::endl;
+            return false;
+        }
+        refs[name] = FileSystem::readJson(branchPath);
+        heads.push_back(repository.branchHead(name));
+    }
+
+    // Everything the heads reach, each commit and object once (bitmaps make this cheap)
+    ReachabilityIndex index(repository);
+    std::vector<std::string> commits;
+    std::vector<Digest> objects;
+    index.reachable(heads).forEach([&](uint64_t position) {
+        if (index.isCommit(position))
+        {
+            commits.push_back(index.commitId(position));
+        }
+        else
+        {
+            objects.push_back(index.object(position));
+        }
+    });
+
+    bool toStdout = file == "-";
+    std::ofstream out;
+    if (!toStdout)
+    {
+        out.open(file, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cerr << "Error: Cannot write " << file << std::endl;
+            return false;
+        }
+    }
+    PackSummary summary;
+    std::string error;
+    if (!Pack::write(toStdout ? std::cout : out, ".", refs, commits, objects, [](const Digest &) { return false; }, summary, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    (toStdout ? std::cerr : std::cout) << "Bundled " << refs.size() << " branches: " << summary.commits << " commits, "
+                                       << summary.objects << " objects and " << summary.chunks << " chunks ("
+                                       << summary.bytes << " bytes)." << std::endl;
+    return true;
+}
+
+bool VCSCommands::unbundle(const std::string &file)
+{
+    VCS_TRACE_SCOPE("unbundle");
+    Repository &repository = Repository::active();
+    if (!repository.exists())
+    {
+        std::cerr << "Error: Not a repository; run `vcs init` first." << std::endl;
+        return false;
+    }
+    std::ifstream in;
+    if (file != "-")
+    {
+        in.open(file, std::ios::binary);
+        if (!in)
+        {
+            std::cerr << "Error: Cannot read " << file << std::endl;
+            return false;
+        }
+    }
+    nlohmann::json refs;
+    PackSummary summary;
+    std::string error;
+    if (!Pack::read(file == "-" ? std::cin : in, ".", refs, summary, error))
+    {
+        std::cerr << "Error: " << error << "; no branches were updated." << std::endl;
+        return false;
+    }
+    std::cout << "Unbundled " << summary.commits << " commits, " << summary.objects << " objects and " << summary.chunks
+              << " chunks (" << summary.bytes << " bytes)." << std::endl;
+
+    // Every bundled commit is here now, so ancestry is checked locally
+    std::vector<RefUpdate> updates;
+    for (const auto &[name, branch] : refs.items())
+    {
+        RefUpdate update;
+        update.branch = name;
+        update.ref = branch;
+        update.newHead = branch.value("head", "");
+        update.oldHead = repository.branchHead(name);
+        if (update.newHead.empty() || update.newHead == update.oldHead)
+        {
+            update.kind = RefUpdate::Kind::UpToDate;
+        }
+        else if (update.oldHead.empty())
+        {
+            update.kind = RefUpdate::Kind::Create;
+        }
+        else if (Remote::isAncestor(repository, update.oldHead, update.newHead))
+        {
+            update.kind = RefUpdate::Kind::FastForward;
+        }
+        else
+        {
+            update.kind = RefUpdate::Kind::NonFastForward;
+        }
+        updates.push_back(std::move(update));
+    }
+    return applyRefUpdates(repository, updates, "unbundle");
+}
@@ -0,0 +1,70 @@
+#include "../include/WorkingTreeIndex.h"
+#include "../include/FileSystem.h"
+#include <filesystem>
+
+void WorkingTreeIndex::beginScan() {
+    scanned.clear();
+    scanned.reserve(entries.size());
+    scanStart = std::filesystem::file_time_type::clock::now().time_since_epoch().count();
+}
+
+const Digest* WorkingTreeIndex::lookup(const std::string& path, uint64_t size, int64_t mtime) {
+    auto it = entries.find(path);
+    if (it == entries.end() || it->second.size != size || it->second.mtime != mtime ||
+        mtime >= scanStart - racyWindowNs) {
+        return nullptr;
+    }
+    return &(scanned[path] = it->second).digest;
+}
+
+void WorkingTreeIndex::record(const std::string& path, uint64_t size, int64_t mtime, const Digest& digest) {
+    if (mtime >= scanStart - racyWindowNs) return; // Hashed again next time
+    scanned[path] = Entry{size, mtime, digest};
+    dirty = true;
+}
+
+void WorkingTreeIndex::finishScan() {
+    // Anything not seen this time was deleted, changed or is now ignored
+    dirty = dirty || scanned.size() != entries.size();
+    entries.swap(scanned);
+    scanned.clear();
+}
+
+bool WorkingTreeIndex::load(const std::string& indexPath) {
+    entries.clear();
+    dirty = false;
+    if (!FileSystem::fileExists(indexPath)) return false;
+    nlohmann::json data;
+    try {
+        data = FileSystem::readJson(indexPath);
+    } catch (const nlohmann::json::exception&) {
+        return false; // Rebuilt by the next scan
+    }
+    if (!data.is_object() || !data.contains("version") || data["version"] != 1 || !data.contains("entries") ||
+        !data["entries"].is_object()) {
+        return false;
+    }
+    entries.reserve(data["entries"].size());
+    for (const auto& [path, value] : data["entries"].items()) {
+        // [size, mtime, digest]; anything else is skipped and rehashed by the next scan
+        if (!value.is_array() || value.size() != 3 || !value[0].is_number_unsigned() || !value[1].is_number_integer() ||
+            !value[2].is_string()) {
+            continue;
+        }
+        Entry entry{value[0].get<uint64_t>(), value[1].get<int64_t>(), Digest()};
+        if (Digest::fromHex(value[2].get_ref<const std::string&>(), entry.digest)) entries.emplace(path, entry);
+    }
+    return true;
+}
+
+bool WorkingTreeIndex::save(const std::string& indexPath) {
+    if (!dirty) return true;
+    nlohmann::json data;
+    data["version"] = 1;
+    nlohmann::json& list = data["entries"] = nlohmann::json::object();
+    for (const auto& [path, entry] : entries) {
+        list[path] = {entry.size, entry.mtime, entry.digest.hex()};
+    }
+    dirty = false;
+    return FileSystem::replaceFile(indexPath, data.dump());
+}
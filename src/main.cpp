@@ -1,12 +1,23 @@
 #include "../include/VCSCommands.h"
+#include "../include/Trace.h"
+#include "../include/Stats.h"
+#include "../include/Refs.h"
+#include "../include/Repository.h"
+#include "../include/FileSystem.h"
+#include <filesystem>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <memory>
 #include <iostream>
 #include <string>
+#include <vector>
 
 void printHelp()
 {
-    std::cout << "Usage: vcs <command> [arguments]\n";
+    std::cout << "Usage: vcs [--trace=<file.json>] [--stats] <command> [arguments]\n";
     std::cout << "Commands:\n";
-    std::cout << "  init                        Initialize a new repository\n";
+    std::cout << "  init [--content-ids]        Initialize a new repository (optionally with content-addressed commit IDs)\n";
     std::cout << "  add <file>                  Add a file to the staging area\n";
     std::cout << "  commit <message>            Commit changes with a message\n";
     std::cout << "  branch <branch_name>        Create a new branch\n";
@@ -14,12 +25,192 @@ void printHelp()
     std::cout << "  revert <commit_id>          Revert changes to a specific commit\n";
     std::cout << "  merge <source_branch>       Merge another branch into the current one\n";
     std::cout << "  exit                        Exit the program\n";
-    std::cout << "  log                         Show log of commits in current branch\n";
-    std::cout << "  graph                       Show Directed Acyclic Graph of commit history\n";
+    std::cout << "  log [-- <path>]             Show log of commits in current branch (only those touching path)\n";
+    std::cout << "  graph [-n <count>] [<commit>]  Show Directed Acyclic Graph of commit history\n";
+    std::cout << "  stats                       Show cumulative operation counters per command\n";
+    std::cout << "  sparse set|add <path>...    Check out only the given path prefixes\n";
+    std::cout << "  sparse list|disable         Show the sparse prefixes, or go back to a full checkout\n";
+    std::cout << "  blame [<commit|branch>] <file>  Show the commit that last changed each line\n";
+    std::cout << "  archive [-o <file>] [--prefix=<dir>/] [--gzip] <commit|branch>\n";
+    std::cout << "                              Write a tar of a commit from the object store (stdout by default)\n";
+    std::cout << "  fsck [--quick]              Rehash every object and check commits and branches (--quick: existence\n";
+    std::cout << "                              and sizes only); exits non-zero on corruption\n";
+    std::cout << "  push <path> [<branch>...]   Send branches to the repository at path (fast-forward only)\n";
+    std::cout << "  pull <path> [<branch>...]   Fetch branches from the repository at path and fast-forward local ones\n";
+    std::cout << "  bundle create <file> [<branch>...]  Write branches (all by default) and their history to one file\n";
+    std::cout << "  bundle unbundle <file>      Restore a bundle's history and create or fast-forward its branches\n";
+    std::cout << "                              (\"-\" for stdout/stdin)\n";
+    std::cout << "  bitmap [--spacing=<n>]      Write reachability bitmaps for branch heads and every n-th commit (100)\n";
+    std::cout << "  reachable <rev>... [--not <rev>...] [--count]\n";
+    std::cout << "                              List commits and objects reachable from the revs but not the --not ones\n";
+    std::cout << "  batch [<file>]              Run one command per line from a file or stdin in a single process;\n";
+    std::cout << "                              metadata is written at `checkpoint` lines and at the end\n";
     std::cout << "  -h                          Show this help message\n";
+    std::cout << "Options:\n";
+    std::cout << "  --trace=<file.json>         Write a Chrome trace of the command's phases (open in Perfetto)\n";
+    std::cout << "  --stats                     Print this command's operation counters when it finishes\n";
 }
 
-int main(int argc, char *argv[])
+// A whole-string non-negative decimal count; false for anything else ("x", "5x", "", "-1")
+bool parseCount(const std::string &text, size_t &value)
+{
+    const char *end = text.data() + text.size();
+    auto [stop, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && stop == end;
+}
+
+// Commands that only read the repository run side by side; anything that changes it waits
+// for them and runs alone
+bool isReadOnly(int argc, char *argv[])
+{
+    std::string command = argc > 1 ? argv[1] : "";
+    return command == "log" || command == "graph" || command == "stats" || command == "blame" ||
+           command == "archive" || command == "fsck" || command == "reachable" ||
+           (command == "bundle" && argc > 2 && std::string(argv[2]) == "create") ||
+           (command == "sparse" && (argc < 3 || std::string(argv[2]) == "list"));
+}
+
+// Commands whose payload goes to stdout, which --stats and --trace messages must then stay out of
+bool writesToStdout(int argc, char *argv[])
+{
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "archive")
+    {
+        std::string outputPath;
+        for (int i = 2; i + 1 < argc; ++i)
+        {
+            if (std::string(argv[i]) == "-o")
+            {
+                outputPath = argv[++i];
+            }
+        }
+        return outputPath.empty() || outputPath == "-";
+    }
+    return command == "bundle" && argc > 3 && std::string(argv[2]) == "create" && std::string(argv[3]) == "-";
+}
+
+// Commands whose metadata reads all go through FileSystem, so they see writes a batch has not
+// flushed yet; anything else runs after a checkpoint
+bool seesDeferredWrites(const std::string &command)
+{
+    return command == "add" || command == "commit" || command == "branch" || command == "checkout" ||
+           command == "revert" || command == "merge" || command == "log";
+}
+
+// Splits a batch line into arguments; single or double quotes group words, a backslash escapes
+// the next character outside single quotes
+std::vector<std::string> splitCommandLine(const std::string &line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool inWord = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        char c = line[i];
+        if (quote)
+        {
+            if (c == quote)
+                quote = 0;
+            else if (c == '\\' && quote == '"' && i + 1 < line.size())
+                word += line[++i];
+            else
+                word += c;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quote = c;
+            inWord = true;
+        }
+        else if (c == '\\' && i + 1 < line.size())
+        {
+            word += line[++i];
+            inWord = true;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r')
+        {
+            if (inWord)
+                words.push_back(std::move(word));
+            word.clear();
+            inWord = false;
+        }
+        else
+        {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord)
+        words.push_back(std::move(word));
+    return words;
+}
+
+int runCommand(int argc, char *argv[]);
+
+// Runs one command per line in this process: caches are shared and metadata writes are only
+// flushed at `checkpoint` lines and at the end. Holds the repository lock exclusively throughout.
+int runBatch(std::istream &input)
+{
+    VCS_TRACE_SCOPE("batch");
+    std::unique_ptr<RepositoryLock> repositoryLock;
+    FileSystem::deferWrites(true);
+    int status = 0;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber)
+    {
+        std::vector<std::string> words = splitCommandLine(line);
+        if (words.empty() || words[0].starts_with("#"))
+        {
+            continue; // Blank line or comment
+        }
+        if (!repositoryLock && std::filesystem::is_directory(".vcs"))
+        {
+            // Taken once the repository exists; a script may start with `init`
+            repositoryLock = std::make_unique<RepositoryLock>(".vcs", RepositoryLock::Mode::Exclusive);
+        }
+        if (words[0] == "checkpoint" || !seesDeferredWrites(words[0]))
+        {
+            Repository::active().checkpoint();
+            if (words[0] == "checkpoint")
+                continue;
+        }
+        if (words[0] == "exit")
+        {
+            break;
+        }
+        if (words[0] == "batch")
+        {
+            std::cerr << "Error: line " << lineNumber << ": batch cannot be nested" << std::endl;
+            status = 1;
+            continue;
+        }
+
+        std::vector<char *> args = {const_cast<char *>("vcs")};
+        for (auto &word : words)
+        {
+            args.push_back(word.data());
+        }
+        try
+        {
+            if (runCommand(static_cast<int>(args.size()), args.data()) != 0)
+            {
+                std::cerr << "Error: line " << lineNumber << ": " << line << std::endl;
+                status = 1;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            // revert rethrows after reporting; the script carries on
+            std::cerr << "Error: line " << lineNumber << ": " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    Repository::active().checkpoint();
+    FileSystem::deferWrites(false);
+    return status;
+}
+
+int runCommand(int argc, char *argv[])
 {
     if (argc < 2)
     {
@@ -36,7 +227,8 @@ int main(int argc, char *argv[])
     }
     if (command == "init")
     {
-        VCSCommands::init();
+        bool contentIds = argc > 2 && std::string(argv[2]) == "--content-ids";
+        VCSCommands::init(contentIds);
     }
     else if (command == "add")
     {
@@ -56,7 +248,7 @@ int main(int argc, char *argv[])
             return 1; // Missing commit message
         }
         std::string message = argv[2]; // Use the third argument as the commit message
-        VCSCommands::commit(message);
+        return VCSCommands::commit(message) ? 0 : 1;
     }
     else if (command == "branch")
     {
@@ -66,7 +258,7 @@ int main(int argc, char *argv[])
             return 1; // Missing branch name
         }
         std::string branchName = argv[2];
-        VCSCommands::branch(branchName);
+        return VCSCommands::branch(branchName) ? 0 : 1;
     }
     else if (command == "checkout")
     {
@@ -76,7 +268,7 @@ int main(int argc, char *argv[])
             return 1; // Missing branch name
         }
         std::string branchName = argv[2];
-        VCSCommands::checkout(branchName);
+        return VCSCommands::checkout(branchName) ? 0 : 1;
     }
     else if (command == "revert")
     {
@@ -96,15 +288,167 @@ int main(int argc, char *argv[])
             return 1; // Missing source branch
         }
         std::string sourceBranch = argv[2];
-        VCSCommands::merge(sourceBranch);
+        return VCSCommands::merge(sourceBranch) ? 0 : 1;
     }
     else if (command == "log")
     {
-        VCSCommands::log(); // Call the log command
+        // `log -- <path>` or `log <path>`
+        int pathIndex = (argc > 2 && std::string(argv[2]) == "--") ? 3 : 2;
+        VCSCommands::log(argc > pathIndex ? argv[pathIndex] : ""); // Call the log command
     }
-        else if (command == "graph")
+    else if (command == "graph")
     {
-        VCSCommands::graph(); // Call the log command
+        std::string tip;
+        size_t limit = 0;
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "-n")
+            {
+                if (i + 1 >= argc || !parseCount(argv[++i], limit))
+                {
+                    std::cout << "Usage: vcs graph [-n <count>] [<commit>]" << std::endl;
+                    return 1; // Bad count
+                }
+            }
+            else
+            {
+                tip = arg;
+            }
+        }
+        VCSCommands::graph(tip, limit);
+    }
+    else if (command == "stats")
+    {
+        Stats::report();
+    }
+    else if (command == "blame")
+    {
+        if (argc < 3)
+        {
+            std::cout << "Usage: vcs blame [<commit|branch>] <file>" << std::endl;
+            return 1; // Missing file
+        }
+        std::string revision = argc > 3 ? argv[2] : "";
+        std::string filePath = argv[argc > 3 ? 3 : 2];
+        VCSCommands::blame(filePath, revision);
+    }
+    else if (command == "archive")
+    {
+        std::string revision;
+        std::string outputPath;
+        std::string prefix;
+        bool gzip = false;
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "-o" && i + 1 < argc)
+            {
+                outputPath = argv[++i];
+            }
+            else if (arg.starts_with("--prefix="))
+            {
+                prefix = arg.substr(9);
+            }
+            else if (arg == "--gzip" || arg == "-z")
+            {
+                gzip = true;
+            }
+            else
+            {
+                revision = arg;
+            }
+        }
+        if (revision.empty())
+        {
+            std::cout << "Usage: vcs archive [-o <file>] [--prefix=<dir>/] [--gzip] <commit|branch>" << std::endl;
+            return 1; // Missing revision
+        }
+        // Compress when the output name asks for it
+        gzip = gzip || outputPath.ends_with(".tar.gz") || outputPath.ends_with(".tgz");
+        return VCSCommands::archive(revision, outputPath, prefix, gzip) ? 0 : 1;
+    }
+    else if (command == "sparse")
+    {
+        std::string action = argc > 2 ? argv[2] : "list";
+        if ((action == "set" || action == "add") && argc < 4)
+        {
+            std::cout << "Usage: vcs sparse " << action << " <path>..." << std::endl;
+            return 1; // Missing paths
+        }
+        VCSCommands::sparse(action, std::vector<std::string>(argv + std::min(argc, 3), argv + argc));
+    }
+    else if (command == "fsck")
+    {
+        bool quick = argc > 2 && std::string(argv[2]) == "--quick";
+        return VCSCommands::fsck(quick) ? 0 : 1;
+    }
+    else if (command == "push" || command == "pull")
+    {
+        if (argc < 3)
+        {
+            std::cout << "Usage: vcs " << command << " <path> [<branch>...]" << std::endl;
+            return 1; // Missing path
+        }
+        std::vector<std::string> branches(argv + 3, argv + argc);
+        bool ok = command == "push" ? VCSCommands::push(argv[2], branches) : VCSCommands::pull(argv[2], branches);
+        return ok ? 0 : 1;
+    }
+    else if (command == "bundle")
+    {
+        std::string action = argc > 2 ? argv[2] : "";
+        if (argc < 4 || (action != "create" && action != "unbundle"))
+        {
+            std::cout << "Usage: vcs bundle create <file> [<branch>...] | vcs bundle unbundle <file>" << std::endl;
+            return 1; // Missing action or file
+        }
+        bool ok = action == "create" ? VCSCommands::bundleCreate(argv[3], std::vector<std::string>(argv + 4, argv + argc))
+                                     : VCSCommands::unbundle(argv[3]);
+        return ok ? 0 : 1;
+    }
+    else if (command == "bitmap")
+    {
+        size_t spacing = 100;
+        if (argc > 2 && std::string(argv[2]).starts_with("--spacing=") &&
+            !parseCount(std::string(argv[2]).substr(10), spacing))
+        {
+            std::cout << "Usage: vcs bitmap [--spacing=<n>]" << std::endl;
+            return 1; // Bad spacing
+        }
+        VCSCommands::bitmap(spacing);
+    }
+    else if (command == "reachable")
+    {
+        std::vector<std::string> include;
+        std::vector<std::string> exclude;
+        bool countOnly = false;
+        bool negate = false;
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--count")
+            {
+                countOnly = true;
+            }
+            else if (arg == "--not")
+            {
+                negate = true;
+            }
+            else if (arg.starts_with("^"))
+            {
+                exclude.push_back(arg.substr(1));
+            }
+            else
+            {
+                (negate ? exclude : include).push_back(arg);
+            }
+        }
+        if (include.empty())
+        {
+            std::cout << "Usage: vcs reachable <rev>... [--not <rev>...] [--count]" << std::endl;
+            return 1; // Missing revision
+        }
+        VCSCommands::reachable(include, exclude, countOnly);
     }
     else if (command == "exit")
     {
@@ -119,3 +463,102 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+int main(int argc, char *argv[])
+{
+    // Strip global options that precede the command
+    std::string tracePath;
+    bool printStats = false;
+    std::vector<char *> args = {argv[0]};
+    int i = 1;
+    for (; i < argc && std::string(argv[i]).starts_with("--"); ++i)
+    {
+        std::string option = argv[i];
+        if (option.starts_with("--trace="))
+        {
+            tracePath = option.substr(8);
+            Trace::enable();
+        }
+        else if (option == "--stats")
+        {
+            printStats = true;
+        }
+        else
+        {
+            std::cout << "Unknown option: " << option << std::endl;
+            printHelp();
+            return 1;
+        }
+    }
+    args.insert(args.end(), argv + i, argv + argc);
+
+    std::string command = args.size() > 1 ? args[1] : "";
+    int status = 0;
+    if (command == "batch")
+    {
+        if (args.size() > 2 && std::string(args[2]) != "-")
+        {
+            std::ifstream script(args[2]);
+            if (!script)
+            {
+                std::cerr << "Error: Could not open " << args[2] << std::endl;
+                return 1;
+            }
+            status = runBatch(script);
+        }
+        else
+        {
+            status = runBatch(std::cin);
+        }
+    }
+    else
+    {
+        std::unique_ptr<RepositoryLock> repositoryLock;
+        if (std::filesystem::is_directory(".vcs") && command != "-h" && command != "exit")
+        {
+            repositoryLock = std::make_unique<RepositoryLock>(
+                ".vcs", isReadOnly(static_cast<int>(args.size()), args.data()) ? RepositoryLock::Mode::Shared
+                                                                               : RepositoryLock::Mode::Exclusive);
+        }
+        try
+        {
+            status = runCommand(static_cast<int>(args.size()), args.data());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (printStats)
+    {
+        std::ostream &out = writesToStdout(static_cast<int>(args.size()), args.data()) ? std::cerr : std::cout;
+        out << "Operation counters:\n";
+        Stats::print(out, Stats::snapshot());
+    }
+    if (!command.empty() && command != "stats" && command != "-h" && command != "exit")
+    {
+        // stats.json is read-modify-write, so even read-only commands update it alone
+        std::unique_ptr<RepositoryLock> statsLock;
+        if (std::filesystem::is_directory(".vcs"))
+        {
+            statsLock = std::make_unique<RepositoryLock>(".vcs", RepositoryLock::Mode::Exclusive);
+        }
+        Stats::persist(command);
+    }
+
+    if (!tracePath.empty())
+    {
+        if (Trace::writeChromeTrace(tracePath))
+        {
+            std::ostream &out = writesToStdout(static_cast<int>(args.size()), args.data()) ? std::cerr : std::cout;
+            out << "Trace written to '" << tracePath << "'." << std::endl;
+        }
+        else
+        {
+            std::cerr << "Error: Could not write trace file: " << tracePath << std::endl;
+        }
+    }
+    return status;
+}
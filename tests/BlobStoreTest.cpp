@@ -0,0 +1,127 @@
+#include "Check.h"
+#include "../include/BlobStore.h"
+#include "../include/Chunker.h"
+#include "../include/Repository.h"
+#include "../include/VCSCommands.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Discards the commands' progress output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static void writeFile(const fs::path& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+static std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::string randomBytes(std::mt19937_64& random, size_t size) {
+    std::string bytes(size, '\0');
+    for (char& c : bytes) c = static_cast<char>(random());
+    return bytes;
+}
+
+static std::vector<std::string> chunksOf(const fs::path& path) {
+    std::vector<std::string> chunks;
+    CHECK(Chunker::chunkFile(path.string(), [&](const uint8_t* data, size_t length) {
+        chunks.emplace_back(reinterpret_cast<const char*>(data), length);
+    }));
+    return chunks;
+}
+
+static void testChunker(const fs::path& scratch) {
+    std::mt19937_64 random(7);
+    std::string data = randomBytes(random, 2 * 1024 * 1024 + 123);
+    fs::path path = scratch / "data.bin";
+    writeFile(path, data);
+
+    // Chunks cover the file in order, and all but the last respect the size bounds
+    std::vector<std::string> chunks = chunksOf(path);
+    std::string joined;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        joined += chunks[i];
+        if (i + 1 < chunks.size()) CHECK(chunks[i].size() >= Chunker::minSize && chunks[i].size() <= Chunker::maxSize);
+    }
+    CHECK(joined == data);
+    CHECK(chunks.size() > 1);
+
+    // Below the minimum there is nothing to cut
+    CHECK(Chunker::cut(reinterpret_cast<const uint8_t*>(data.data()), Chunker::minSize - 1) == Chunker::minSize - 1);
+
+    // An insert near the front only changes the chunks around it
+    std::string edited = data;
+    edited.insert(100 * 1024, "inserted bytes");
+    writeFile(path, edited);
+    std::vector<std::string> editedChunks = chunksOf(path);
+    std::set<std::string> before(chunks.begin(), chunks.end());
+    size_t shared = 0;
+    for (const auto& chunk : editedChunks) shared += before.count(chunk);
+    CHECK(shared + 3 >= chunks.size());
+}
+
+// User files named like the object folder's bookkeeping are stored and restored as content
+static void testReservedNames(const fs::path& scratch) {
+    fs::path root = scratch / "repository";
+    fs::create_directories(root);
+    const std::string manifestLike = "{\"chunks\": [], \"size\": 0}\n";
+    const std::string hashLike = "{\"file_name\": \"x\"}\n";
+    writeFile(root / "chunks.json", manifestLike);
+    writeFile(root / "hash.json", hashLike);
+
+    Repository repository(root.string());
+    repository.run([&] {
+        VCSCommands::init();
+        VCSCommands::add("all");
+        VCSCommands::commit("bookkeeping names");
+    });
+    std::string head = repository.branchHead("master");
+    CHECK(!head.empty());
+
+    for (const auto& entry : repository.commitTree(head)) {
+        std::string name = fs::path(std::string(entry.path)).filename().string();
+        std::string expected = name == "chunks.json" ? manifestLike : hashLike;
+        repository.run([&] {
+            std::string folder = BlobStore::objectPath(entry.digest);
+            CHECK(!BlobStore::isChunked(folder));
+            uint64_t size = 0;
+            CHECK(BlobStore::size(folder, size) && size == expected.size());
+            std::string content;
+            CHECK(BlobStore::read(folder, content) && content == expected);
+            fs::path restored = scratch / ("restored-" + name);
+            CHECK(BlobStore::restore(folder, restored.string()) && readFile(restored) == expected);
+        });
+    }
+
+    bool clean = false;
+    repository.run([&] { clean = VCSCommands::fsck(); });
+    CHECK(clean);
+}
+
+int main() {
+    NullBuffer null;
+    std::streambuf* original = std::cout.rdbuf(&null);
+
+    fs::path scratch = fs::temp_directory_path() / ("vcs_blob_store_test_" + std::to_string(getpid()));
+    fs::remove_all(scratch);
+    fs::create_directories(scratch);
+
+    testChunker(scratch);
+    testReservedNames(scratch);
+
+    std::cout.rdbuf(original);
+    fs::remove_all(scratch);
+    return testResult();
+}
@@ -0,0 +1,26 @@
+#ifndef VCS_TESTS_CHECK_H
+#define VCS_TESTS_CHECK_H
+
+#include <iostream>
+
+// Minimal assertions for the test executables: a failed CHECK is reported and counted, and the
+// test's main returns testResult() so ctest sees the failure
+inline int& failedChecks() {
+    static int failed = 0;
+    return failed;
+}
+
+#define CHECK(condition)                                                                         \
+    do {                                                                                         \
+        if (!(condition)) {                                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n";      \
+            ++failedChecks();                                                                    \
+        }                                                                                        \
+    } while (0)
+
+inline int testResult() {
+    if (failedChecks() > 0) std::cerr << failedChecks() << " check(s) failed\n";
+    return failedChecks() > 0 ? 1 : 0;
+}
+
+#endif // VCS_TESTS_CHECK_H
@@ -0,0 +1,138 @@
+#include "Check.h"
+#include "../include/EwahBitmap.h"
+#include <bit>
+#include <random>
+
+using Words = std::vector<uint64_t>;
+
+static Words trimmed(Words words) {
+    while (!words.empty() && words.back() == 0) words.pop_back();
+    return words;
+}
+
+static Words plainOf(const EwahBitmap& bitmap) {
+    Words plain;
+    bitmap.orInto(plain);
+    return trimmed(plain);
+}
+
+// Runs of zeros, runs of ones and literals, in random lengths and order
+static Words randomWords(std::mt19937_64& random) {
+    Words words;
+    size_t pieces = random() % 12;
+    for (size_t i = 0; i < pieces; ++i) {
+        size_t length = 1 + random() % (random() % 4 == 0 ? 300 : 5);
+        switch (random() % 3) {
+        case 0: words.insert(words.end(), length, 0); break;
+        case 1: words.insert(words.end(), length, ~uint64_t(0)); break;
+        default:
+            for (size_t j = 0; j < length; ++j) words.push_back(random() | 1); // Never all zeros
+        }
+    }
+    return words;
+}
+
+static Words combined(const Words& a, const Words& b, bool andNot) {
+    Words result(std::max(a.size(), b.size()), 0);
+    for (size_t i = 0; i < result.size(); ++i) {
+        uint64_t x = i < a.size() ? a[i] : 0, y = i < b.size() ? b[i] : 0;
+        result[i] = andNot ? x & ~y : x | y;
+    }
+    return trimmed(result);
+}
+
+static void checkAgainstPlain(const EwahBitmap& bitmap, const Words& plain) {
+    CHECK(plainOf(bitmap) == trimmed(plain));
+    uint64_t count = 0;
+    for (uint64_t word : plain) count += std::popcount(word);
+    CHECK(bitmap.count() == count);
+
+    Words visited;
+    uint64_t last = 0;
+    bool ordered = true, first = true;
+    bitmap.forEach([&](uint64_t position) {
+        ordered = ordered && (first || position > last);
+        first = false;
+        last = position;
+        if (position / 64 >= visited.size()) visited.resize(position / 64 + 1, 0);
+        visited[position / 64] |= uint64_t(1) << (position % 64);
+    });
+    CHECK(ordered);
+    CHECK(visited == trimmed(plain));
+
+    for (uint64_t position : {uint64_t(0), uint64_t(63), uint64_t(64), uint64_t(1000), 64 * plain.size() + 5}) {
+        bool expected = position / 64 < plain.size() && ((plain[position / 64] >> (position % 64)) & 1);
+        CHECK(bitmap.get(position) == expected);
+    }
+}
+
+static void operationsMatchPlainBitsets() {
+    std::mt19937_64 random(7);
+    for (int round = 0; round < 300; ++round) {
+        Words a = randomWords(random), b = randomWords(random);
+        EwahBitmap left = EwahBitmap::fromWords(a), right = EwahBitmap::fromWords(b);
+        checkAgainstPlain(left, a);
+        checkAgainstPlain(left | right, combined(a, b, false));
+        checkAgainstPlain(left.andNot(right), combined(a, b, true));
+        checkAgainstPlain(right.andNot(left), combined(b, a, true));
+    }
+}
+
+static void runsAcrossLiterals() {
+    // A long run on one side meets literals on the other, with the boundaries out of step
+    Words ones(100, ~uint64_t(0));
+    Words mixed = {0x5, 0, 0, 0x80, ~uint64_t(0), ~uint64_t(0), 0x1};
+    mixed.resize(150, 0);
+    mixed.push_back(0xF0);
+    EwahBitmap a = EwahBitmap::fromWords(ones), b = EwahBitmap::fromWords(mixed);
+    checkAgainstPlain(a | b, combined(ones, mixed, false));
+    checkAgainstPlain(a.andNot(b), combined(ones, mixed, true));
+    checkAgainstPlain(b.andNot(a), combined(mixed, ones, true));
+    CHECK(a.compressedWords() == 1); // One marker for the whole run
+}
+
+static void trailingZerosAreTrimmed() {
+    EwahBitmap padded = EwahBitmap::fromWords({0x3, 0, 0, 0, 0});
+    EwahBitmap plain = EwahBitmap::fromWords({0x3});
+    CHECK(padded.compressedWords() == plain.compressedWords());
+    CHECK(padded.serialize() == plain.serialize());
+
+    EwahBitmap empty = EwahBitmap::fromWords({0, 0, 0});
+    CHECK(empty.compressedWords() == 0 && empty.count() == 0);
+
+    // Subtracting everything leaves nothing behind, not a run of zeros
+    EwahBitmap all = EwahBitmap::fromWords({0x3, ~uint64_t(0), 0x9});
+    EwahBitmap none = all.andNot(all);
+    CHECK(none.compressedWords() == 0 && none.count() == 0);
+    CHECK(none.serialize() == EwahBitmap().serialize());
+}
+
+static void serializationRoundTrips() {
+    std::mt19937_64 random(11);
+    for (int round = 0; round < 100; ++round) {
+        Words words = randomWords(random);
+        EwahBitmap bitmap = EwahBitmap::fromWords(words);
+        std::string data = bitmap.serialize();
+        CHECK(data.size() == 8 * (bitmap.compressedWords() + 1));
+        EwahBitmap restored;
+        CHECK(EwahBitmap::deserialize(data, restored));
+        CHECK(restored.serialize() == data);
+        checkAgainstPlain(restored, words);
+    }
+
+    EwahBitmap ignored;
+    CHECK(!EwahBitmap::deserialize("", ignored));
+    CHECK(!EwahBitmap::deserialize(std::string(12, '\0'), ignored));
+    // A marker claiming two literal words that are not there
+    std::string data = EwahBitmap::fromWords({0x5}).serialize();
+    data[8 + 4] = 0x04; // Bit 34 of the marker: literal count 2
+    CHECK(!EwahBitmap::deserialize(data, ignored));
+}
+
+int main() {
+    operationsMatchPlainBitsets();
+    runsAcrossLiterals();
+    trailingZerosAreTrimmed();
+    serializationRoundTrips();
+    return testResult();
+}
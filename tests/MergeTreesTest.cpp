@@ -0,0 +1,110 @@
+#include "Check.h"
+#include "../include/MergeHandler.h"
+#include <initializer_list>
+#include <utility>
+
+// A tree from (path, content) pairs; the digest is the content's SHA-256
+static Tree makeTree(std::initializer_list<std::pair<const char*, const char*>> files) {
+    Tree tree;
+    for (const auto& [path, content] : files) tree.insert(path, Digest::of(content));
+    tree.finalize();
+    return tree;
+}
+
+static const MergeEntry* changeAt(const TreeMergeResult& result, const std::string& path) {
+    for (const auto& change : result.changes) {
+        if (change.path == path) return &change;
+    }
+    return nullptr;
+}
+
+static void oneSidedChanges() {
+    Tree base = makeTree({{"./a", "a"}, {"./b", "b"}, {"./c", "c"}});
+    Tree ours = makeTree({{"./a", "a2"}, {"./b", "b"}, {"./c", "c"}, {"./d", "d"}});
+    Tree theirs = makeTree({{"./a", "a"}, {"./c", "c"}});
+    TreeMergeResult result = MergeHandler::mergeTrees(base, ours, theirs);
+
+    CHECK(result.conflicts == 0);
+    CHECK(result.tree == makeTree({{"./a", "a2"}, {"./c", "c"}, {"./d", "d"}}));
+    CHECK(result.changes.size() == 3);
+    const MergeEntry* a = changeAt(result, "./a");
+    CHECK(a && a->action == MergeAction::Modified && a->side == MergeSide::Ours);
+    const MergeEntry* b = changeAt(result, "./b");
+    CHECK(b && b->action == MergeAction::Deleted && b->side == MergeSide::Theirs && b->theirs.isNull());
+    const MergeEntry* d = changeAt(result, "./d");
+    CHECK(d && d->action == MergeAction::Added && d->base.isNull());
+    CHECK(!changeAt(result, "./c"));
+}
+
+static void sameChangeOnBothSides() {
+    Tree base = makeTree({{"./a", "a"}, {"./b", "b"}});
+    Tree both = makeTree({{"./a", "a2"}, {"./n", "n"}});
+    TreeMergeResult result = MergeHandler::mergeTrees(base, both, both);
+
+    CHECK(result.conflicts == 0);
+    CHECK(result.tree == both);
+    for (const auto& change : result.changes) CHECK(change.side == MergeSide::Both);
+    CHECK(changeAt(result, "./b") && changeAt(result, "./b")->action == MergeAction::Deleted);
+}
+
+static void conflictsKeepOurVersion() {
+    Tree base = makeTree({{"./a", "a"}, {"./m", "m"}});
+    Tree ours = makeTree({{"./a", "ours"}, {"./m", "m2"}, {"./z", "z1"}});
+    Tree theirs = makeTree({{"./a", "theirs"}, {"./z", "z2"}});
+    TreeMergeResult result = MergeHandler::mergeTrees(base, ours, theirs);
+
+    // Modify/modify, modify/delete and add/add
+    CHECK(result.conflicts == 3);
+    CHECK(result.tree == ours);
+    for (const auto& change : result.changes) CHECK(change.action == MergeAction::Conflict);
+}
+
+static void disjointAndEmptyTrees() {
+    Tree empty;
+    Tree ours = makeTree({{"./a", "a"}, {"./c", "c"}});
+    Tree theirs = makeTree({{"./b", "b"}, {"./d", "d"}});
+    TreeMergeResult result = MergeHandler::mergeTrees(empty, ours, theirs);
+    CHECK(result.conflicts == 0);
+    CHECK(result.tree == makeTree({{"./a", "a"}, {"./b", "b"}, {"./c", "c"}, {"./d", "d"}}));
+    CHECK(result.changes.size() == 4);
+
+    TreeMergeResult nothing = MergeHandler::mergeTrees(empty, empty, empty);
+    CHECK(nothing.tree.empty() && nothing.changes.empty());
+}
+
+static void renameOnOneSideIsFollowed() {
+    Tree base = makeTree({{"./old", "content"}, {"./x", "x"}});
+    Tree ours = makeTree({{"./new", "content"}, {"./x", "x"}});
+    Tree theirs = makeTree({{"./old", "content"}, {"./x", "x2"}});
+    std::vector<Rename> followed;
+    TreeMergeResult result = MergeHandler::mergeTreesFollowingRenames(base, ours, theirs, followed);
+
+    CHECK(result.conflicts == 0);
+    CHECK(followed.size() == 1 && followed[0].from == "./old" && followed[0].to == "./new");
+    CHECK(result.tree == makeTree({{"./new", "content"}, {"./x", "x2"}}));
+}
+
+static void renameToDifferentNamesConflicts() {
+    Tree base = makeTree({{"./old", "content"}});
+    Tree ours = makeTree({{"./ours", "content"}});
+    Tree theirs = makeTree({{"./theirs", "content"}});
+    std::vector<Rename> followed;
+    TreeMergeResult result = MergeHandler::mergeTreesFollowingRenames(base, ours, theirs, followed);
+
+    CHECK(followed.empty());
+    CHECK(result.conflicts == 2);
+    const MergeEntry* our = changeAt(result, "./ours");
+    const MergeEntry* their = changeAt(result, "./theirs");
+    CHECK(our && our->action == MergeAction::Conflict && our->renamedFrom == "./old");
+    CHECK(their && their->action == MergeAction::Conflict && their->renamedFrom == "./old");
+}
+
+int main() {
+    oneSidedChanges();
+    sameChangeOnBothSides();
+    conflictsKeepOurVersion();
+    disjointAndEmptyTrees();
+    renameOnOneSideIsFollowed();
+    renameToDifferentNamesConflicts();
+    return testResult();
+}
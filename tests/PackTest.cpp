@@ -0,0 +1,131 @@
+#include "Check.h"
+#include "../include/BlobStore.h"
+#include "../include/Pack.h"
+#include "../include/Repository.h"
+#include "../include/VCSCommands.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Discards the commands' progress output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static void writeFile(const fs::path& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+// An initialized repository at `root`, with `files` committed if there are any
+static void makeRepository(const fs::path& root, const std::vector<std::pair<std::string, std::string>>& files) {
+    fs::create_directories(root);
+    for (const auto& [name, content] : files) writeFile(root / name, content);
+    Repository repository(root.string());
+    repository.run([&] {
+        VCSCommands::init();
+        if (files.empty()) return;
+        VCSCommands::add("all");
+        VCSCommands::commit("initial");
+    });
+}
+
+static std::string objectContent(Repository& repository, const Digest& digest) {
+    std::string content;
+    repository.run([&] { BlobStore::read(BlobStore::objectPath(digest), content); });
+    return content;
+}
+
+int main() {
+    NullBuffer null;
+    std::streambuf* original = std::cout.rdbuf(&null);
+
+    fs::path scratch = fs::temp_directory_path() / ("vcs_pack_test_" + std::to_string(getpid()));
+    fs::remove_all(scratch);
+
+    // Large enough to be stored in chunks, random so the chunks differ
+    std::mt19937_64 random(42);
+    std::string big(3 * BlobStore::chunkThreshold, '\0');
+    for (char& c : big) c = static_cast<char>(random());
+    makeRepository(scratch / "source", {{"small.txt", "hello\n"}, {"big.bin", big}});
+
+    Repository source((scratch / "source").string());
+    std::string head = source.branchHead("master");
+    std::vector<Digest> objects;
+    for (const auto& entry : source.commitTree(head)) objects.push_back(entry.digest);
+    CHECK(!head.empty() && objects.size() == 2);
+    nlohmann::json refs = {{"master", {{"branch_name", "master"}, {"head", head}, {"commits", {head}}}}};
+
+    std::stringstream pack;
+    PackSummary written;
+    std::string error;
+    CHECK(Pack::write(pack, (scratch / "source").string(), refs, {head}, objects, [](const Digest&) { return false; },
+                      written, error));
+    CHECK(written.commits == 1 && written.objects == 2 && written.chunks > 1);
+    std::string bytes = pack.str();
+    CHECK(written.bytes == bytes.size());
+
+    // Round trip: everything arrives and reads back the same
+    {
+        makeRepository(scratch / "target", {});
+        std::istringstream in(bytes);
+        nlohmann::json receivedRefs;
+        PackSummary received;
+        CHECK(Pack::read(in, (scratch / "target").string(), receivedRefs, received, error));
+        CHECK(receivedRefs == refs);
+        CHECK(received.commits == written.commits && received.objects == written.objects &&
+              received.chunks == written.chunks && received.bytes == written.bytes);
+        Repository target((scratch / "target").string());
+        CHECK(target.commit(head) != nullptr);
+        for (const auto& digest : objects) CHECK(objectContent(target, digest) == objectContent(source, digest));
+    }
+
+    // A flipped byte anywhere or a missing tail is rejected, and no commit becomes visible
+    for (size_t offset : {size_t(20), bytes.size() / 2, bytes.size() - 10}) {
+        std::string damaged = bytes;
+        damaged[offset] ^= 0x20;
+        fs::path root = scratch / ("damaged" + std::to_string(offset));
+        makeRepository(root, {});
+        std::istringstream in(damaged);
+        nlohmann::json receivedRefs;
+        PackSummary received;
+        CHECK(!Pack::read(in, root.string(), receivedRefs, received, error));
+        CHECK(!fs::exists(root / ".vcs/commits" / (head + ".json")));
+    }
+    {
+        fs::path root = scratch / "truncated";
+        makeRepository(root, {});
+        std::istringstream in(bytes.substr(0, bytes.size() - 1));
+        nlohmann::json receivedRefs;
+        PackSummary received;
+        CHECK(!Pack::read(in, root.string(), receivedRefs, received, error));
+        CHECK(!fs::exists(root / ".vcs/commits" / (head + ".json")));
+    }
+
+    // Refs that would escape `.vcs/branches/`, are not objects, or point at unknown commits are
+    // rejected, and nothing from the pack becomes visible
+    for (const nlohmann::json& badRefs :
+         {nlohmann::json{{"../../escaped", refs["master"]}}, nlohmann::json{{"master", 5}},
+          nlohmann::json{{"master", {{"branch_name", "master"}, {"head", "unknown"}, {"commits", {"unknown"}}}}}}) {
+        std::stringstream badPack;
+        CHECK(Pack::write(badPack, (scratch / "source").string(), badRefs, {head}, objects,
+                          [](const Digest&) { return false; }, written, error));
+        fs::path root = scratch / "badrefs";
+        fs::remove_all(root);
+        makeRepository(root, {});
+        nlohmann::json receivedRefs;
+        PackSummary received;
+        CHECK(!Pack::read(badPack, root.string(), receivedRefs, received, error));
+        CHECK(!fs::exists(root / ".vcs/commits" / (head + ".json")));
+        CHECK(!fs::exists(scratch / "escaped.json"));
+    }
+
+    std::cout.rdbuf(original);
+    fs::remove_all(scratch);
+    return testResult();
+}